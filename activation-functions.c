@@ -1,4 +1,7 @@
 #include <math.h>
+#include <string.h>
+
+#include "simd-kernels.h"
 
 #include "activation-functions.h"
 
@@ -62,3 +65,230 @@ sigmoid_derivative (const double value_before_activation,
   return value_after_activation * (1.0 - value_after_activation);
 }
 
+
+void
+elliott_activation_array (const real_t* const x,
+                          real_t*       const y,
+                          const size_t        n)
+{
+  get_simd_kernels()->elliott(x, y, n, 0.5, 0.5);
+}
+
+void
+elliott_derivative_array (const real_t* const values_before_activation,
+                          const real_t* const values_after_activation,
+                          real_t*       const derivatives,
+                          const size_t        n)
+{
+  (void) values_after_activation;
+  get_simd_kernels()->elliott_derivative(values_before_activation, derivatives, n, 2.0);
+}
+
+void
+elliott_symmetric_activation_array (const real_t* const x,
+                                    real_t*       const y,
+                                    const size_t        n)
+{
+  get_simd_kernels()->elliott(x, y, n, 1.0, 0.0);
+}
+
+void
+elliott_symmetric_derivative_array (const real_t* const values_before_activation,
+                                    const real_t* const values_after_activation,
+                                    real_t*       const derivatives,
+                                    const size_t        n)
+{
+  (void) values_after_activation;
+  get_simd_kernels()->elliott_derivative(values_before_activation, derivatives, n, 1.0);
+}
+
+void
+tanh_activation_array (const real_t* const x,
+                       real_t*       const y,
+                       const size_t        n)
+{
+  size_t i;
+  for (i = 0; i < n; ++i)
+  {
+    y[i] = tanh(x[i]);
+  }
+}
+
+void
+tanh_derivative_array (const real_t* const values_before_activation,
+                       const real_t* const values_after_activation,
+                       real_t*       const derivatives,
+                       const size_t        n)
+{
+  (void) values_before_activation;
+  get_simd_kernels()->tanh_derivative(values_after_activation, derivatives, n);
+}
+
+void
+sigmoid_activation_array (const real_t* const x,
+                          real_t*       const y,
+                          const size_t        n)
+{
+  size_t i;
+  for (i = 0; i < n; ++i)
+  {
+    y[i] = 1.0 / (1.0 + exp(-1.0 * x[i]));
+  }
+}
+
+void
+sigmoid_derivative_array (const real_t* const values_before_activation,
+                          const real_t* const values_after_activation,
+                          real_t*       const derivatives,
+                          const size_t        n)
+{
+  (void) values_before_activation;
+  get_simd_kernels()->sigmoid_derivative(values_after_activation, derivatives, n);
+}
+
+double
+fast_tanh_activation (const double x)
+{
+  const real_t input = x;
+  real_t output;
+  fast_tanh_activation_array(&input, &output, 1);
+  return output;
+}
+
+double
+fast_sigmoid_activation (const double x)
+{
+  const real_t input = x;
+  real_t output;
+  fast_sigmoid_activation_array(&input, &output, 1);
+  return output;
+}
+
+void
+fast_tanh_activation_array (const real_t* const x,
+                            real_t*       const y,
+                            const size_t        n)
+{
+  get_simd_kernels()->fast_tanh(x, y, n);
+}
+
+void
+fast_sigmoid_activation_array (const real_t* const x,
+                               real_t*       const y,
+                               const size_t        n)
+{
+  get_simd_kernels()->fast_sigmoid(x, y, n);
+}
+
+static real_t tanh_lookup_table[ACTIVATION_LOOKUP_TABLE_SIZE + 1];
+static real_t sigmoid_lookup_table[ACTIVATION_LOOKUP_TABLE_SIZE + 1];
+
+__attribute__((constructor)) static void
+_initialize_lookup_tables ()
+{
+  size_t i;
+  for (i = 0; i <= ACTIVATION_LOOKUP_TABLE_SIZE; ++i)
+  {
+    const double x = -ACTIVATION_LOOKUP_TABLE_RANGE
+      + i * (2.0 * ACTIVATION_LOOKUP_TABLE_RANGE / ACTIVATION_LOOKUP_TABLE_SIZE);
+    tanh_lookup_table[i] = tanh_activation(x);
+    sigmoid_lookup_table[i] = sigmoid_activation(x);
+  }
+}
+
+static inline real_t
+_lookup (const real_t* const table,
+         const real_t        x)
+{
+  const real_t position = (x + (real_t) ACTIVATION_LOOKUP_TABLE_RANGE)
+    * (real_t) (ACTIVATION_LOOKUP_TABLE_SIZE / (2.0 * ACTIVATION_LOOKUP_TABLE_RANGE));
+  // Also catches NaN.
+  if (!(position > 0))
+    return table[0];
+  if (position >= ACTIVATION_LOOKUP_TABLE_SIZE)
+    return table[ACTIVATION_LOOKUP_TABLE_SIZE];
+
+  const size_t index = (size_t) position;
+  const real_t fraction = position - index;
+  return table[index] + fraction * (table[index + 1] - table[index]);
+}
+
+double
+lookup_tanh_activation (const double x)
+{
+  return _lookup(tanh_lookup_table, x);
+}
+
+double
+lookup_sigmoid_activation (const double x)
+{
+  return _lookup(sigmoid_lookup_table, x);
+}
+
+void
+lookup_tanh_activation_array (const real_t* const x,
+                              real_t*       const y,
+                              const size_t        n)
+{
+  size_t i;
+  for (i = 0; i < n; ++i)
+  {
+    y[i] = _lookup(tanh_lookup_table, x[i]);
+  }
+}
+
+void
+lookup_sigmoid_activation_array (const real_t* const x,
+                                 real_t*       const y,
+                                 const size_t        n)
+{
+  size_t i;
+  for (i = 0; i < n; ++i)
+  {
+    y[i] = _lookup(sigmoid_lookup_table, x[i]);
+  }
+}
+
+static const activation_functions_t activation_functions[] =
+{
+  { "elliott", &elliott_activation, &elliott_derivative,
+    &elliott_activation_array, &elliott_derivative_array },
+  { "elliott_symmetric", &elliott_symmetric_activation, &elliott_symmetric_derivative,
+    &elliott_symmetric_activation_array, &elliott_symmetric_derivative_array },
+  { "tanh", &tanh_activation, &tanh_derivative,
+    &tanh_activation_array, &tanh_derivative_array },
+  { "sigmoid", &sigmoid_activation, &sigmoid_derivative,
+    &sigmoid_activation_array, &sigmoid_derivative_array },
+  { "fast_tanh", &fast_tanh_activation, &tanh_derivative,
+    &fast_tanh_activation_array, &tanh_derivative_array },
+  { "fast_sigmoid", &fast_sigmoid_activation, &sigmoid_derivative,
+    &fast_sigmoid_activation_array, &sigmoid_derivative_array },
+  { "lookup_tanh", &lookup_tanh_activation, &tanh_derivative,
+    &lookup_tanh_activation_array, &tanh_derivative_array },
+  { "lookup_sigmoid", &lookup_sigmoid_activation, &sigmoid_derivative,
+    &lookup_sigmoid_activation_array, &sigmoid_derivative_array }
+};
+
+const activation_functions_t*
+find_activation_functions (double (*activation_function) (const double))
+{
+  size_t i;
+  for (i = 0; i < sizeof(activation_functions) / sizeof(activation_functions[0]); ++i)
+  {
+    if (activation_functions[i].activation_function == activation_function)
+      return &activation_functions[i];
+  }
+  return NULL;
+}
+
+const activation_functions_t*
+find_activation_functions_by_name (const char* const name)
+{
+  size_t i;
+  for (i = 0; i < sizeof(activation_functions) / sizeof(activation_functions[0]); ++i)
+  {
+    if (strcmp(activation_functions[i].name, name) == 0)
+      return &activation_functions[i];
+  }
+  return NULL;
+}
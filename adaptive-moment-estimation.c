@@ -0,0 +1,117 @@
+#include <math.h>
+
+#include "util/util.h"
+#include "util/thread-pool.h"
+
+#include "adaptive-moment-estimation.h"
+
+adaptive_moment_estimation_data_t*
+construct_adaptive_moment_estimation_data (const neural_network_t* nn,
+                                           const double            learning_rate,
+                                           const double            weight_decay)
+{
+  // MALLOC: data
+  adaptive_moment_estimation_data_t* data =
+    malloc_exit_if_null(sizeof(adaptive_moment_estimation_data_t));
+
+  // INIT: data->learning_rate, data->beta1, data->beta2, data->epsilon, data->weight_decay
+  data->learning_rate = learning_rate;
+  data->beta1 = ADAM_DEFAULT_BETA1;
+  data->beta2 = ADAM_DEFAULT_BETA2;
+  data->epsilon = ADAM_DEFAULT_EPSILON;
+  data->weight_decay = weight_decay;
+
+  // INIT: data->_step
+  data->_step = 0;
+
+  // MALLOC: data->_first_moments
+  // INIT: data->_first_moments
+  data->_first_moments = construct_neural_network_weight_buffer(nn);
+
+  // MALLOC: data->_second_moments
+  // INIT: data->_second_moments
+  data->_second_moments = construct_neural_network_weight_buffer(nn);
+
+  return data;
+}
+
+void
+destruct_adaptive_moment_estimation_data (adaptive_moment_estimation_data_t* data,
+                                          const neural_network_t*            nn)
+{
+  (void) nn;
+  // FREE: data->_second_moments
+  destruct_neural_network_weight_buffer(data->_second_moments);
+
+  // FREE: data->_first_moments
+  destruct_neural_network_weight_buffer(data->_first_moments);
+
+  // FREE: data
+  free_and_null(data);
+}
+
+/*
+  The arguments of the parallel loop of adaptive_moment_estimation_loop().
+  */
+struct adaptive_moment_estimation_step_t
+{
+  const adaptive_moment_estimation_data_t* data;
+  const neural_network_t*                  nn;
+  const training_t*                        training;
+  double                                   first_moment_correction;
+  double                                   second_moment_correction;
+};
+
+typedef struct adaptive_moment_estimation_step_t adaptive_moment_estimation_step_t;
+
+static void
+_update_weights (void*        step_data,
+                 const size_t begin,
+                 const size_t end,
+                 const size_t slot)
+{
+  (void) slot;
+  const adaptive_moment_estimation_step_t* const step = (const adaptive_moment_estimation_step_t*) step_data;
+  const adaptive_moment_estimation_data_t* const data = step->data;
+  const double beta1 = data->beta1;
+  const double beta2 = data->beta2;
+  const double learning_rate = data->learning_rate;
+  const double decay = 1.0 - data->learning_rate * data->weight_decay;
+  double* const gradients = step->training->gradients;
+  real_t* const first_moments = data->_first_moments;
+  real_t* const second_moments = data->_second_moments;
+  real_t* const weights = step->nn->weights;
+  size_t wi;
+  for (wi = begin; wi < end; ++wi)
+  {
+    const double gradient = gradients[wi];
+    const double first_moment = beta1 * first_moments[wi] + (1.0 - beta1) * gradient;
+    const double second_moment = beta2 * second_moments[wi] + (1.0 - beta2) * gradient * gradient;
+    first_moments[wi] = first_moment;
+    second_moments[wi] = second_moment;
+    weights[wi] = decay * weights[wi]
+                  + learning_rate * (first_moment * step->first_moment_correction)
+                    / (sqrt(second_moment * step->second_moment_correction) + data->epsilon);
+    gradients[wi] = 0.0;
+  }
+}
+
+void
+adaptive_moment_estimation_loop (void*                    adaptive_moment_estimation_data,
+                                 const neural_network_t*  nn,
+                                 const training_t*        training)
+{
+  adaptive_moment_estimation_data_t* const data =
+    (adaptive_moment_estimation_data_t*) adaptive_moment_estimation_data;
+  ++data->_step;
+
+  adaptive_moment_estimation_step_t step;
+  step.data = data;
+  step.nn = nn;
+  step.training = training;
+  step.first_moment_correction = 1.0 / (1.0 - pow(data->beta1, data->_step));
+  step.second_moment_correction = 1.0 / (1.0 - pow(data->beta2, data->_step));
+
+  run_thread_pool_parallel_for(get_shared_thread_pool(), 0, nn->weights_size, ADAM_BLOCK_SIZE,
+                               get_training_num_threads(training), &_update_weights, &step);
+}
@@ -0,0 +1,112 @@
+/*!
+  \file adaptive-moment-estimation.h
+  \brief The Adam and AdamW optimizers, as propagation loops.
+  \author Hellyna Ng (hellyna@hellyna.com)
+  */
+
+#ifndef ADAPTIVE_MOMENT_ESTIMATION_H_1C794674_77D0_4EEA_866E_F230661FED7C
+#define ADAPTIVE_MOMENT_ESTIMATION_H_1C794674_77D0_4EEA_866E_F230661FED7C
+
+#include "neural-network.h"
+#include "training.h"
+
+/*!
+  The default step size.
+  */
+#define ADAM_DEFAULT_LEARNING_RATE  0.001
+/*!
+  The default decay rate of the first moment estimates.
+  */
+#define ADAM_DEFAULT_BETA1          0.9
+/*!
+  The default decay rate of the second moment estimates.
+  */
+#define ADAM_DEFAULT_BETA2          0.999
+/*!
+  The default term added to the square root of the second moment estimates.
+  */
+#define ADAM_DEFAULT_EPSILON        1e-8
+/*!
+  The number of weights updated at a time by one thread of adaptive_moment_estimation_loop().
+  Networks with fewer weights are updated by the calling thread alone.
+  */
+#define ADAM_BLOCK_SIZE             16384
+
+/*!
+  Data used by this Adam implementation.
+  */
+struct adaptive_moment_estimation_data_t
+{
+  /*!
+    The step size.
+    */
+  double           learning_rate;
+  /*!
+    The decay rate of the first moment estimates, ADAM_DEFAULT_BETA1 by default.
+    */
+  double           beta1;
+  /*!
+    The decay rate of the second moment estimates, ADAM_DEFAULT_BETA2 by default.
+    */
+  double           beta2;
+  /*!
+    The term added to the square root of the second moment estimates, ADAM_DEFAULT_EPSILON by default.
+    */
+  double           epsilon;
+  /*!
+    The decoupled weight decay of AdamW: every update also shrinks the weights by
+    learning_rate * weight_decay times themselves. 0 gives plain Adam.
+    */
+  double           weight_decay;
+  size_t           _step;
+  real_t*          _first_moments;
+  real_t*          _second_moments;
+};
+
+typedef struct adaptive_moment_estimation_data_t adaptive_moment_estimation_data_t;
+
+/*!
+  Constructs an adaptive_moment_estimation_data_t instance, recursively allocating the memory for it.
+
+  The moment estimates are laid out like neural_network_t::weights, in \b real_t, so they
+  take as much memory as the weights.
+
+  \param nn the associated neural_network_t instance to get data essential to the construction from.
+  \param learning_rate the step size, eg. ADAM_DEFAULT_LEARNING_RATE.
+  \param weight_decay the decoupled weight decay of AdamW, or 0 for Adam.
+  \return a new adaptive_moment_estimation_data_t instance.
+  */
+adaptive_moment_estimation_data_t*
+construct_adaptive_moment_estimation_data (const neural_network_t* nn,
+                                           const double            learning_rate,
+                                           const double            weight_decay);
+
+/*!
+  Destructs and recursively free an adaptive_moment_estimation_data_t instance.
+  \param data the adaptive_moment_estimation_data_t instance to free and destruct.
+  \param nn the associated neural_network_t instance to get data essential to the destruction from.
+  */
+void
+destruct_adaptive_moment_estimation_data (adaptive_moment_estimation_data_t* data,
+                                          const neural_network_t*            nn);
+
+/*!
+  The Adam loop to be inserted as a parameter in train_neural_network_in_mini_batches(),
+  or in train_neural_network().
+
+  With g the summed gradients (which point downhill), m and v the moment estimates of a
+  weight and t the number of updates so far: m = beta1 * m + (1 - beta1) * g and
+  v = beta2 * v + (1 - beta2) * g * g, then the weight moves by
+  learning_rate * (m / (1 - beta1^t)) / (sqrt(v / (1 - beta2^t)) + epsilon), minus
+  learning_rate * weight_decay times itself. The gradients are then cleared.
+
+  \param adaptive_moment_estimation_data the \b void pointer to the adaptive_moment_estimation_data_t instance.
+  \param nn the associated neural_network_t instance to perform the loop on.
+  \param training the associated training_t instance to perform the loop on.
+  */
+void
+adaptive_moment_estimation_loop (void*                    adaptive_moment_estimation_data,
+                                 const neural_network_t*  nn,
+                                 const training_t*        training);
+
+#endif
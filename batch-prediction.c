@@ -0,0 +1,212 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "util/util.h"
+#include "util/thread-pool.h"
+#include "libcsv/csv.h"
+#include "validation.h"
+#include "prediction.h"
+
+#include "batch-prediction.h"
+
+/*
+  The arguments of the parallel loop of _predict_rows().
+  */
+struct batch_prediction_t
+{
+  const neural_network_t*  nn;
+  real_t* const*           rows;
+  size_t                   row_count;
+  real_t*                  outputs;
+  prediction_workspace_t** workspaces;
+  real_t**                 inputs;
+};
+
+typedef struct batch_prediction_t batch_prediction_t;
+
+/*
+  Predicts blocks \b begin to \b end - 1 of the rows, in the buffers of slot \b slot.
+  */
+static void
+_predict_blocks (void*        data,
+                 const size_t begin,
+                 const size_t end,
+                 const size_t slot)
+{
+  const batch_prediction_t* const prediction = (const batch_prediction_t*) data;
+  const neural_network_t* const nn = prediction->nn;
+  const size_t input_size = nn->config[0];
+  const size_t output_size = nn->config[nn->config_size - 1];
+  real_t* const inputs = prediction->inputs[slot];
+  size_t block;
+  for (block = begin; block < end; ++block)
+  {
+    const size_t first_row = block * BATCH_PREDICTION_BLOCK_SIZE;
+    size_t count = prediction->row_count - first_row, i;
+    if (count > BATCH_PREDICTION_BLOCK_SIZE)
+      count = BATCH_PREDICTION_BLOCK_SIZE;
+
+    for (i = 0; i < count; ++i)
+    {
+      memcpy(inputs + i * input_size, prediction->rows[first_row + i], input_size * sizeof(real_t));
+    }
+    predict_neural_network(nn, prediction->workspaces[slot], inputs, prediction->outputs + first_row * output_size, count);
+  }
+}
+
+static void
+_predict_rows (const neural_network_t* const nn,
+               double                        (*activation_function) (const double),
+               real_t* const*          const rows,
+               const size_t                  row_count,
+               real_t*                 const outputs,
+               const size_t                  num_threads)
+{
+  thread_pool_t* const pool = get_shared_thread_pool();
+  const size_t num_slots = num_threads == 0 || num_threads > pool->num_threads ? pool->num_threads : num_threads;
+  const size_t num_blocks = (row_count + BATCH_PREDICTION_BLOCK_SIZE - 1) / BATCH_PREDICTION_BLOCK_SIZE;
+
+  batch_prediction_t prediction;
+  prediction.nn = nn;
+  prediction.rows = rows;
+  prediction.row_count = row_count;
+  prediction.outputs = outputs;
+
+  // MALLOC: prediction.workspaces, prediction.inputs
+  prediction.workspaces = malloc_exit_if_null(num_slots * SIZEOF_PTR);
+  prediction.inputs = malloc_exit_if_null(num_slots * SIZEOF_PTR);
+  size_t i;
+  for (i = 0; i < num_slots; ++i)
+  {
+    prediction.workspaces[i] = construct_prediction_workspace(nn, activation_function, BATCH_PREDICTION_BLOCK_SIZE);
+    prediction.inputs[i] = malloc_exit_if_null(BATCH_PREDICTION_BLOCK_SIZE * nn->config[0] * sizeof(real_t));
+  }
+
+  run_thread_pool_parallel_for(pool, 0, num_blocks, 1, num_slots, &_predict_blocks, &prediction);
+
+  // FREE: prediction.workspaces, prediction.inputs
+  for (i = 0; i < num_slots; ++i)
+  {
+    destruct_prediction_workspace(prediction.workspaces[i]);
+    free_and_null(prediction.inputs[i]);
+  }
+  free_and_null(prediction.workspaces);
+  free_and_null(prediction.inputs);
+}
+
+static void
+_write_predictions (const char*           const output_path,
+                    const training_set_t* const ranges,
+                    const bool                  denormalize,
+                    const real_t*         const outputs,
+                    const size_t                row_count,
+                    const size_t                output_size)
+{
+  FILE* fp = fopen(output_path, "wb");
+  exit_if_null(fp);
+  size_t i, j;
+  char buffer[1024];
+  for (j = 0; j < output_size; ++j)
+  {
+    memset(buffer, 0, sizeof(buffer));
+    if (ranges != NULL)
+      strncpy(buffer, ranges->output_entries_desc[j], sizeof(buffer) - 1);
+    else
+      sprintf(buffer, "Output %zu", j + 1);
+    csv_fwrite(fp, buffer, strlen(buffer));
+    if (j < output_size - 1)
+      fputc(',', fp);
+  }
+  fputc('\n', fp);
+
+  for (i = 0; i < row_count; ++i)
+  {
+    for (j = 0; j < output_size; ++j)
+    {
+      double output = outputs[i * output_size + j];
+      if (denormalize)
+        output = denormalize_training_set_output(ranges, j, output);
+
+      memset(buffer, 0, sizeof(buffer));
+      sprintf(buffer, "%.9g", output);
+      csv_fwrite(fp, buffer, strlen(buffer));
+      if (j < output_size - 1)
+        fputc(',', fp);
+    }
+    fputc('\n', fp);
+  }
+  fclose(fp);
+}
+
+void
+predict_training_set (const neural_network_t* const nn,
+                      double                        (*activation_function) (const double),
+                      const training_set_t*   const ts,
+                      const char*             const output_path,
+                      const bool                    denormalize,
+                      const size_t                  num_threads)
+{
+  validate_matching_neural_network_and_training_set(nn, ts);
+
+  // MALLOC: outputs
+  real_t* outputs = malloc_exit_if_null(ts->training_set_size * ts->output_size * sizeof(real_t));
+
+  _predict_rows(nn, activation_function, ts->target_inputs, ts->training_set_size, outputs, num_threads);
+  _write_predictions(output_path, ts, denormalize && ts->_is_normalized,
+                     outputs, ts->training_set_size, ts->output_size);
+
+  // FREE: outputs
+  free_and_null(outputs);
+}
+
+void
+predict_csv_file (const neural_network_t* const nn,
+                  double                        (*activation_function) (const double),
+                  const char*             const input_path,
+                  const char*             const output_path,
+                  const training_set_t*   const ranges,
+                  const size_t                  num_threads)
+{
+  csv_data_t* const input_data = construct_csv_data(input_path);
+  if (input_data->line_count < 2)
+    printferr_and_exit("The input file %s must have a header line and at least one line of inputs.\n", input_path);
+
+  const size_t input_size = validate_csv_data_entry_counts(input_data);
+  if (input_size != nn->config[0])
+    putserr_and_exit("Number of input neurons must be equal to the number of inputs in the input file.");
+
+  const size_t output_size = nn->config[nn->config_size - 1];
+  if (ranges != NULL)
+    validate_matching_neural_network_and_training_set(nn, ranges);
+  const bool is_normalized = ranges != NULL && ranges->_is_normalized;
+
+  // MALLOC: rows
+  // INIT: rows
+  const size_t row_count = input_data->line_count - 1;
+  real_t* const inputs = malloc_exit_if_null(row_count * input_size * sizeof(real_t));
+  real_t** const rows = malloc_exit_if_null(row_count * SIZEOF_PTR);
+  size_t i, j;
+  for (i = 0; i < row_count; ++i)
+  {
+    rows[i] = inputs + i * input_size;
+    for (j = 0; j < input_size; ++j)
+    {
+      double input = strtod(input_data->data[i + 1][j], NULL);
+      if (is_normalized)
+        input = normalize_training_set_input(ranges, j, input);
+      rows[i][j] = input;
+    }
+  }
+  destruct_csv_data(input_data);
+
+  // MALLOC: outputs
+  real_t* outputs = malloc_exit_if_null(row_count * output_size * sizeof(real_t));
+
+  _predict_rows(nn, activation_function, rows, row_count, outputs, num_threads);
+  _write_predictions(output_path, ranges, is_normalized, outputs, row_count, output_size);
+
+  // FREE: outputs, rows
+  free_and_null(outputs);
+  free_and_null(rows);
+  free_and_null(inputs);
+}
@@ -0,0 +1,68 @@
+/*!
+  \file batch-prediction.h
+  \brief Predicts whole data sets with a trained neural network, using all cores.
+  \author Hellyna Ng (hellyna@hellyna.com)
+  */
+#ifndef BATCH_PREDICTION_H_6E0D2B84_1C5F_4A97_B3E8_0F92D4C7A615
+#define BATCH_PREDICTION_H_6E0D2B84_1C5F_4A97_B3E8_0F92D4C7A615
+
+#include <stdbool.h>
+
+#include "neural-network.h"
+#include "training-set.h"
+
+/*!
+  The number of rows a thread predicts in one predict_neural_network() call.
+  */
+#define BATCH_PREDICTION_BLOCK_SIZE 64
+
+/*!
+  Predicts the outputs for every target input of a training set and writes them to a csv file.
+
+  The rows are split in blocks of \b BATCH_PREDICTION_BLOCK_SIZE that are predicted by
+  \b num_threads threads of get_shared_thread_pool(), each with its own prediction_workspace_t instance. The file has
+  a header line with the output descriptions, then one line per row in the training set order.
+
+  \param nn the trained neural_network_t instance.
+  \param activation_function the activation function the network was trained with.
+  \param ts the training_set_t instance to predict the target inputs of.
+  \param output_path the path + filename of the csv file to write.
+  \param denormalize set this to true to write the outputs in their original ranges,
+         if \b ts is normalized.
+  \param num_threads the number of threads to use, or 0 to use all available cores.
+  */
+void
+predict_training_set (const neural_network_t* const nn,
+                      double                        (*activation_function) (const double),
+                      const training_set_t*   const ts,
+                      const char*             const output_path,
+                      const bool                    denormalize,
+                      const size_t                  num_threads);
+
+/*!
+  Predicts the outputs for every line of an input csv file and writes them to a csv file.
+
+  The input file has the format of a training set input file: a header line, then one
+  line of config[0] inputs per row. See predict_training_set() for the threading and
+  the output file format.
+
+  This function will exit if the file has no line of inputs.
+
+  \param nn the trained neural_network_t instance.
+  \param activation_function the activation function the network was trained with.
+  \param input_path the path + filename of the input csv file.
+  \param output_path the path + filename of the csv file to write.
+  \param ranges the training set \b nn was trained on, to name the outputs and, if it is
+         normalized, to normalize the inputs and denormalize the outputs with its ranges, or
+         \b NULL to use the values as they are.
+  \param num_threads the number of threads to use, or 0 to use all available cores.
+  */
+void
+predict_csv_file (const neural_network_t* const nn,
+                  double                        (*activation_function) (const double),
+                  const char*             const input_path,
+                  const char*             const output_path,
+                  const training_set_t*   const ranges,
+                  const size_t                  num_threads);
+
+#endif
@@ -0,0 +1,490 @@
+#include <string.h>
+#include <math.h>
+
+#include "util/util.h"
+#include "util/thread-pool.h"
+#include "validation.h"
+
+#include "levenberg-marquardt.h"
+
+/*
+  The number of weights of nn, without the padding between its layers.
+  */
+static size_t
+_count_weights (const neural_network_t* nn)
+{
+  size_t num_weights = 0;
+  size_t i;
+  for (i = 0; i < nn->config_size - 1; ++i)
+  {
+    num_weights += nn->config[i] * nn->config[i + 1];
+  }
+  return num_weights;
+}
+
+levenberg_marquardt_data_t*
+construct_levenberg_marquardt_data (const neural_network_t* nn,
+                                    const training_set_t*   ts)
+{
+  validate_matching_neural_network_and_training_set(nn, ts);
+
+  // MALLOC: data
+  levenberg_marquardt_data_t* data = malloc_exit_if_null(sizeof(levenberg_marquardt_data_t));
+
+  // INIT: data->damping, data->_ts, data->_num_weights
+  data->damping = LM_INITIAL_DAMPING;
+  data->_ts = ts;
+  const size_t n = _count_weights(nn);
+  data->_num_weights = n;
+
+  // MALLOC: data->_hessian, data->_cholesky_factor
+  data->_hessian = malloc_exit_if_null(n * n * sizeof(double));
+  data->_cholesky_factor = malloc_exit_if_null(n * n * sizeof(double));
+
+  // MALLOC: data->_gradient, data->_step
+  data->_gradient = malloc_exit_if_null(n * sizeof(double));
+  data->_step = malloc_exit_if_null(n * sizeof(double));
+
+  // MALLOC: data->_jacobian
+  const size_t num_outputs = nn->config[nn->config_size - 1];
+  data->_jacobian = malloc_exit_if_null(LM_BLOCK_SIZE * num_outputs * n * sizeof(double));
+
+  // MALLOC: data->_previous_weights
+  data->_previous_weights = construct_neural_network_weight_buffer(nn);
+
+  // MALLOC: data->_pre_activated_sums, data->_post_activated_sums, data->_deltas
+  data->_pre_activated_sums = malloc_exit_if_null(nn->config_size * SIZEOF_PTR);
+  data->_post_activated_sums = malloc_exit_if_null(nn->config_size * SIZEOF_PTR);
+  data->_deltas = malloc_exit_if_null(nn->config_size * SIZEOF_PTR);
+  size_t i;
+  for (i = 0; i < nn->config_size; ++i)
+  {
+    data->_pre_activated_sums[i] = malloc_exit_if_null(LM_BLOCK_SIZE * nn->config[i] * sizeof(real_t));
+    data->_post_activated_sums[i] = malloc_exit_if_null(LM_BLOCK_SIZE * nn->config[i] * sizeof(real_t));
+    data->_deltas[i] = malloc_exit_if_null(nn->config[i] * sizeof(double));
+  }
+
+  return data;
+}
+
+void
+destruct_levenberg_marquardt_data (levenberg_marquardt_data_t* data,
+                                   const neural_network_t*     nn)
+{
+  // FREE: data->_pre_activated_sums, data->_post_activated_sums, data->_deltas
+  size_t i;
+  for (i = 0; i < nn->config_size; ++i)
+  {
+    free_and_null(data->_pre_activated_sums[i]);
+    free_and_null(data->_post_activated_sums[i]);
+    free_and_null(data->_deltas[i]);
+  }
+  free_and_null(data->_pre_activated_sums);
+  free_and_null(data->_post_activated_sums);
+  free_and_null(data->_deltas);
+
+  // FREE: data->_previous_weights
+  destruct_neural_network_weight_buffer(data->_previous_weights);
+
+  // FREE: data->_jacobian, data->_step, data->_gradient, data->_cholesky_factor, data->_hessian
+  free_and_null(data->_jacobian);
+  free_and_null(data->_step);
+  free_and_null(data->_gradient);
+  free_and_null(data->_cholesky_factor);
+  free_and_null(data->_hessian);
+
+  // FREE: data
+  free_and_null(data);
+}
+
+/*
+  Feeds the samples [first_index, first_index + batch_size) through the network,
+  with the activation function of the training.
+  */
+static void
+_feed_forward (levenberg_marquardt_data_t* data,
+               const neural_network_t*     nn,
+               const training_t*           training,
+               const size_t                first_index,
+               const size_t                batch_size)
+{
+  // current_layer_index
+  size_t cli,
+  // batch_index
+         bi,
+  // sum_index
+         si;
+  const size_t num_inputs = nn->config[0];
+  for (bi = 0; bi < batch_size; ++bi)
+  {
+    memcpy(data->_post_activated_sums[0] + bi * num_inputs, data->_ts->target_inputs[first_index + bi],
+           num_inputs * sizeof(real_t));
+  }
+
+  for (cli = 1; cli < nn->config_size; ++cli)
+  {
+    const size_t num_sums = batch_size * nn->config[cli];
+    real_t* const sums = data->_pre_activated_sums[cli];
+    real_t* const post_activated_sums = data->_post_activated_sums[cli];
+    compute_neural_network_layer_sums(nn, cli - 1, data->_post_activated_sums[cli - 1], sums, batch_size);
+    if (training->_activation_array_function != NULL)
+    {
+      (*(training->_activation_array_function)) (sums, post_activated_sums, num_sums);
+    }
+    else
+    {
+      for (si = 0; si < num_sums; ++si)
+      {
+        post_activated_sums[si] = (*(training->_activation_function)) (sums[si]);
+      }
+    }
+  }
+}
+
+/*
+  The sum of square errors of the network over the whole training set.
+  */
+static double
+_compute_square_sum_error (levenberg_marquardt_data_t* data,
+                           const neural_network_t*     nn,
+                           const training_t*           training)
+{
+  const training_set_t* const ts = data->_ts;
+  const size_t num_outputs = nn->config[nn->config_size - 1];
+  double square_sum_error = 0.0;
+  size_t first_index, batch_size, bi, oi;
+  for (first_index = 0; first_index < ts->training_set_size; first_index += batch_size)
+  {
+    batch_size = ts->training_set_size - first_index < LM_BLOCK_SIZE ? ts->training_set_size - first_index
+                                                                     : LM_BLOCK_SIZE;
+    _feed_forward(data, nn, training, first_index, batch_size);
+    for (bi = 0; bi < batch_size; ++bi)
+    {
+      const real_t* const outputs = data->_post_activated_sums[nn->config_size - 1] + bi * num_outputs;
+      const real_t* const target_outputs = ts->target_outputs[first_index + bi];
+      for (oi = 0; oi < num_outputs; ++oi)
+      {
+        const double error = (double) target_outputs[oi] - outputs[oi];
+        square_sum_error += error * error;
+      }
+    }
+  }
+  return square_sum_error;
+}
+
+/*
+  Back-propagates every output of the samples just fed forward on its own, writing one
+  row of the Jacobian per output, and adds their errors times their rows to the gradient.
+  The Jacobian block is stored transposed, one column of LM_BLOCK_SIZE * num_outputs rows
+  per weight. Returns the sum of their square errors.
+  */
+static double
+_compute_jacobian (levenberg_marquardt_data_t* data,
+                   const neural_network_t*     nn,
+                   const training_t*           training,
+                   const size_t                first_index,
+                   const size_t                batch_size)
+{
+  // current_layer_index
+  size_t cli,
+  // current_layer_neuron_index
+         clni,
+  // next_layer_neuron_index
+         nlni,
+  // batch_index
+         bi,
+  // output_index
+         oi;
+  const size_t oli = nn->config_size - 1;
+  const size_t num_outputs = nn->config[oli];
+  const size_t stride = LM_BLOCK_SIZE * num_outputs;
+  double square_sum_error = 0.0;
+  for (bi = 0; bi < batch_size; ++bi)
+  {
+    const real_t* const target_outputs = data->_ts->target_outputs[first_index + bi];
+    for (oi = 0; oi < num_outputs; ++oi)
+    {
+      const size_t offset = bi * num_outputs + oi;
+      const real_t output = data->_post_activated_sums[oli][offset];
+      const double error = (double) target_outputs[oi] - output;
+      square_sum_error += error * error;
+
+      memset(data->_deltas[oli], 0, num_outputs * sizeof(double));
+      data->_deltas[oli][oi] =
+        (*(training->_derivative_function)) (data->_pre_activated_sums[oli][offset], output);
+      for (cli = oli - 1; cli > 0; --cli)
+      {
+        const size_t num_neurons = nn->config[cli];
+        const size_t num_next_neurons = nn->config[cli + 1];
+        const real_t* const weights = get_neural_network_weight_layer(nn, cli);
+        const real_t* const pre_activated_sums = data->_pre_activated_sums[cli] + bi * num_neurons;
+        const real_t* const post_activated_sums = data->_post_activated_sums[cli] + bi * num_neurons;
+        const double* const next_deltas = data->_deltas[cli + 1];
+        for (clni = 0; clni < num_neurons; ++clni)
+        {
+          double sum = 0.0;
+          for (nlni = 0; nlni < num_next_neurons; ++nlni)
+          {
+            sum += weights[clni * num_next_neurons + nlni] * next_deltas[nlni];
+          }
+          data->_deltas[cli][clni] =
+            sum * (*(training->_derivative_function)) (pre_activated_sums[clni], post_activated_sums[clni]);
+        }
+      }
+
+      double* const row = data->_jacobian + offset;
+      size_t wi = 0;
+      for (cli = 0; cli < oli; ++cli)
+      {
+        const size_t num_neurons = nn->config[cli];
+        const size_t num_next_neurons = nn->config[cli + 1];
+        const real_t* const post_activated_sums = data->_post_activated_sums[cli] + bi * num_neurons;
+        const double* const next_deltas = data->_deltas[cli + 1];
+        for (clni = 0; clni < num_neurons; ++clni)
+        {
+          for (nlni = 0; nlni < num_next_neurons; ++nlni, ++wi)
+          {
+            const double derivative = post_activated_sums[clni] * next_deltas[nlni];
+            row[wi * stride] = derivative;
+            data->_gradient[wi] += error * derivative;
+          }
+        }
+      }
+    }
+  }
+  return square_sum_error;
+}
+
+/*
+  The arguments of the parallel loops of levenberg_marquardt_loop().
+  */
+struct levenberg_marquardt_step_t
+{
+  levenberg_marquardt_data_t* data;
+  size_t                      stride;
+  size_t                      num_rows;
+  size_t                      column;
+};
+
+typedef struct levenberg_marquardt_step_t levenberg_marquardt_step_t;
+
+/*
+  Adds the products of the Jacobian block to row blocks \b begin to \b end - 1 of the lower
+  triangle of the approximated Hessian. Each element is the dot product of two columns of
+  the block, summed in row order, four elements at a time.
+  */
+static void
+_accumulate_hessian (void*        step_data,
+                     const size_t begin,
+                     const size_t end,
+                     const size_t slot)
+{
+  (void) slot;
+  const levenberg_marquardt_step_t* const step = (const levenberg_marquardt_step_t*) step_data;
+  const size_t n = step->data->_num_weights;
+  const size_t stride = step->stride;
+  const size_t num_rows = step->num_rows;
+  const double* const jacobian = step->data->_jacobian;
+  const size_t last_row = end * LM_ROW_BLOCK_SIZE < n ? end * LM_ROW_BLOCK_SIZE : n;
+  size_t i, j, r;
+  for (i = begin * LM_ROW_BLOCK_SIZE; i < last_row; ++i)
+  {
+    double* const hessian_row = step->data->_hessian + i * n;
+    const double* const column_i = jacobian + i * stride;
+    for (j = 0; j + 4 <= i + 1; j += 4)
+    {
+      const double* const column_j = jacobian + j * stride;
+      double sum0 = 0.0, sum1 = 0.0, sum2 = 0.0, sum3 = 0.0;
+      for (r = 0; r < num_rows; ++r)
+      {
+        const double derivative = column_i[r];
+        sum0 += derivative * column_j[r];
+        sum1 += derivative * column_j[stride + r];
+        sum2 += derivative * column_j[2 * stride + r];
+        sum3 += derivative * column_j[3 * stride + r];
+      }
+      hessian_row[j] += sum0;
+      hessian_row[j + 1] += sum1;
+      hessian_row[j + 2] += sum2;
+      hessian_row[j + 3] += sum3;
+    }
+    for (; j <= i; ++j)
+    {
+      const double* const column_j = jacobian + j * stride;
+      double sum = 0.0;
+      for (r = 0; r < num_rows; ++r)
+      {
+        sum += column_i[r] * column_j[r];
+      }
+      hessian_row[j] += sum;
+    }
+  }
+}
+
+/*
+  Computes column \b step->column of the Cholesky factor, for row blocks \b begin to
+  \b end - 1 below its diagonal.
+  */
+static void
+_factorize_column (void*        step_data,
+                   const size_t begin,
+                   const size_t end,
+                   const size_t slot)
+{
+  (void) slot;
+  const levenberg_marquardt_step_t* const step = (const levenberg_marquardt_step_t*) step_data;
+  const size_t n = step->data->_num_weights;
+  const size_t j = step->column;
+  const double* const hessian = step->data->_hessian;
+  double* const factor = step->data->_cholesky_factor;
+  const double* const column_row = factor + j * n;
+  const size_t last_row = j + 1 + (end * LM_ROW_BLOCK_SIZE < n - j - 1 ? end * LM_ROW_BLOCK_SIZE : n - j - 1);
+  size_t i, k;
+  for (i = j + 1 + begin * LM_ROW_BLOCK_SIZE; i < last_row; ++i)
+  {
+    double* const factor_row = factor + i * n;
+    double sum = hessian[i * n + j];
+    for (k = 0; k < j; ++k)
+    {
+      sum -= factor_row[k] * column_row[k];
+    }
+    factor_row[j] = sum / column_row[j];
+  }
+}
+
+/*
+  Factorizes J^T J + damping * I into L L^T, with the rows below each diagonal element
+  spread over the threads. Returns false if it is not positive definite.
+  */
+static bool
+_factorize (levenberg_marquardt_data_t* data,
+            const double                damping,
+            const size_t                num_threads)
+{
+  const size_t n = data->_num_weights;
+  levenberg_marquardt_step_t step;
+  step.data = data;
+  size_t j, k;
+  for (j = 0; j < n; ++j)
+  {
+    const double* const factor_row = data->_cholesky_factor + j * n;
+    double diagonal = data->_hessian[j * n + j] + damping;
+    for (k = 0; k < j; ++k)
+    {
+      diagonal -= factor_row[k] * factor_row[k];
+    }
+    if (!(diagonal > 0.0) || !isfinite(diagonal))
+      return false;
+
+    data->_cholesky_factor[j * n + j] = sqrt(diagonal);
+    step.column = j;
+    const size_t num_blocks = (n - j - 1 + LM_ROW_BLOCK_SIZE - 1) / LM_ROW_BLOCK_SIZE;
+    run_thread_pool_parallel_for(get_shared_thread_pool(), 0, num_blocks, 1, num_threads,
+                                 &_factorize_column, &step);
+  }
+  return true;
+}
+
+/*
+  Solves L L^T step = gradient with the Cholesky factor.
+  */
+static void
+_solve (levenberg_marquardt_data_t* data)
+{
+  const size_t n = data->_num_weights;
+  const double* const factor = data->_cholesky_factor;
+  double* const step = data->_step;
+  size_t i, k;
+  for (i = 0; i < n; ++i)
+  {
+    double sum = data->_gradient[i];
+    for (k = 0; k < i; ++k)
+    {
+      sum -= factor[i * n + k] * step[k];
+    }
+    step[i] = sum / factor[i * n + i];
+  }
+  for (i = n; i-- > 0;)
+  {
+    double sum = step[i];
+    for (k = i + 1; k < n; ++k)
+    {
+      sum -= factor[k * n + i] * step[k];
+    }
+    step[i] = sum / factor[i * n + i];
+  }
+}
+
+/*
+  Sets the weights to the previous weights moved by the step.
+  */
+static void
+_apply_step (const levenberg_marquardt_data_t* data,
+             const neural_network_t*           nn)
+{
+  size_t wi = 0;
+  size_t i, j;
+  for (i = 0; i < nn->config_size - 1; ++i)
+  {
+    real_t* const weights = get_neural_network_weight_layer(nn, i);
+    const real_t* const previous_weights = get_weight_buffer_layer(nn, data->_previous_weights, i);
+    const size_t layer_size = nn->config[i] * nn->config[i + 1];
+    for (j = 0; j < layer_size; ++j)
+    {
+      weights[j] = previous_weights[j] + data->_step[wi++];
+    }
+  }
+}
+
+void
+levenberg_marquardt_loop (void*                    levenberg_marquardt_data,
+                          const neural_network_t*  nn,
+                          const training_t*        training)
+{
+  levenberg_marquardt_data_t* const data = (levenberg_marquardt_data_t*) levenberg_marquardt_data;
+  const training_set_t* const ts = data->_ts;
+  const size_t n = data->_num_weights;
+  const size_t num_threads = get_training_num_threads(training);
+  const size_t num_outputs = nn->config[nn->config_size - 1];
+  thread_pool_t* const pool = get_shared_thread_pool();
+
+  memset(data->_hessian, 0, n * n * sizeof(double));
+  memset(data->_gradient, 0, n * sizeof(double));
+  levenberg_marquardt_step_t step;
+  step.data = data;
+  step.stride = LM_BLOCK_SIZE * num_outputs;
+  const size_t num_row_blocks = (n + LM_ROW_BLOCK_SIZE - 1) / LM_ROW_BLOCK_SIZE;
+  double square_sum_error = 0.0;
+  size_t first_index, batch_size;
+  for (first_index = 0; first_index < ts->training_set_size; first_index += batch_size)
+  {
+    batch_size = ts->training_set_size - first_index < LM_BLOCK_SIZE ? ts->training_set_size - first_index
+                                                                     : LM_BLOCK_SIZE;
+    _feed_forward(data, nn, training, first_index, batch_size);
+    square_sum_error += _compute_jacobian(data, nn, training, first_index, batch_size);
+    step.num_rows = batch_size * num_outputs;
+    run_thread_pool_parallel_for(pool, 0, num_row_blocks, 1, num_threads, &_accumulate_hessian, &step);
+  }
+
+  memcpy(data->_previous_weights, nn->weights, nn->weights_size * sizeof(real_t));
+  while (true)
+  {
+    if (_factorize(data, data->damping, num_threads))
+    {
+      _solve(data);
+      _apply_step(data, nn);
+      if (_compute_square_sum_error(data, nn, training) < square_sum_error)
+      {
+        data->damping = fmax(data->damping / LM_DAMPING_FACTOR, LM_DAMPING_MIN);
+        break;
+      }
+      memcpy(nn->weights, data->_previous_weights, nn->weights_size * sizeof(real_t));
+    }
+    if (data->damping >= LM_DAMPING_MAX)
+      break;
+
+    data->damping = fmin(data->damping * LM_DAMPING_FACTOR, LM_DAMPING_MAX);
+  }
+
+  memset(training->gradients, 0, nn->weights_size * sizeof(double));
+}
@@ -1,43 +1,89 @@
+#define _POSIX_C_SOURCE 200112L
+
 #include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 #include "../util/util.h"
+#include "../util/thread-pool.h"
 #include "csv.h"
 
-static size_t line_index;
-static size_t entry_index;
+/*
+  The initial number of elements of the growable arrays of csv_builder_t.
+  */
+#define CSV_INITIAL_CAPACITY 64
 
-static void
-count_lines (int delim, void* csv_data)
+/*
+  The lines and entries of a csv file being parsed, in arrays that double in size as they
+  fill up. Every entry is appended to one arena of null-terminated strings, and is only
+  located by its offset until the arena stops moving.
+  */
+struct csv_builder_t
 {
-  (void) delim;
-  csv_data_t* csvd = (csv_data_t*) csv_data;
-  ++(csvd->line_count);
-}
+  size_t  line_count;
+  size_t  line_capacity;
+  size_t* entry_counts;
+  size_t  entry_count;
+  size_t  entry_capacity;
+  size_t* entry_offsets;
+  size_t  arena_size;
+  size_t  arena_capacity;
+  char*   arena;
+  // The number of entries of the line being parsed.
+  size_t  line_entry_count;
+};
 
-static void
-increment_line (int delim, void* csv_data)
+typedef struct csv_builder_t csv_builder_t;
+
+/*
+  Grows \b array to hold at least \b size elements of \b element_size bytes.
+  */
+static void*
+_reserve (void*        array,
+          size_t*      capacity,
+          const size_t size,
+          const size_t element_size)
 {
-  (void) delim;
-  (void) csv_data;
-  ++line_index;
-  entry_index = 0;
+  if (size <= *capacity)
+    return array;
+
+  while (*capacity < size)
+  {
+    *capacity *= 2;
+  }
+  return realloc_exit_if_null(array, *capacity * element_size);
 }
 
 static void
-count_entries (void* entry, size_t entry_length, void* csv_data)
+_add_entry (void* entry, size_t entry_length, void* csv_builder)
 {
-  (void) entry;
-  (void) entry_length;
-  csv_data_t* csvd = (csv_data_t*) csv_data;
-  ++(csvd->entry_counts[line_index]);
+  csv_builder_t* builder = (csv_builder_t*) csv_builder;
+  builder->arena = _reserve(builder->arena, &builder->arena_capacity, builder->arena_size + entry_length + 1,
+                            sizeof(char));
+  // The parser appends a null character to every entry.
+  memcpy(builder->arena + builder->arena_size, entry, entry_length + 1);
+
+  builder->entry_offsets = _reserve(builder->entry_offsets, &builder->entry_capacity, builder->entry_count + 1,
+                                    sizeof(size_t));
+  builder->entry_offsets[builder->entry_count] = builder->arena_size;
+  ++builder->entry_count;
+  builder->arena_size += entry_length + 1;
+  ++builder->line_entry_count;
 }
 
 static void
-read_entries (void* entry, size_t entry_length, void* csv_data)
+_add_line (int delim, void* csv_builder)
 {
-  csv_data_t* csvd = (csv_data_t*) csv_data;
-  csvd->data[line_index][entry_index] = malloc_exit_if_null(sizeof(char) * entry_length + 1);
-  memcpy(csvd->data[line_index][entry_index], entry, sizeof(char) * entry_length + 1);
-  ++entry_index;
+  (void) delim;
+  csv_builder_t* builder = (csv_builder_t*) csv_builder;
+  builder->entry_counts = _reserve(builder->entry_counts, &builder->line_capacity, builder->line_count + 1,
+                                   sizeof(size_t));
+  builder->entry_counts[builder->line_count] = builder->line_entry_count;
+  ++builder->line_count;
+  builder->line_entry_count = 0;
 }
 
 static inline void
@@ -47,6 +93,150 @@ csv_exit_if_error (csv_parser* parser)
   exit(EXIT_FAILURE);
 }
 
+static void
+_construct_builder (csv_builder_t* builder)
+{
+  // MALLOC: builder->entry_counts, builder->entry_offsets, builder->arena
+  builder->line_count = 0;
+  builder->line_capacity = CSV_INITIAL_CAPACITY;
+  builder->entry_counts = malloc_exit_if_null(builder->line_capacity * sizeof(size_t));
+  builder->entry_count = 0;
+  builder->entry_capacity = CSV_INITIAL_CAPACITY;
+  builder->entry_offsets = malloc_exit_if_null(builder->entry_capacity * sizeof(size_t));
+  builder->arena_size = 0;
+  builder->arena_capacity = CSV_INITIAL_CAPACITY;
+  builder->arena = malloc_exit_if_null(builder->arena_capacity);
+  builder->line_entry_count = 0;
+}
+
+static void
+_destruct_builder (csv_builder_t* builder)
+{
+  // FREE: builder->entry_counts, builder->entry_offsets, builder->arena
+  free_and_null(builder->entry_counts);
+  free_and_null(builder->entry_offsets);
+  free_and_null(builder->arena);
+}
+
+/*
+  The builders of the chunks of a csv file, each of which parsed one chunk, and where their
+  lines and entries go in the csv_data_t instance they are stitched into.
+  */
+struct csv_stitch_t
+{
+  csv_builder_t* builders;
+  size_t*        first_lines;
+  size_t*        first_entries;
+  size_t*        first_bytes;
+  csv_data_t*    csvd;
+};
+
+typedef struct csv_stitch_t csv_stitch_t;
+
+/*
+  Copies the lines and entries of the builders from \b begin to \b end into the csv_data_t
+  instance, and destructs them.
+  */
+static void
+_stitch_builders (void*        data,
+                  const size_t begin,
+                  const size_t end,
+                  const size_t slot)
+{
+  (void) slot;
+  const csv_stitch_t* const stitch = (const csv_stitch_t*) data;
+  csv_data_t* const csvd = stitch->csvd;
+  size_t i, j;
+  for (i = begin; i < end; ++i)
+  {
+    csv_builder_t* const builder = &stitch->builders[i];
+    char* const arena = csvd->_arena + stitch->first_bytes[i];
+    char** const entries = csvd->_entries + stitch->first_entries[i];
+    // A single builder hands its arena and entry counts over, which are already in place.
+    if (arena != builder->arena)
+      memcpy(arena, builder->arena, builder->arena_size);
+    else
+      builder->arena = NULL;
+    for (j = 0; j < builder->entry_count; ++j)
+    {
+      entries[j] = arena + builder->entry_offsets[j];
+    }
+
+    size_t first_entry = 0;
+    for (j = 0; j < builder->line_count; ++j)
+    {
+      csvd->entry_counts[stitch->first_lines[i] + j] = builder->entry_counts[j];
+      csvd->data[stitch->first_lines[i] + j] = entries + first_entry;
+      first_entry += builder->entry_counts[j];
+    }
+    if (csvd->entry_counts == builder->entry_counts)
+      builder->entry_counts = NULL;
+    _destruct_builder(builder);
+  }
+}
+
+/*
+  Constructs a csv_data_t instance from the lines of \b num_builders builders in order,
+  destructing them. A single builder hands its arena over, and several are copied by up to
+  \b num_threads threads of get_shared_thread_pool().
+  */
+static csv_data_t*
+_construct_csv_data_from_builders (csv_builder_t* builders,
+                                   const size_t   num_builders,
+                                   const size_t   num_threads)
+{
+  // MALLOC: csvd
+  csv_data_t* csvd = malloc_exit_if_null(sizeof(csv_data_t));
+
+  csv_stitch_t stitch;
+  stitch.builders = builders;
+  stitch.csvd = csvd;
+  // MALLOC: stitch.first_lines, stitch.first_entries, stitch.first_bytes
+  stitch.first_lines = malloc_exit_if_null(num_builders * sizeof(size_t));
+  stitch.first_entries = malloc_exit_if_null(num_builders * sizeof(size_t));
+  stitch.first_bytes = malloc_exit_if_null(num_builders * sizeof(size_t));
+  size_t i, line_count = 0, entry_count = 0, arena_size = 0;
+  for (i = 0; i < num_builders; ++i)
+  {
+    stitch.first_lines[i] = line_count;
+    stitch.first_entries[i] = entry_count;
+    stitch.first_bytes[i] = arena_size;
+    line_count += builders[i].line_count;
+    entry_count += builders[i].entry_count;
+    arena_size += builders[i].arena_size;
+  }
+
+  // INIT: csvd->line_count
+  csvd->line_count = line_count;
+
+  // MALLOC: csvd->entry_counts, csvd->_arena, csvd->_entries, csvd->data
+  if (num_builders == 1)
+  {
+    csvd->entry_counts = builders[0].entry_counts;
+    csvd->_arena = builders[0].arena;
+  }
+  else
+  {
+    csvd->entry_counts = malloc_exit_if_null((line_count > 0 ? line_count : 1) * sizeof(size_t));
+    csvd->_arena = malloc_exit_if_null(arena_size > 0 ? arena_size : 1);
+  }
+  csvd->_entries = malloc_exit_if_null(SIZEOF_PTR * (entry_count > 0 ? entry_count : 1));
+  csvd->data = malloc_exit_if_null(SIZEOF_PTR * (line_count > 0 ? line_count : 1));
+
+  // INIT: csvd->entry_counts, csvd->_arena, csvd->_entries, csvd->data
+  if (num_builders == 1)
+    _stitch_builders(&stitch, 0, 1, 0);
+  else
+    run_thread_pool_parallel_for(get_shared_thread_pool(), 0, num_builders, 1, num_threads,
+                                 &_stitch_builders, &stitch);
+
+  // FREE: stitch.first_lines, stitch.first_entries, stitch.first_bytes
+  free_and_null(stitch.first_lines);
+  free_and_null(stitch.first_entries);
+  free_and_null(stitch.first_bytes);
+  return csvd;
+}
+
 csv_data_t*
 construct_csv_data (const char* path)
 {
@@ -54,63 +244,248 @@ construct_csv_data (const char* path)
   exit_if_null(fp);
 
   csv_parser parser;
-  char buffer[1024];
+  exit_if_not_zero(csv_init(&parser, CSV_STRICT | CSV_APPEND_NULL));
+
+  csv_builder_t builder;
+  _construct_builder(&builder);
+
+  // MALLOC: buffer
+  char* buffer = malloc_exit_if_null(CSV_READ_BLOCK_SIZE);
   size_t bytes_read;
+  while ((bytes_read = fread(buffer, 1, CSV_READ_BLOCK_SIZE, fp)) > 0)
+  {
+    if (csv_parse(&parser, buffer, bytes_read, _add_entry, _add_line, &builder) != bytes_read)
+    {
+      csv_exit_if_error(&parser);
+    }
+  }
+  // A last line without a line break ends here.
+  if (csv_fini(&parser, _add_entry, _add_line, &builder) != 0)
+  {
+    csv_exit_if_error(&parser);
+  }
 
-  exit_if_not_zero(csv_init(&parser, CSV_STRICT | CSV_APPEND_NULL));
+  // FREE: buffer
+  free_and_null(buffer);
+  fclose(fp);
+  csv_free(&parser);
 
-  // MALLOC: csvd
-  csv_data_t* csvd = malloc_exit_if_null(sizeof(csv_data_t));
+  return _construct_csv_data_from_builders(&builder, 1, 1);
+}
+
+csv_file_t*
+construct_csv_file (const char* path)
+{
+  const int fd = open(path, O_RDONLY);
+  if (fd == -1)
+  {
+    perror("Error");
+    exit(EXIT_FAILURE);
+  }
+  struct stat status;
+  exit_if_not_zero(fstat(fd, &status));
+
+  // MALLOC: file
+  csv_file_t* file = malloc_exit_if_null(sizeof(csv_file_t));
 
-  // Count csv file lines
-  csvd->line_count = 0;
-  while ((bytes_read = fread(buffer, 1, 1024, fp)) > 0)
+  // INIT: file->size, file->contents
+  file->size = status.st_size;
+  file->contents = NULL;
+  if (file->size > 0)
   {
-    if (csv_parse(&parser, buffer, bytes_read, NULL, count_lines, csvd) != bytes_read)
+    void* const mapping = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED)
     {
-      csv_exit_if_error(&parser); }
+      perror("Error");
+      exit(EXIT_FAILURE);
+    }
+    file->contents = (const char*) mapping;
+    // Every byte is read once, from the start to the end of each chunk.
+    posix_madvise(mapping, file->size, POSIX_MADV_SEQUENTIAL);
   }
+  close(fd);
+  return file;
+}
+
+void
+destruct_csv_file (csv_file_t* file)
+{
+  if (file->size > 0)
+    exit_if_not_zero(munmap((void*) file->contents, file->size));
+
+  // FREE: file
+  free_and_null(file);
+}
+
+#define CSV_NO_LINE_BREAK SIZE_MAX
+
+/*
+  What the first pass of split_csv_file() finds in a chunk of the file: the parity of its
+  quotes, and the first line break in it for either quote parity at its start.
+  */
+struct csv_chunk_scan_t
+{
+  size_t is_quote_count_odd;
+  size_t first_line_breaks[2];
+};
 
-  // MALLOC: csvd->entry_counts
-  csvd->entry_counts = calloc_exit_if_null(csvd->line_count, sizeof(size_t));
+typedef struct csv_chunk_scan_t csv_chunk_scan_t;
 
-  // MALLOC: csvd->data (lines)
-  csvd->data = malloc_exit_if_null(SIZEOF_PTR * csvd->line_count);
+struct csv_split_t
+{
+  const csv_file_t* file;
+  size_t            num_chunks;
+  csv_chunk_scan_t* scans;
+};
+
+typedef struct csv_split_t csv_split_t;
 
-  // Count csv file entries in each line
-  csv_fini(&parser, NULL, NULL, csvd);
-  rewind(fp);
-  line_index = 0;
-  while ((bytes_read = fread(buffer, 1, 1024, fp)) > 0)
+/*
+  A line break ends a line if it is outside quotes. As quotes inside quoted entries are
+  doubled, it is outside quotes if as many quotes come before it in the file as in the
+  chunk, modulo 2, when the chunk starts outside quotes, and otherwise if they differ.
+  */
+static void
+_scan_chunks (void*        data,
+              const size_t begin,
+              const size_t end,
+              const size_t slot)
+{
+  (void) slot;
+  const csv_split_t* const split = (const csv_split_t*) data;
+  size_t i, j;
+  for (i = begin; i < end; ++i)
   {
-    if (csv_parse(&parser, buffer, bytes_read, count_entries, increment_line, csvd) != bytes_read)
+    const char* const contents = split->file->contents;
+    const size_t first_byte = i * split->file->size / split->num_chunks;
+    const size_t last_byte = (i + 1) * split->file->size / split->num_chunks;
+    csv_chunk_scan_t* const scan = &split->scans[i];
+    scan->first_line_breaks[0] = scan->first_line_breaks[1] = CSV_NO_LINE_BREAK;
+    size_t is_quote_count_odd = 0;
+    for (j = first_byte; j < last_byte; ++j)
     {
-      csv_exit_if_error(&parser);
+      if (contents[j] == CSV_QUOTE)
+        is_quote_count_odd ^= 1;
+      else if (contents[j] == '\n' && scan->first_line_breaks[is_quote_count_odd] == CSV_NO_LINE_BREAK)
+        scan->first_line_breaks[is_quote_count_odd] = j;
     }
+    scan->is_quote_count_odd = is_quote_count_odd;
   }
+}
 
-  // MALLOC: csvd->data (fields in malloc'd lines)
-  size_t i;
-  for (i = 0; i < csvd->line_count; ++i)
+size_t
+split_csv_file (const csv_file_t* file,
+                const size_t      max_chunks,
+                const size_t      num_threads,
+                size_t*           chunk_offsets)
+{
+  const size_t num_chunks = max_chunks < 1 ? 1 : max_chunks;
+  csv_split_t split;
+  split.file = file;
+  split.num_chunks = num_chunks;
+  // MALLOC: split.scans
+  split.scans = malloc_exit_if_null(num_chunks * sizeof(csv_chunk_scan_t));
+  if (num_chunks > 1)
+    run_thread_pool_parallel_for(get_shared_thread_pool(), 0, num_chunks, 1, num_threads, &_scan_chunks, &split);
+
+  // The quote parity at the start of every chunk picks which of its line breaks is the first
+  // one outside quotes, after which the chunk starts. Chunks without one are merged.
+  size_t i, count = 1, is_quote_count_odd = 0;
+  chunk_offsets[0] = 0;
+  for (i = 1; i < num_chunks; ++i)
   {
-    csvd->data[i] = malloc_exit_if_null(SIZEOF_PTR * csvd->entry_counts[i]);
+    is_quote_count_odd ^= split.scans[i - 1].is_quote_count_odd;
+    const size_t line_break = split.scans[i].first_line_breaks[is_quote_count_odd];
+    if (line_break != CSV_NO_LINE_BREAK && line_break + 1 < file->size)
+      chunk_offsets[count++] = line_break + 1;
   }
+  chunk_offsets[count] = file->size;
+
+  // FREE: split.scans
+  free_and_null(split.scans);
+  return count;
+}
+
+size_t
+get_csv_file_max_chunks (const csv_file_t* file,
+                         const size_t      num_threads)
+{
+  const size_t max_threads = num_threads == 0 ? get_shared_thread_pool()->num_threads : num_threads;
+  // A single thread parses the file whole, as the lines of a single chunk are not copied.
+  const size_t max_chunks = file->size / CSV_MIN_CHUNK_SIZE;
+  if (max_threads == 1 || max_chunks < 1)
+    return 1;
+  if (max_chunks > max_threads * CSV_CHUNKS_PER_THREAD)
+    return max_threads * CSV_CHUNKS_PER_THREAD;
+  return max_chunks;
+}
 
-  // Read each entry into data, including mallocing the associated space.
-  csv_fini(&parser, NULL, NULL, csvd);
-  rewind(fp);
-  line_index = 0;
-  entry_index = 0;
-  while ((bytes_read = fread(buffer, 1, 1024, fp)) > 0)
+struct csv_parallel_parse_t
+{
+  const csv_file_t* file;
+  const size_t*     chunk_offsets;
+  csv_builder_t*    builders;
+};
+
+typedef struct csv_parallel_parse_t csv_parallel_parse_t;
+
+static void
+_parse_chunks (void*        data,
+               const size_t begin,
+               const size_t end,
+               const size_t slot)
+{
+  (void) slot;
+  const csv_parallel_parse_t* const parse = (const csv_parallel_parse_t*) data;
+  size_t i;
+  for (i = begin; i < end; ++i)
   {
-    if (csv_parse(&parser, buffer, bytes_read, read_entries, increment_line, csvd) != bytes_read)
+    csv_builder_t* const builder = &parse->builders[i];
+    _construct_builder(builder);
+
+    csv_parser parser;
+    exit_if_not_zero(csv_init(&parser, CSV_STRICT | CSV_APPEND_NULL));
+    const size_t size = parse->chunk_offsets[i + 1] - parse->chunk_offsets[i];
+    if (csv_parse(&parser, parse->file->contents + parse->chunk_offsets[i], size, _add_entry, _add_line, builder)
+        != size)
+    {
+      csv_exit_if_error(&parser);
+    }
+    if (csv_fini(&parser, _add_entry, _add_line, builder) != 0)
     {
       csv_exit_if_error(&parser);
     }
+    csv_free(&parser);
   }
+}
 
-  fclose(fp);
-  csv_free(&parser);
+csv_data_t*
+construct_csv_data_in_parallel (const char*  path,
+                                const size_t num_threads)
+{
+  csv_file_t* const file = construct_csv_file(path);
+  const size_t max_threads = num_threads == 0 ? get_shared_thread_pool()->num_threads : num_threads;
+  const size_t max_chunks = get_csv_file_max_chunks(file, max_threads);
+
+  // MALLOC: chunk_offsets
+  size_t* const chunk_offsets = malloc_exit_if_null((max_chunks + 1) * sizeof(size_t));
+  csv_parallel_parse_t parse;
+  parse.file = file;
+  parse.chunk_offsets = chunk_offsets;
+  const size_t num_chunks = split_csv_file(file, max_chunks, max_threads, chunk_offsets);
+
+  // MALLOC: parse.builders
+  parse.builders = malloc_exit_if_null(num_chunks * sizeof(csv_builder_t));
+  if (num_chunks > 1)
+    run_thread_pool_parallel_for(get_shared_thread_pool(), 0, num_chunks, 1, max_threads, &_parse_chunks, &parse);
+  else
+    _parse_chunks(&parse, 0, 1, 0);
+  csv_data_t* const csvd = _construct_csv_data_from_builders(parse.builders, num_chunks, max_threads);
+
+  // FREE: parse.builders, chunk_offsets
+  free_and_null(parse.builders);
+  free_and_null(chunk_offsets);
+  destruct_csv_file(file);
   return csvd;
 }
 
@@ -118,21 +493,15 @@ construct_csv_data (const char* path)
 void
 destruct_csv_data (csv_data_t* csvd)
 {
-  size_t i, j;
-  for (i = 0; i < csvd->line_count; ++i)
-  {
-    for (j = 0; j < csvd->entry_counts[i]; ++j)
-    {
-      // FREE: csvd->data[i][j]
-      free_and_null(csvd->data[i][j]);
-    }
-    // FREE: csvd->data[i]
-    free_and_null(csvd->data[i]);
-  }
-
   // FREE: csvd->data
   free_and_null(csvd->data);
 
+  // FREE: csvd->_entries
+  free_and_null(csvd->_entries);
+
+  // FREE: csvd->_arena
+  free_and_null(csvd->_arena);
+
   // FREE: csvd->entry_counts
   free_and_null(csvd->entry_counts);
 
@@ -10,6 +10,23 @@
 
 typedef struct csv_parser csv_parser;
 
+/*!
+  The number of bytes construct_csv_data() reads from a file at a time.
+  */
+#define CSV_READ_BLOCK_SIZE (1 << 20)
+
+/*!
+  The smallest number of bytes construct_csv_data_in_parallel() gives to a chunk, below
+  which a file is parsed by fewer threads.
+  */
+#define CSV_MIN_CHUNK_SIZE (1 << 20)
+
+/*!
+  The number of chunks per thread construct_csv_data_in_parallel() splits a file into, so
+  that threads finishing early take over the chunks of slower ones.
+  */
+#define CSV_CHUNKS_PER_THREAD 4
+
 /*!
   The csv_data_t \b struct
   */
@@ -27,18 +44,43 @@ struct csv_data_t
     The csv data, implemented in a two-dimensional array holding data strings.
     */
   char*** data;
+  char**  _entries;
+  char*   _arena;
 };
 
 typedef struct csv_data_t csv_data_t;
 
 /*!
   Constructs and recursively allocates memory for a new csv_data_t
+
+  The file is parsed once, in blocks of \b CSV_READ_BLOCK_SIZE bytes. The entries are
+  null-terminated strings stored back to back in a single allocation, and the entries of
+  each line are contiguous in another one.
+
+  The parser state lives in the call, so any number of files can be loaded concurrently.
+
   \param path the path to the associated csv file.
   \return a new csv_data_t instance.
   */
 csv_data_t*
 construct_csv_data (const char* path);
 
+/*!
+  Constructs a csv_data_t instance like construct_csv_data(), with the file mapped into
+  memory and split into chunks parsed by several threads of get_shared_thread_pool().
+
+  The chunks start after line breaks found by split_csv_file(), each is parsed by its own
+  parser, and their lines are copied back together in order, so the result is the same as
+  that of construct_csv_data() for any number of threads.
+
+  \param path the path to the associated csv file.
+  \param num_threads the maximum number of threads to use, or 0 for all of them.
+  \return a new csv_data_t instance.
+  */
+csv_data_t*
+construct_csv_data_in_parallel (const char*  path,
+                                const size_t num_threads);
+
 /*!
   Destructs and recursively free memory for the associated csv_data_t
   \param csvd the csv_data_t instance to free and destruct.
@@ -46,6 +88,78 @@ construct_csv_data (const char* path);
 void
 destruct_csv_data (csv_data_t* csvd);
 
+/*!
+  The csv_file_t \b struct
+
+  A csv file mapped into memory, read-only.
+  */
+struct csv_file_t
+{
+  /*!
+    The contents of the file, which are not null-terminated. \b NULL if it is empty.
+    */
+  const char* contents;
+  /*!
+    The size of the file in bytes.
+    */
+  size_t      size;
+};
+
+typedef struct csv_file_t csv_file_t;
+
+/*!
+  Constructs a csv_file_t instance by mapping a file into memory.
+
+  This function will exit if the file cannot be opened or mapped.
+
+  \param path the path to the associated csv file.
+  \return a new csv_file_t instance.
+  */
+csv_file_t*
+construct_csv_file (const char* path);
+
+/*!
+  Destructs a csv_file_t instance, unmapping its file.
+  \param file the csv_file_t instance to free and destruct.
+  */
+void
+destruct_csv_file (csv_file_t* file);
+
+/*!
+  Returns how many chunks a csv file is split into to be parsed by \b num_threads threads:
+  \b CSV_CHUNKS_PER_THREAD per thread, but none smaller than \b CSV_MIN_CHUNK_SIZE bytes, and
+  only one for a single thread.
+  \param file the csv_file_t instance to split.
+  \param num_threads the maximum number of threads to use, or 0 for all of them.
+  \return the number of chunks to give to split_csv_file().
+  */
+size_t
+get_csv_file_max_chunks (const csv_file_t* file,
+                         const size_t      num_threads);
+
+/*!
+  Splits a csv file into at most \b max_chunks chunks of whole lines, for them to be parsed
+  independently.
+
+  The file is cut into chunks of equal size, in which up to \b num_threads threads of
+  get_shared_thread_pool() count the quotes and find the first line feed both for a chunk
+  starting inside and outside quotes. The quotes before every chunk then tell which of the two
+  ends a line, and the chunk is moved to start after it. Chunks in which no line ends are
+  merged into the previous one.
+
+  \param file the csv_file_t instance to split.
+  \param max_chunks the maximum number of chunks.
+  \param num_threads the maximum number of threads to use, or 0 for all of them.
+  \param chunk_offsets an array of at least \b max_chunks + 1 elements, which receives the
+         offset of the start of every chunk followed by the size of the file.
+  \return the number of chunks.
+  */
+size_t
+split_csv_file (const csv_file_t* file,
+                const size_t      max_chunks,
+                const size_t      num_threads,
+                size_t*           chunk_offsets);
+
 /*!
   Prints data in the associated csv_data_t instance. Used for debugging purposes.
   \param csvd the csv_data_t instance to print.
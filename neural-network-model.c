@@ -0,0 +1,412 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "util/util.h"
+#include "validation.h"
+
+#include "neural-network-model.h"
+
+/*
+  Written as a uint32_t, it reads back the same only on machines of the same byte order.
+  */
+#define NEURAL_NETWORK_MODEL_BYTE_ORDER 0x01020304u
+
+#define FNV_OFFSET_BASIS 0xCBF29CE484222325ULL
+#define FNV_PRIME 0x100000001B3ULL
+
+static const char _model_magic[8] = {'C', 'A', 'N', 'N', 'M', 'O', 'D', 'L'};
+
+/*
+  The header at the start of a model file. Every offset is in bytes from the start of the file.
+  */
+struct neural_network_model_header_t
+{
+  char     magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t real_size;
+  uint32_t has_ranges;
+  char     activation_name[NEURAL_NETWORK_MODEL_ACTIVATION_NAME_SIZE];
+  uint64_t config_size;
+  uint64_t weights_size;
+  // The config_size sizes of the layers, then the config_size - 1 offsets of the weight
+  // layers in the weights, as uint64_t.
+  uint64_t config_offset;
+  // The minimums and maximums of the inputs, then those of the outputs, as double, then the
+  // descriptions of the inputs and of the outputs, as null-terminated strings. 0 if there are none.
+  uint64_t ranges_offset;
+  uint64_t weights_offset;
+  uint64_t file_size;
+  // The checksum of the whole file, with this field set to 0.
+  uint64_t checksum;
+};
+
+typedef struct neural_network_model_header_t neural_network_model_header_t;
+
+static uint64_t
+_hash (uint64_t          checksum,
+       const void* const p,
+       const size_t      size)
+{
+  const unsigned char* const bytes = (const unsigned char*) p;
+  size_t i;
+  for (i = 0; i < size; ++i)
+  {
+    checksum = (checksum ^ bytes[i]) * FNV_PRIME;
+  }
+  return checksum;
+}
+
+/*
+  A model file being written, and the checksum of what has been written to it.
+  */
+struct neural_network_model_writer_t
+{
+  FILE*    fp;
+  uint64_t offset;
+  uint64_t checksum;
+};
+
+typedef struct neural_network_model_writer_t neural_network_model_writer_t;
+
+static void
+_write (neural_network_model_writer_t* writer,
+        const void* const              p,
+        const size_t                   size)
+{
+  fwrite_exit_if_failed(p, 1, size, writer->fp);
+  writer->checksum = _hash(writer->checksum, p, size);
+  writer->offset += size;
+}
+
+static void
+_write_uint64 (neural_network_model_writer_t* writer,
+               const uint64_t                 value)
+{
+  _write(writer, &value, sizeof(uint64_t));
+}
+
+static void
+_write_doubles (neural_network_model_writer_t* writer,
+                const double* const            values,
+                const size_t                   count)
+{
+  _write(writer, values, count * sizeof(double));
+}
+
+static void
+_write_strings (neural_network_model_writer_t* writer,
+                char** const                   strings,
+                const size_t                   count)
+{
+  size_t i;
+  for (i = 0; i < count; ++i)
+  {
+    _write(writer, strings[i], strlen(strings[i]) + 1);
+  }
+}
+
+static size_t
+_get_strings_size (char** const strings,
+                   const size_t count)
+{
+  size_t i, size = 0;
+  for (i = 0; i < count; ++i)
+  {
+    size += strlen(strings[i]) + 1;
+  }
+  return size;
+}
+
+void
+save_neural_network_model (const neural_network_t* const nn,
+                           double                        (*activation_function) (const double),
+                           const training_set_t*   const ranges,
+                           const char*             const path)
+{
+  const activation_functions_t* const functions = find_activation_functions(activation_function);
+  if (functions == NULL)
+    putserr_and_exit("Only the activation functions defined in activation-functions.h can be saved in a model.");
+  if (ranges != NULL)
+    validate_matching_neural_network_and_training_set(nn, ranges);
+
+  neural_network_model_header_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, _model_magic, sizeof(_model_magic));
+  header.version = NEURAL_NETWORK_MODEL_VERSION;
+  header.byte_order = NEURAL_NETWORK_MODEL_BYTE_ORDER;
+  header.real_size = sizeof(real_t);
+  header.has_ranges = ranges != NULL;
+  strncpy(header.activation_name, functions->name, sizeof(header.activation_name) - 1);
+  header.config_size = nn->config_size;
+  header.weights_size = nn->weights_size;
+  header.config_offset = sizeof(header);
+  uint64_t offset = header.config_offset + (2 * nn->config_size - 1) * sizeof(uint64_t);
+  if (ranges != NULL)
+  {
+    header.ranges_offset = offset;
+    offset += 2 * (ranges->input_size + ranges->output_size) * sizeof(double)
+              + _get_strings_size(ranges->input_entries_desc, ranges->input_size)
+              + _get_strings_size(ranges->output_entries_desc, ranges->output_size);
+  }
+  header.weights_offset = (offset + NEURAL_NETWORK_WEIGHT_ALIGNMENT - 1)
+                          / NEURAL_NETWORK_WEIGHT_ALIGNMENT * NEURAL_NETWORK_WEIGHT_ALIGNMENT;
+  header.file_size = header.weights_offset + nn->weights_size * sizeof(real_t);
+
+  neural_network_model_writer_t writer;
+  writer.fp = fopen(path, "wb");
+  exit_if_null(writer.fp);
+  writer.offset = 0;
+  writer.checksum = FNV_OFFSET_BASIS;
+
+  _write(&writer, &header, sizeof(header));
+  size_t i;
+  for (i = 0; i < nn->config_size; ++i)
+  {
+    _write_uint64(&writer, nn->config[i]);
+  }
+  for (i = 0; i < nn->config_size - 1; ++i)
+  {
+    _write_uint64(&writer, nn->weight_offsets[i]);
+  }
+  if (ranges != NULL)
+  {
+    _write_doubles(&writer, ranges->input_entries_min, ranges->input_size);
+    _write_doubles(&writer, ranges->input_entries_max, ranges->input_size);
+    _write_doubles(&writer, ranges->output_entries_min, ranges->output_size);
+    _write_doubles(&writer, ranges->output_entries_max, ranges->output_size);
+    _write_strings(&writer, ranges->input_entries_desc, ranges->input_size);
+    _write_strings(&writer, ranges->output_entries_desc, ranges->output_size);
+  }
+  const char padding[NEURAL_NETWORK_WEIGHT_ALIGNMENT] = {0};
+  _write(&writer, padding, header.weights_offset - writer.offset);
+  _write(&writer, nn->weights, nn->weights_size * sizeof(real_t));
+
+  // The checksum was computed with the field set to 0, and goes in it last.
+  exit_if_not_zero(fseek(writer.fp, offsetof(neural_network_model_header_t, checksum), SEEK_SET));
+  fwrite_exit_if_failed(&writer.checksum, sizeof(uint64_t), 1, writer.fp);
+  exit_if_not_zero(fclose(writer.fp));
+}
+
+/*
+  Whether \b size bytes at \b offset are within a file of \b file_size bytes.
+  */
+static bool
+_is_within (const uint64_t offset,
+            const uint64_t size,
+            const uint64_t file_size)
+{
+  return offset <= file_size && size <= file_size - offset;
+}
+
+/*
+  Checks everything the model is built from, so that a malformed file cannot make it
+  point outside the mapping.
+  */
+static void
+_validate_model (const char* const                    path,
+                 const neural_network_model_header_t* header,
+                 const size_t                         file_size,
+                 const bool                           verify_checksum)
+{
+  if (file_size < sizeof(neural_network_model_header_t)
+      || memcmp(header->magic, _model_magic, sizeof(_model_magic)) != 0)
+    printferr_and_exit("%s is not a neural network model.\n", path);
+  if (header->version != NEURAL_NETWORK_MODEL_VERSION)
+    printferr_and_exit("The neural network model %s has version %u instead of %d.\n", path,
+                       (unsigned int) header->version, NEURAL_NETWORK_MODEL_VERSION);
+  if (header->byte_order != NEURAL_NETWORK_MODEL_BYTE_ORDER)
+    printferr_and_exit("The neural network model %s was saved with another byte order.\n", path);
+  if (header->real_size != sizeof(real_t))
+    printferr_and_exit("The neural network model %s was saved with another precision.\n", path);
+  if (header->file_size != file_size)
+    printferr_and_exit("The neural network model %s is truncated.\n", path);
+
+  if (verify_checksum)
+  {
+    const uint64_t zero = 0;
+    const size_t checksum_offset = offsetof(neural_network_model_header_t, checksum);
+    const unsigned char* const bytes = (const unsigned char*) header;
+    uint64_t checksum = _hash(FNV_OFFSET_BASIS, bytes, checksum_offset);
+    checksum = _hash(checksum, &zero, sizeof(uint64_t));
+    checksum = _hash(checksum, bytes + checksum_offset + sizeof(uint64_t),
+                     file_size - checksum_offset - sizeof(uint64_t));
+    if (checksum != header->checksum)
+      printferr_and_exit("The neural network model %s is corrupted.\n", path);
+  }
+
+  const uint64_t config_size = header->config_size;
+  const uint64_t weights_size = header->weights_size;
+  bool is_valid = memchr(header->activation_name, '\0', sizeof(header->activation_name)) != NULL
+                  && config_size >= 2 && config_size <= file_size / sizeof(uint64_t)
+                  && header->config_offset % sizeof(uint64_t) == 0
+                  && _is_within(header->config_offset, (2 * config_size - 1) * sizeof(uint64_t), file_size)
+                  && header->weights_offset % NEURAL_NETWORK_WEIGHT_ALIGNMENT == 0
+                  && weights_size <= file_size / sizeof(real_t)
+                  && _is_within(header->weights_offset, weights_size * sizeof(real_t), file_size);
+  const uint64_t* const config = (const uint64_t*) ((const char*) header + header->config_offset);
+  const uint64_t* const weight_offsets = config + config_size;
+  const uint64_t elements_per_alignment = NEURAL_NETWORK_WEIGHT_ALIGNMENT / sizeof(real_t);
+  size_t i;
+  for (i = 0; is_valid && i < config_size - 1; ++i)
+  {
+    // Every weight layer is aligned like those of construct_neural_network(), and within the weights.
+    is_valid = config[i] > 0 && config[i + 1] > 0
+               && config[i] <= weights_size && config[i + 1] <= weights_size / config[i]
+               && weight_offsets[i] % elements_per_alignment == 0
+               && _is_within(weight_offsets[i], config[i] * config[i + 1], weights_size);
+  }
+  if (!is_valid)
+    printferr_and_exit("The neural network model %s is malformed.\n", path);
+}
+
+/*
+  Builds the ranges of a model from its mapping, whose descriptions must end before its weights.
+  */
+static training_set_t*
+_construct_model_ranges (const char* const                    path,
+                         const neural_network_model_header_t* header,
+                         const neural_network_t*              nn)
+{
+  char* const mapping = (char*) header;
+  const size_t input_size = nn->config[0];
+  const size_t output_size = nn->config[nn->config_size - 1];
+  const uint64_t doubles_size = 2 * (input_size + output_size) * sizeof(double);
+  if (header->ranges_offset % sizeof(double) != 0
+      || !_is_within(header->ranges_offset, doubles_size, header->weights_offset))
+    printferr_and_exit("The neural network model %s is malformed.\n", path);
+
+  // MALLOC: ranges
+  training_set_t* const ranges = malloc_exit_if_null(sizeof(training_set_t));
+
+  // INIT: ranges->training_set_size, ranges->input_size, ranges->output_size,
+  //       ranges->target_inputs, ranges->target_outputs, ranges->_is_normalized,
+  //       ranges->_inputs, ranges->_outputs
+  ranges->training_set_size = 0;
+  ranges->input_size = input_size;
+  ranges->output_size = output_size;
+  ranges->target_inputs = NULL;
+  ranges->target_outputs = NULL;
+  ranges->_inputs = NULL;
+  ranges->_outputs = NULL;
+  ranges->_is_normalized = true;
+
+  // INIT: ranges->input_entries_min, ranges->input_entries_max,
+  //       ranges->output_entries_min, ranges->output_entries_max
+  ranges->input_entries_min = (double*) (mapping + header->ranges_offset);
+  ranges->input_entries_max = ranges->input_entries_min + input_size;
+  ranges->output_entries_min = ranges->input_entries_max + input_size;
+  ranges->output_entries_max = ranges->output_entries_min + output_size;
+
+  // MALLOC: ranges->input_entries_desc, ranges->output_entries_desc
+  // INIT: ranges->input_entries_desc, ranges->output_entries_desc
+  ranges->input_entries_desc = malloc_exit_if_null((input_size + output_size) * SIZEOF_PTR);
+  ranges->output_entries_desc = ranges->input_entries_desc + input_size;
+  char* description = mapping + header->ranges_offset + doubles_size;
+  char* const end = mapping + header->weights_offset;
+  size_t i;
+  for (i = 0; i < input_size + output_size; ++i)
+  {
+    char* const terminator = memchr(description, '\0', end - description);
+    if (terminator == NULL)
+      printferr_and_exit("The neural network model %s is malformed.\n", path);
+    ranges->input_entries_desc[i] = description;
+    description = terminator + 1;
+  }
+
+  return ranges;
+}
+
+neural_network_model_t*
+construct_neural_network_model (const char* const path,
+                                const bool        verify_checksum)
+{
+  const int fd = open(path, O_RDONLY);
+  if (fd == -1)
+  {
+    perror("Error");
+    exit(EXIT_FAILURE);
+  }
+  struct stat status;
+  exit_if_not_zero(fstat(fd, &status));
+  const size_t file_size = status.st_size;
+  if (file_size < sizeof(neural_network_model_header_t))
+    printferr_and_exit("%s is not a neural network model.\n", path);
+
+  // The mapping is private, so that the weights can be changed without changing the file.
+  void* const mapping = mmap(NULL, file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if (mapping == MAP_FAILED)
+  {
+    perror("Error");
+    exit(EXIT_FAILURE);
+  }
+  close(fd);
+
+  const neural_network_model_header_t* const header = (const neural_network_model_header_t*) mapping;
+  _validate_model(path, header, file_size, verify_checksum);
+
+  // MALLOC: model
+  neural_network_model_t* const model = malloc_exit_if_null(sizeof(neural_network_model_t));
+
+  // INIT: model->_mapping, model->_mapping_size
+  model->_mapping = mapping;
+  model->_mapping_size = file_size;
+
+  // MALLOC: model->nn.config, model->nn.weight_offsets
+  // INIT: model->nn
+  const uint64_t* const config = (const uint64_t*) ((const char*) mapping + header->config_offset);
+  model->nn.config_size = header->config_size;
+  model->nn.config = malloc_exit_if_null(model->nn.config_size * sizeof(size_t));
+  model->nn.weight_offsets = malloc_exit_if_null((model->nn.config_size - 1) * sizeof(size_t));
+  size_t i;
+  for (i = 0; i < model->nn.config_size; ++i)
+  {
+    model->nn.config[i] = config[i];
+  }
+  for (i = 0; i < model->nn.config_size - 1; ++i)
+  {
+    model->nn.weight_offsets[i] = config[model->nn.config_size + i];
+  }
+  model->nn.weights_size = header->weights_size;
+  model->nn.weights = (real_t*) ((char*) mapping + header->weights_offset);
+
+  // INIT: model->activation_functions
+  model->activation_functions = find_activation_functions_by_name(header->activation_name);
+  if (model->activation_functions == NULL)
+    printferr_and_exit("The neural network model %s uses the unknown activation function %s.\n", path,
+                       header->activation_name);
+
+  // MALLOC: model->ranges
+  // INIT: model->ranges
+  model->ranges = header->has_ranges ? _construct_model_ranges(path, header, &model->nn) : NULL;
+
+  return model;
+}
+
+void
+destruct_neural_network_model (neural_network_model_t* model)
+{
+  // FREE: model->ranges
+  if (model->ranges != NULL)
+  {
+    free_and_null(model->ranges->input_entries_desc);
+    free_and_null(model->ranges);
+  }
+
+  // FREE: model->nn.config, model->nn.weight_offsets
+  free_and_null(model->nn.config);
+  free_and_null(model->nn.weight_offsets);
+
+  exit_if_not_zero(munmap(model->_mapping, model->_mapping_size));
+
+  // FREE: model
+  free_and_null(model);
+}
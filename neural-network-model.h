@@ -0,0 +1,103 @@
+/*!
+  \file neural-network-model.h
+  \brief Saves trained neural networks to binary model files, and maps them back into memory.
+  \author Hellyna Ng (hellyna@hellyna.com)
+  */
+#ifndef NEURAL_NETWORK_MODEL_H_580BA57B_35D9_451A_915E_89FC00163C4A
+#define NEURAL_NETWORK_MODEL_H_580BA57B_35D9_451A_915E_89FC00163C4A
+
+#include <stdbool.h>
+
+#include "neural-network.h"
+#include "training-set.h"
+#include "activation-functions.h"
+
+/*!
+  The version of the model files written by save_neural_network_model(). Files of other
+  versions are refused.
+  */
+#define NEURAL_NETWORK_MODEL_VERSION 1
+
+/*!
+  The maximum length of the name of the activation function in a model file, including
+  the terminating null character.
+  */
+#define NEURAL_NETWORK_MODEL_ACTIVATION_NAME_SIZE 32
+
+/*!
+  The neural_network_model_t \b struct.
+
+  A neural network mapped from a model file. Its weights are used in place in the
+  mapping, so loading it reads nothing but the header and the topology.
+  */
+struct neural_network_model_t
+{
+  /*!
+    The neural network, whose weights point into the mapped file. Writing to them changes
+    this mapping only, never the file. It must not be destructed with destruct_neural_network().
+    */
+  neural_network_t              nn;
+  /*!
+    The activation functions the neural network was trained with.
+    */
+  const activation_functions_t* activation_functions;
+  /*!
+    The training set the neural network was trained on, with its input and output sizes,
+    normalization ranges and descriptions but no samples, to give to predict_csv_file().
+    \b NULL if the model was saved without it. It must not be destructed with
+    destruct_training_set().
+    */
+  training_set_t*               ranges;
+  void*                         _mapping;
+  size_t                        _mapping_size;
+};
+
+typedef struct neural_network_model_t neural_network_model_t;
+
+/*!
+  Saves a neural network to a binary model file.
+
+  The file starts with a header holding its version, byte order, precision, the name of
+  the activation function, and a 64-bit FNV-1a checksum of the whole file. Then come the
+  topology, with the offsets of the weight layers, the normalization ranges and
+  descriptions if any, and neural_network_t::weights as it is in memory, padding included,
+  at an offset that is a multiple of \b NEURAL_NETWORK_WEIGHT_ALIGNMENT bytes. The weights
+  are therefore saved exactly, and the file can only be loaded on machines with the same
+  byte order and precision.
+
+  \param nn the neural_network_t instance to save.
+  \param activation_function the activation function the network was trained with, one of
+         those defined in activation-functions.h.
+  \param ranges the training set the network was trained on, whose ranges and descriptions
+         are saved, or \b NULL to save none.
+  \param path the path + filename to save to.
+  */
+void
+save_neural_network_model (const neural_network_t* const nn,
+                           double                        (*activation_function) (const double),
+                           const training_set_t*   const ranges,
+                           const char*             const path);
+
+/*!
+  Constructs a neural_network_model_t instance by mapping a model file saved by
+  save_neural_network_model() into memory.
+
+  This function will exit if the file is not a model file of this version, byte order and
+  precision, or is malformed.
+
+  \param path the path + filename to load from.
+  \param verify_checksum set this to true to verify the checksum, which reads the whole file.
+  \return a new neural_network_model_t instance.
+  */
+neural_network_model_t*
+construct_neural_network_model (const char* const path,
+                                const bool        verify_checksum);
+
+/*!
+  Destructs a neural_network_model_t instance, unmapping its file.
+  \param model the neural_network_model_t instance to free and destruct.
+  */
+void
+destruct_neural_network_model (neural_network_model_t* model);
+
+#endif
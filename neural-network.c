@@ -7,6 +7,7 @@
 #include "util/util.h"
 #include "libcsv/csv.h"
 #include "validation.h"
+#include "simd-kernels.h"
 
 #include "neural-network.h"
 
@@ -27,18 +28,22 @@ _construct_neural_network (const size_t* const config,
   memcpy(nn->config, config, sizeof(size_t) * config_size);
 
   size_t num_weight_layers = nn->config_size - 1;
-  // MALLOC: nn->weights
-  nn->weights = malloc_exit_if_null(num_weight_layers * SIZEOF_PTR);
+  // MALLOC: nn->weight_offsets
+  nn->weight_offsets = malloc_exit_if_null(num_weight_layers * sizeof(size_t));
 
-  size_t i, j;
+  // INIT: nn->weight_offsets, nn->weights_size
+  const size_t elements_per_alignment = NEURAL_NETWORK_WEIGHT_ALIGNMENT / sizeof(real_t);
+  size_t i, weights_size = 0;
   for (i = 0; i < num_weight_layers; ++i)
   {
-    nn->weights[i] = malloc_exit_if_null(SIZEOF_PTR * nn->config[i]);
-    for (j = 0; j < nn->config[i]; ++j)
-    {
-      nn->weights[i][j] = malloc_exit_if_null(sizeof(double) * nn->config[i + 1]);
-    }
+    nn->weight_offsets[i] = weights_size;
+    weights_size += nn->config[i] * nn->config[i + 1];
+    weights_size = (weights_size + elements_per_alignment - 1) / elements_per_alignment * elements_per_alignment;
   }
+  nn->weights_size = weights_size;
+
+  // MALLOC: nn->weights
+  nn->weights = construct_neural_network_weight_buffer(nn);
 
   return nn;
 }
@@ -103,17 +108,10 @@ void
 destruct_neural_network (neural_network_t* nn)
 {
   // FREE: nn->weights
-  size_t num_weight_layers = nn->config_size - 1;
-  size_t i, j;
-  for (i = 0; i < num_weight_layers; ++i)
-  {
-    for (j = 0; j < nn->config[i]; ++j)
-    {
-      free_and_null(nn->weights[i][j]);
-    }
-    free_and_null(nn->weights[i]);
-  }
-  free_and_null(nn->weights);
+  destruct_neural_network_weight_buffer(nn->weights);
+
+  // FREE: nn->weight_offsets
+  free_and_null(nn->weight_offsets);
 
   // FREE: config
   free_and_null(nn->config);
@@ -123,6 +121,79 @@ destruct_neural_network (neural_network_t* nn)
 }
 
 
+real_t*
+construct_neural_network_weight_buffer (const neural_network_t* const nn)
+{
+  return aligned_calloc_exit_if_null(NEURAL_NETWORK_WEIGHT_ALIGNMENT, nn->weights_size, sizeof(real_t));
+}
+
+
+double*
+construct_neural_network_gradient_buffer (const neural_network_t* const nn)
+{
+  return aligned_calloc_exit_if_null(NEURAL_NETWORK_WEIGHT_ALIGNMENT, nn->weights_size, sizeof(double));
+}
+
+
+void
+destruct_neural_network_weight_buffer (void* buffer)
+{
+  free_and_null(buffer);
+}
+
+
+static inline size_t
+_min (const size_t a,
+      const size_t b)
+{
+  return a < b ? a : b;
+}
+
+
+void
+compute_neural_network_layer_sums (const neural_network_t* const nn,
+                                   const size_t                  layer,
+                                   const real_t*           const inputs,
+                                   real_t*                 const sums,
+                                   const size_t                  batch_size)
+{
+  const simd_kernels_t* const kernels = get_simd_kernels();
+  const size_t num_inputs = nn->config[layer];
+  const size_t num_outputs = nn->config[layer + 1];
+  const real_t* const weights = get_neural_network_weight_layer(nn, layer);
+  size_t i;
+  for (i = 0; i < batch_size * num_outputs; ++i)
+  {
+    sums[i] = 0.0;
+  }
+
+  const size_t column_block = _min(num_outputs, NEURAL_NETWORK_CACHE_BLOCK_SIZE / sizeof(real_t) / 8);
+  size_t row_block = NEURAL_NETWORK_CACHE_BLOCK_SIZE / (column_block * sizeof(real_t));
+  if (row_block == 0)
+    row_block = 1;
+
+  size_t column_begin, column_end, row_begin, row_end, bi;
+  for (column_begin = 0; column_begin < num_outputs; column_begin = column_end)
+  {
+    column_end = _min(column_begin + column_block, num_outputs);
+    for (row_begin = 0; row_begin < num_inputs; row_begin = row_end)
+    {
+      row_end = _min(row_begin + row_block, num_inputs);
+      for (bi = 0; bi < batch_size; ++bi)
+      {
+        const real_t* const sample_inputs = inputs + bi * num_inputs;
+        real_t* const sample_sums = sums + bi * num_outputs + column_begin;
+        for (i = row_begin; i < row_end; ++i)
+        {
+          kernels->axpy(sample_inputs[i], weights + i * num_outputs + column_begin,
+                        sample_sums, column_end - column_begin);
+        }
+      }
+    }
+  }
+}
+
+
 void
 initialize_nguyen_widrow_weights (const neural_network_t* const nn,
                                   const double                  min_weight,
@@ -144,18 +215,19 @@ initialize_nguyen_widrow_weights (const neural_network_t* const nn,
   {
     for (j = 0; j < nn->config[i]; ++j)
     {
+      real_t* const row = get_neural_network_weight(nn, i, j, 0);
       double n = 0.0;
       for (k = 0; k < nn->config[i + 1]; ++k)
       {
-        double x = nn->weights[i][j][k];
+        double x = row[k];
         n += x * x;
       }
       n = sqrt(n);
 
       for (k = 0; k < nn->config[i + 1]; ++k)
       {
-        double x = nn->weights[i][j][k];
-        nn->weights[i][j][k] = (x * beta) / n;
+        double x = row[k];
+        row[k] = (x * beta) / n;
       }
     }
   }
@@ -172,11 +244,12 @@ initialize_uniform_weights (const neural_network_t* const nn,
   size_t i, j, k;
   for (i = 0; i < nn->config_size - 1; ++i)
   {
+    real_t* const layer = get_neural_network_weight_layer(nn, i);
     for (j = 0; j < nn->config[i]; ++j)
     {
       for (k = 0; k < nn->config[i + 1]; ++k)
       {
-        nn->weights[i][j][k] = rand_double() * (max_weight - min_weight) + min_weight ;
+        layer[j * nn->config[i + 1] + k] = rand_double() * (max_weight - min_weight) + min_weight ;
       }
     }
   }
@@ -197,7 +270,7 @@ save_neural_network_weights (const neural_network_t*  const nn,
       for (k = 0; k < nn->config[i + 1]; ++k)
       {
         memset(buffer, 0, sizeof(buffer));
-        sprintf(buffer, "%g", nn->weights[i][j][k]);
+        sprintf(buffer, "%g", *get_neural_network_weight(nn, i, j, k));
         csv_fwrite(fp, buffer, strlen(buffer));
         if (k < nn->config[i + 1] - 1)
           fputc(',', fp);
@@ -223,7 +296,7 @@ load_neural_network_weights (const neural_network_t*  const nn,
     {
       for (k = 0; k < nn->config[i + 1]; ++k)
       {
-        nn->weights[i][j][k] = strtod(data->data[csv_data_index + j][k], NULL);
+        *get_neural_network_weight(nn, i, j, k) = strtod(data->data[csv_data_index + j][k], NULL);
       }
     }
     csv_data_index += nn->config[i];
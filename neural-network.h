@@ -7,6 +7,20 @@
 #define NEURAL_NETWORK_H_12AFA1B9_118C_4A47_BFB9_66D964F377ED
 
 #include "error-data.h"
+#include "precision.h"
+
+/*!
+  The alignment, in bytes, of every weight layer in neural_network_t::weights
+  and in every buffer created by construct_neural_network_weight_buffer() or
+  construct_neural_network_gradient_buffer().
+  */
+#define NEURAL_NETWORK_WEIGHT_ALIGNMENT 64
+
+/*!
+  The size in bytes of the weight and gradient blocks that are kept in cache while a batch
+  of samples is processed.
+  */
+#define NEURAL_NETWORK_CACHE_BLOCK_SIZE 32768
 
 /*!
   The neural_network_t \b struct.
@@ -28,19 +42,93 @@ struct neural_network_t {
     States the size of the \link config config.
     */
   size_t           config_size;
+  /*!
+    The offset of each weight layer in \link weights weights, counted in elements.
+
+    There are \link config_size config_size - 1 offsets, each of which is a multiple of
+    \b NEURAL_NETWORK_WEIGHT_ALIGNMENT bytes.
+    */
+  size_t*          weight_offsets;
+  /*!
+    The total number of elements in \link weights weights, including the padding between layers.
+    */
+  size_t           weights_size;
   /*!
     The neural network weights
 
-    Stores all the weights in the neural network in a 3-dimensional jagged array.
+    Stores all the weights in the neural network in a single aligned allocation.
 
-    The first dimension contains the number of neuron layers - 1. The second dimension
-    points to the 'from' (current) neuron and the third dimension points to the 'to' neuron.
+    Weight layer \b i starts at \link weight_offsets weight_offsets[i] and is a row-major
+    config[i] x config[i + 1] matrix: the row points to the 'from' (current) neuron and
+    the column points to the 'to' neuron. Use get_neural_network_weight_layer() or
+    get_neural_network_weight() to access it.
     */
-  double***        weights;
+  real_t*          weights;
 };
 
 typedef struct neural_network_t neural_network_t;
 
+/*!
+  Gets a weight layer from a buffer laid out like neural_network_t::weights.
+  \param nn the neural_network_t instance the buffer was created for.
+  \param buffer the buffer, either neural_network_t::weights or one created by
+         construct_neural_network_weight_buffer().
+  \param layer the weight layer index, from 0 to config_size - 2.
+  \return the row-major config[layer] x config[layer + 1] matrix of that layer.
+  */
+static inline real_t*
+get_weight_buffer_layer (const neural_network_t* const nn,
+                         real_t*                 const buffer,
+                         const size_t                  layer)
+{
+  return buffer + nn->weight_offsets[layer];
+}
+
+/*!
+  Gets a weight layer from a buffer created by construct_neural_network_gradient_buffer().
+  \param nn the neural_network_t instance the buffer was created for.
+  \param buffer the buffer.
+  \param layer the weight layer index, from 0 to config_size - 2.
+  \return the row-major config[layer] x config[layer + 1] matrix of that layer.
+  */
+static inline double*
+get_gradient_buffer_layer (const neural_network_t* const nn,
+                           double*                 const buffer,
+                           const size_t                  layer)
+{
+  return buffer + nn->weight_offsets[layer];
+}
+
+/*!
+  Gets a weight layer of a neural_network_t instance.
+  \param nn the neural_network_t instance.
+  \param layer the weight layer index, from 0 to config_size - 2.
+  \return the row-major config[layer] x config[layer + 1] matrix of that layer.
+  */
+static inline real_t*
+get_neural_network_weight_layer (const neural_network_t* const nn,
+                                 const size_t                  layer)
+{
+  return get_weight_buffer_layer(nn, nn->weights, layer);
+}
+
+/*!
+  Gets a single weight of a neural_network_t instance.
+  \param nn the neural_network_t instance.
+  \param layer the weight layer index, from 0 to config_size - 2.
+  \param from the neuron index in layer \b layer.
+  \param to the neuron index in layer \b layer + 1.
+  \return a pointer to the weight.
+  */
+static inline real_t*
+get_neural_network_weight (const neural_network_t* const nn,
+                           const size_t                  layer,
+                           const size_t                  from,
+                           const size_t                  to)
+{
+  return get_neural_network_weight_layer(nn, layer) + from * nn->config[layer + 1] + to;
+}
+
 /*!
   Constructs a neural_network_t instance, dynamically allocating all the memory in it recursively.
   \param config the config structure as stated in neural_network_t.
@@ -77,6 +165,53 @@ construct_neural_network_from_file (const char* const path);
 void
 destruct_neural_network (neural_network_t* nn);
 
+/*!
+  Allocates a zero-initialized buffer laid out exactly like neural_network_t::weights,
+  for per-weight data such as optimizer state.
+  \param nn the neural_network_t instance to derive the layout from.
+  \return the new buffer, of \link neural_network_t::weights_size weights_size elements.
+  */
+real_t*
+construct_neural_network_weight_buffer (const neural_network_t* const nn);
+
+/*!
+  Allocates a zero-initialized \b double buffer with the same layout as neural_network_t::weights,
+  for per-weight sums such as gradients, which are always accumulated in double precision.
+  \param nn the neural_network_t instance to derive the layout from.
+  \return the new buffer, of \link neural_network_t::weights_size weights_size elements.
+  */
+double*
+construct_neural_network_gradient_buffer (const neural_network_t* const nn);
+
+/*!
+  Frees a buffer created by construct_neural_network_weight_buffer() or
+  construct_neural_network_gradient_buffer().
+  \param buffer the buffer to free.
+  */
+void
+destruct_neural_network_weight_buffer (void* buffer);
+
+/*!
+  Computes the weighted sums of the neurons in layer \b layer + 1 for a batch of samples.
+
+  The batch is processed as a matrix-matrix product, blocked so that a block of weights
+  is reused by every sample of the batch while it is in cache. Each sum is accumulated
+  in weight row order, so the result for a sample does not depend on the batch size.
+  Reads nothing but \b nn and \b inputs, so it can be called concurrently.
+
+  \param nn the neural_network_t instance.
+  \param layer the weight layer index, from 0 to config_size - 2.
+  \param inputs the row-major batch_size x config[layer] activations of layer \b layer.
+  \param sums the row-major batch_size x config[layer + 1] weighted sums to write.
+  \param batch_size the number of samples.
+  */
+void
+compute_neural_network_layer_sums (const neural_network_t* const nn,
+                                   const size_t                  layer,
+                                   const real_t*           const inputs,
+                                   real_t*                 const sums,
+                                   const size_t                  batch_size);
+
 /*!
   Initializes a neural_network_t instance with Nguyen-Widrow weights.
   \param nn the neural_network_t instance to initialize.
@@ -0,0 +1,28 @@
+/*!
+  \file precision.h
+  \brief Selects the floating-point precision of the weights, activations and training data.
+
+  Define \b CANN_SINGLE_PRECISION when compiling every file to store them as \b float,
+  which halves their memory and doubles the number of them in a vector register.
+  Gradients and errors, which are summed over the whole training set, are always
+  accumulated in \b double.
+  \author Hellyna Ng (hellyna@hellyna.com)
+  */
+#ifndef PRECISION_H_0C7E3B52_8A41_4D6F_9E2C_71B5A3D84F16
+#define PRECISION_H_0C7E3B52_8A41_4D6F_9E2C_71B5A3D84F16
+
+#ifdef DOXYGEN
+  /*!
+    The floating-point type of the weights, activations and training data:
+    \b float if \b CANN_SINGLE_PRECISION is defined, \b double otherwise.
+    */
+  typedef double real_t;
+#else
+  #ifdef CANN_SINGLE_PRECISION
+    typedef float real_t;
+  #else
+    typedef double real_t;
+  #endif
+#endif
+
+#endif
@@ -0,0 +1,83 @@
+#include "util/util.h"
+
+#include "prediction.h"
+
+prediction_workspace_t*
+construct_prediction_workspace (const neural_network_t* const nn,
+                                double                        (*activation_function) (const double),
+                                const size_t                  batch_size)
+{
+  if (batch_size == 0)
+    putserr_and_exit("The prediction batch size must be at least 1.");
+
+  // MALLOC: workspace
+  prediction_workspace_t* workspace = malloc_exit_if_null(sizeof(prediction_workspace_t));
+
+  // INIT: workspace->batch_size
+  workspace->batch_size = batch_size;
+
+  // INIT: workspace->_activation_function
+  workspace->_activation_function = activation_function;
+
+  // INIT: workspace->_activation_array_function
+  const activation_functions_t* const functions = find_activation_functions(activation_function);
+  workspace->_activation_array_function = functions != NULL ? functions->activation_array_function : NULL;
+
+  // MALLOC: workspace->_layer_outputs
+  size_t i, max_layer_size = 0;
+  for (i = 0; i < nn->config_size; ++i)
+  {
+    if (nn->config[i] > max_layer_size)
+      max_layer_size = nn->config[i];
+  }
+  workspace->_layer_outputs[0] = malloc_exit_if_null(batch_size * max_layer_size * sizeof(real_t));
+  workspace->_layer_outputs[1] = malloc_exit_if_null(batch_size * max_layer_size * sizeof(real_t));
+
+  return workspace;
+}
+
+void
+destruct_prediction_workspace (prediction_workspace_t* workspace)
+{
+  // FREE: workspace->_layer_outputs
+  free_and_null(workspace->_layer_outputs[0]);
+  free_and_null(workspace->_layer_outputs[1]);
+
+  // FREE: workspace
+  free_and_null(workspace);
+}
+
+void
+predict_neural_network (const neural_network_t* const nn,
+                        prediction_workspace_t* const workspace,
+                        const real_t*           const inputs,
+                        real_t*                 const outputs,
+                        const size_t                  count)
+{
+  if (count > workspace->batch_size)
+    putserr_and_exit("Cannot predict more samples at once than the prediction workspace batch size.");
+
+  const size_t num_weight_layers = nn->config_size - 1;
+  const real_t* layer_inputs = inputs;
+  size_t layer, i;
+  for (layer = 0; layer < num_weight_layers; ++layer)
+  {
+    // The last layer is written straight into the outputs.
+    real_t* const layer_outputs =
+      layer == num_weight_layers - 1 ? outputs : workspace->_layer_outputs[layer % 2];
+    compute_neural_network_layer_sums(nn, layer, layer_inputs, layer_outputs, count);
+    const size_t n = count * nn->config[layer + 1];
+    if (workspace->_activation_array_function != NULL)
+    {
+      (*(workspace->_activation_array_function)) (layer_outputs, layer_outputs, n);
+    }
+    else
+    {
+      for (i = 0; i < n; ++i)
+      {
+        layer_outputs[i] = (*(workspace->_activation_function)) (layer_outputs[i]);
+      }
+    }
+    layer_inputs = layer_outputs;
+  }
+}
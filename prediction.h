@@ -0,0 +1,75 @@
+/*!
+  \file prediction.h
+  \brief Runs trained neural networks forward, without a training_t instance.
+  \author Hellyna Ng (hellyna@hellyna.com)
+  */
+#ifndef PREDICTION_H_9A3C6E21_47D8_4B15_8F0E_C2D61B7A5E94
+#define PREDICTION_H_9A3C6E21_47D8_4B15_8F0E_C2D61B7A5E94
+
+#include "neural-network.h"
+#include "activation-functions.h"
+
+/*!
+  The prediction_workspace_t \b struct.
+
+  The scratch memory for predict_neural_network(). A workspace belongs to one caller
+  at a time, but any number of workspaces can be used concurrently with the same
+  neural_network_t instance, which predict_neural_network() never modifies.
+  */
+struct prediction_workspace_t
+{
+  /*!
+    The maximum number of samples that can be predicted in one call.
+    */
+  size_t                      batch_size;
+  double                      (*_activation_function) (const double);
+  activation_array_function_t _activation_array_function;
+  real_t*                     _layer_outputs[2];
+};
+
+typedef struct prediction_workspace_t prediction_workspace_t;
+
+/*!
+  Constructs and allocates memory for a new prediction_workspace_t instance.
+
+  It only holds the activations of two layers, since earlier layers are not needed
+  once the next one has been computed.
+
+  \param nn the neural_network_t instance to derive the layer sizes from.
+  \param activation_function the activation function the network was trained with,
+         from those defined in activation-functions.h.
+  \param batch_size the maximum number of samples predicted in one call, at least 1.
+  \return a new prediction_workspace_t instance.
+  */
+prediction_workspace_t*
+construct_prediction_workspace (const neural_network_t* const nn,
+                                double                        (*activation_function) (const double),
+                                const size_t                  batch_size);
+
+/*!
+  Destructs and frees memory for a prediction_workspace_t instance.
+  \param workspace the prediction_workspace_t instance to free and destruct.
+  */
+void
+destruct_prediction_workspace (prediction_workspace_t* workspace);
+
+/*!
+  Feeds samples forward through a neural network.
+
+  The outputs are bitwise identical to those computed by train_neural_network()
+  for the same weights and activation function.
+
+  \param nn the neural_network_t instance, which is only read.
+  \param workspace a prediction_workspace_t instance constructed for \b nn, used by this call only.
+  \param inputs the row-major count x config[0] inputs.
+  \param outputs the row-major count x config[config_size - 1] outputs to write.
+  \param count the number of samples, at most the workspace batch size.
+  */
+void
+predict_neural_network (const neural_network_t* const nn,
+                        prediction_workspace_t* const workspace,
+                        const real_t*           const inputs,
+                        real_t*                 const outputs,
+                        const size_t                  count);
+
+#endif
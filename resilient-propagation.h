@@ -35,6 +35,11 @@
   The minimum double value considered as zero.
   */
 #define RPROP_ZERO_TOLERANCE      0.00000000000000001
+/*!
+  The number of weights updated at a time by one thread of resilient_propagation_loop().
+  Networks with fewer weights are updated by the calling thread alone.
+  */
+#define RPROP_BLOCK_SIZE          16384
 
 /*!
   Data used by this resilient propagation implementation.
@@ -42,8 +47,8 @@
 struct resilient_propagation_data_t
 {
   double           _previous_error;
-  double***        _previous_weight_changes;
-  double***        _update_values;
+  real_t*          _previous_weight_changes;
+  real_t*          _update_values;
 };
 
 typedef struct resilient_propagation_data_t resilient_propagation_data_t;
@@ -65,8 +70,36 @@ void
 destruct_resilient_propagation_data (resilient_propagation_data_t* data,
                                      const neural_network_t*       nn);
 
+/*!
+  Saves a resilient_propagation_data_t instance to a checkpoint, as the
+  training_checkpoint_function_t given to set_training_checkpoint().
+  \param fp the checkpoint file to write to.
+  \param resilient_propagation_data the \b void pointer to the resilient_propagation_data_t instance.
+  \param nn the associated neural_network_t instance.
+  */
+void
+save_resilient_propagation_data (FILE*                   fp,
+                                 void*                   resilient_propagation_data,
+                                 const neural_network_t* nn);
+
+/*!
+  Loads a resilient_propagation_data_t instance from a checkpoint, as the
+  training_checkpoint_function_t given to resume_training_from_checkpoint().
+  \param fp the checkpoint file to read from.
+  \param resilient_propagation_data the \b void pointer to the resilient_propagation_data_t instance.
+  \param nn the associated neural_network_t instance.
+  */
+void
+load_resilient_propagation_data (FILE*                   fp,
+                                 void*                   resilient_propagation_data,
+                                 const neural_network_t* nn);
+
 /*!
   The main resilient propagation loop to be inserted as a parameter in train_neural_network()
+
+  The weights and their update data are updated as flat arrays by the irprop_plus kernel
+  of get_simd_kernels(), in blocks of \b RPROP_BLOCK_SIZE weights spread over the
+  threads of the training_t instance.
   \param resilient_propagation_data the \b void pointer to the resilient_propagation_data_t instance.
   \param nn the associated neural_network_t instance to perform the loop on.
   \param training the associated training_t instance to perform the loop on.
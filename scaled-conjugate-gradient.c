@@ -0,0 +1,232 @@
+#include <string.h>
+#include <math.h>
+
+#include "util/util.h"
+
+#include "scaled-conjugate-gradient.h"
+
+scaled_conjugate_gradient_data_t*
+construct_scaled_conjugate_gradient_data (const neural_network_t* nn,
+                                          const training_set_t*   ts)
+{
+  // MALLOC: data
+  scaled_conjugate_gradient_data_t* data = malloc_exit_if_null(sizeof(scaled_conjugate_gradient_data_t));
+
+  // INIT: data->_ts, data->_is_started, data->_is_success, data->_num_iterations, data->_lambda
+  data->_ts = ts;
+  data->_is_started = false;
+  data->_is_success = true;
+  data->_num_iterations = 0;
+  data->_lambda = SCG_INITIAL_LAMBDA;
+
+  // INIT: data->_error, data->_mu, data->_kappa, data->_theta, data->_sigma, data->_alpha
+  data->_error = 0.0;
+  data->_mu = 0.0;
+  data->_kappa = 0.0;
+  data->_theta = 0.0;
+  data->_sigma = 0.0;
+  data->_alpha = 0.0;
+
+  // MALLOC: data->_gradients, data->_directions
+  // INIT: data->_gradients, data->_directions
+  data->_gradients = construct_neural_network_gradient_buffer(nn);
+  data->_directions = construct_neural_network_gradient_buffer(nn);
+
+  // MALLOC: data->_weights
+  // INIT: data->_weights
+  data->_weights = construct_neural_network_weight_buffer(nn);
+
+  return data;
+}
+
+void
+destruct_scaled_conjugate_gradient_data (scaled_conjugate_gradient_data_t* data,
+                                         const neural_network_t*           nn)
+{
+  (void) nn;
+  // FREE: data->_weights
+  destruct_neural_network_weight_buffer(data->_weights);
+
+  // FREE: data->_directions, data->_gradients
+  destruct_neural_network_weight_buffer(data->_directions);
+  destruct_neural_network_weight_buffer(data->_gradients);
+
+  // FREE: data
+  free_and_null(data);
+}
+
+static double
+_dot (const double* a,
+      const double* b,
+      const size_t  n)
+{
+  double sum = 0.0;
+  size_t i;
+  for (i = 0; i < n; ++i)
+  {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+
+/*
+  Moves the weights to the kept weights plus \b scale times the search direction.
+  */
+static void
+_move_weights (const scaled_conjugate_gradient_data_t* data,
+               const neural_network_t*                 nn,
+               const double                            scale)
+{
+  size_t wi;
+  for (wi = 0; wi < nn->weights_size; ++wi)
+  {
+    nn->weights[wi] = data->_weights[wi] + scale * data->_directions[wi];
+  }
+}
+
+/*
+  Updates the search direction with the gradients the epoch has computed at the weights
+  the last step moved to.
+  */
+static void
+_update_directions (scaled_conjugate_gradient_data_t* data,
+                    const neural_network_t*           nn,
+                    const training_t*                 training)
+{
+  ++data->_num_iterations;
+  // Restarts the search direction every as many iterations as there are weights.
+  if (data->_num_iterations % nn->weights_size == 0)
+  {
+    memcpy(data->_directions, training->gradients, nn->weights_size * sizeof(double));
+  }
+  else
+  {
+    const double beta = (_dot(training->gradients, training->gradients, nn->weights_size)
+                         - _dot(training->gradients, data->_gradients, nn->weights_size)) / data->_mu;
+    size_t wi;
+    for (wi = 0; wi < nn->weights_size; ++wi)
+    {
+      data->_directions[wi] = beta * data->_directions[wi] + training->gradients[wi];
+    }
+  }
+  memcpy(data->_gradients, training->gradients, nn->weights_size * sizeof(double));
+}
+
+/*
+  Approximates the second derivative along the search direction from the gradients a
+  little way along it, and puts the kept weights back. Returns false if the gradients are
+  zero, so that there is nowhere to go.
+  */
+static bool
+_approximate_second_derivative (scaled_conjugate_gradient_data_t* data,
+                                const neural_network_t*           nn,
+                                const training_t*                 training)
+{
+  data->_mu = _dot(data->_directions, data->_gradients, nn->weights_size);
+  // Restarts from the gradients if the search direction does not go downhill.
+  if (data->_mu <= 0.0)
+  {
+    memcpy(data->_directions, data->_gradients, nn->weights_size * sizeof(double));
+    data->_mu = _dot(data->_directions, data->_gradients, nn->weights_size);
+  }
+  data->_kappa = _dot(data->_directions, data->_directions, nn->weights_size);
+  if (data->_kappa == 0.0)
+    return false;
+
+  data->_sigma = SCG_SIGMA / sqrt(data->_kappa);
+  _move_weights(data, nn, data->_sigma);
+  compute_training_gradients(training, nn, data->_ts);
+  memcpy(nn->weights, data->_weights, nn->weights_size * sizeof(real_t));
+
+  // The gradients point downhill, so their change along the direction is minus the second derivative.
+  data->_theta = 0.0;
+  size_t wi;
+  for (wi = 0; wi < nn->weights_size; ++wi)
+  {
+    data->_theta += data->_directions[wi] * (data->_gradients[wi] - training->gradients[wi]);
+  }
+  data->_theta /= data->_sigma;
+  return true;
+}
+
+/*
+  Computes the step along the search direction from the approximated second derivative,
+  raising the trust region scale until the model is positive definite, and evaluates its
+  end. The step is kept if it does not raise the error, and the weights are put back
+  otherwise. The trust region is then adapted to how well the quadratic model predicted
+  the error. Returns whether the step is kept.
+  */
+static bool
+_take_step (scaled_conjugate_gradient_data_t* data,
+            const neural_network_t*           nn,
+            const training_t*                 training)
+{
+  double delta = data->_theta + data->_lambda * data->_kappa;
+  if (delta <= 0.0)
+  {
+    delta = data->_lambda * data->_kappa;
+    data->_lambda -= data->_theta / data->_kappa;
+  }
+  data->_alpha = data->_mu / delta;
+  _move_weights(data, nn, data->_alpha);
+  compute_training_gradients(training, nn, data->_ts);
+
+  const double error = calculate_error(training->error_data, SUM_OF_SQUARES);
+  const double comparison = 2.0 * (data->_error - error) / (data->_alpha * data->_mu);
+  const bool is_success = comparison >= 0.0;
+  if (is_success)
+  {
+    data->_error = error;
+    memcpy(data->_weights, nn->weights, nn->weights_size * sizeof(real_t));
+  }
+  else
+  {
+    memcpy(nn->weights, data->_weights, nn->weights_size * sizeof(real_t));
+  }
+
+  // An error that is not a number widens the trust region too.
+  if (!(comparison >= 0.25))
+    data->_lambda = fmin(4.0 * data->_lambda, SCG_LAMBDA_MAX);
+  else if (comparison > 0.75)
+    data->_lambda = fmax(0.5 * data->_lambda, SCG_LAMBDA_MIN);
+
+  return is_success;
+}
+
+void
+scaled_conjugate_gradient_loop (void*                    scaled_conjugate_gradient_data,
+                                const neural_network_t*  nn,
+                                const training_t*        training)
+{
+  scaled_conjugate_gradient_data_t* const data = (scaled_conjugate_gradient_data_t*) scaled_conjugate_gradient_data;
+  if (!data->_is_started)
+  {
+    data->_error = calculate_error(training->error_data, SUM_OF_SQUARES);
+    memcpy(data->_weights, nn->weights, nn->weights_size * sizeof(real_t));
+    memcpy(data->_gradients, training->gradients, nn->weights_size * sizeof(double));
+    memcpy(data->_directions, training->gradients, nn->weights_size * sizeof(double));
+    data->_is_started = true;
+  }
+  else if (data->_is_success)
+  {
+    _update_directions(data, nn, training);
+  }
+
+  // After a step that was not kept, the previous second derivative is reused.
+  if (data->_is_success && !_approximate_second_derivative(data, nn, training))
+  {
+    // There is nowhere to go: the next epoch starts over.
+    data->_is_started = false;
+    memset(training->gradients, 0, nn->weights_size * sizeof(double));
+    return;
+  }
+
+  // Shrinks the step until it is kept, or the trust region cannot grow any more.
+  do
+  {
+    data->_is_success = _take_step(data, nn, training);
+  }
+  while (!data->_is_success && data->_lambda < SCG_LAMBDA_MAX);
+
+  memset(training->gradients, 0, nn->weights_size * sizeof(double));
+}
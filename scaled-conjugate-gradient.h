@@ -0,0 +1,98 @@
+/*!
+  \file scaled-conjugate-gradient.h
+  \brief Møller's scaled conjugate gradient algorithm, for full-batch training.
+  \author Hellyna Ng (hellyna@hellyna.com)
+  */
+
+#ifndef SCALED_CONJUGATE_GRADIENT_H_9BC22E81_1D7C_44AF_8994_9C52B9946860
+#define SCALED_CONJUGATE_GRADIENT_H_9BC22E81_1D7C_44AF_8994_9C52B9946860
+
+#include <stdbool.h>
+
+#include "neural-network.h"
+#include "training-set.h"
+#include "training.h"
+
+/*!
+  The length of the step along the search direction used to approximate the second
+  derivative, divided by the length of the search direction.
+  */
+#define SCG_SIGMA                 1e-4
+/*!
+  The initial scale of the model trust region.
+  */
+#define SCG_INITIAL_LAMBDA        1e-6
+/*!
+  The minimum scale of the model trust region.
+  */
+#define SCG_LAMBDA_MIN            1e-15
+/*!
+  The maximum scale of the model trust region.
+  */
+#define SCG_LAMBDA_MAX            1e100
+
+/*!
+  Data used by this scaled conjugate gradient implementation.
+  */
+struct scaled_conjugate_gradient_data_t
+{
+  const training_set_t* _ts;
+  bool             _is_started;
+  bool             _is_success;
+  size_t           _num_iterations;
+  double           _lambda;
+  double           _error;
+  double           _mu;
+  double           _kappa;
+  double           _theta;
+  double           _sigma;
+  double           _alpha;
+  double*          _gradients;
+  double*          _directions;
+  real_t*          _weights;
+};
+
+typedef struct scaled_conjugate_gradient_data_t scaled_conjugate_gradient_data_t;
+
+/*!
+  Constructs a scaled_conjugate_gradient_data_t instance, recursively allocating the memory for it.
+  \param nn the associated neural_network_t instance to get data essential to the construction from.
+  \param ts the training set the neural network is trained on, which the steps are evaluated on.
+  \return a new scaled_conjugate_gradient_data_t instance.
+  */
+scaled_conjugate_gradient_data_t*
+construct_scaled_conjugate_gradient_data (const neural_network_t* nn,
+                                          const training_set_t*   ts);
+
+/*!
+  Destructs and recursively free a scaled_conjugate_gradient_data_t instance.
+  \param data the scaled_conjugate_gradient_data_t instance to free and destruct.
+  \param nn the associated neural_network_t instance to get data essential to the destruction from.
+  */
+void
+destruct_scaled_conjugate_gradient_data (scaled_conjugate_gradient_data_t* data,
+                                         const neural_network_t*           nn);
+
+/*!
+  The scaled conjugate gradient loop to be inserted as a parameter in train_neural_network().
+
+  Every epoch is one iteration, which also needs the gradients at two other points: a
+  little way along the search direction, to approximate the second derivative along it,
+  and at the end of the step. The loop computes them itself with
+  compute_training_gradients(), and keeps the step only if it does not raise the error,
+  taking it again with a larger trust region otherwise. An iteration therefore takes at
+  least three passes over the training set, but the weights are always those the error of
+  the epoch was computed at, and the error never rises from one epoch to the next. Besides
+  the weights, it keeps two \b double and one \b real_t buffers laid out like them, and has
+  no parameter to tune.
+
+  \param scaled_conjugate_gradient_data the \b void pointer to the scaled_conjugate_gradient_data_t instance.
+  \param nn the associated neural_network_t instance to perform the loop on.
+  \param training the associated training_t instance to perform the loop on.
+  */
+void
+scaled_conjugate_gradient_loop (void*                    scaled_conjugate_gradient_data,
+                                const neural_network_t*  nn,
+                                const training_t*        training);
+
+#endif
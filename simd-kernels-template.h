@@ -0,0 +1,504 @@
+/*!
+  \file simd-kernels-template.h
+  \brief The vector kernels, written once against the SIMD_* macros and included by
+         simd-kernels.c once per instruction set.
+
+  Before including this file, simd-kernels.c defines, for both \b float and \b double:
+  - \b SIMD_ISA: the instruction set token, appended to every function name.
+  - \b SIMD_ISA_NAME: the instruction set name, as a string.
+  - \b SIMD_FLOAT_WIDTH, \b SIMD_DOUBLE_WIDTH: the number of elements in a vector.
+  - \b simd_float, \b simd_double: the vector types.
+  - \b simd_float_load, \b simd_float_store, \b simd_float_set1, \b simd_float_zero,
+    \b simd_float_add, \b simd_float_sub, \b simd_float_mul, \b simd_float_div,
+    \b simd_float_abs, \b simd_float_min, \b simd_float_max, \b simd_float_fmadd and
+    \b simd_float_reduce, and their \b double counterparts: the unaligned vector operations.
+  - \b simd_float_pow2n, \b simd_double_pow2n: 2^n, from n + FAST_EXP_ROUND_MAGIC.
+  - \b simd_double_load_float: loads \b SIMD_DOUBLE_WIDTH floats, widened to doubles.
+  - \b simd_double_store_float: stores \b SIMD_DOUBLE_WIDTH doubles, rounded to floats.
+  - \b simd_double_select_less(a, b, x, y): x where a < b and y elsewhere, lane by lane.
+  - \b SIMD_FLOAT_SCALAR_FMADD, \b SIMD_DOUBLE_SCALAR_FMADD: the scalar multiply-adds
+    matching the vector ones, used for tails.
+
+  This file maps the \b simd_real_* names onto the precision selected by precision.h,
+  and undefines all of the above when done. There is intentionally no include guard.
+  */
+
+#ifdef CANN_SINGLE_PRECISION
+  #define SIMD_REAL_WIDTH         SIMD_FLOAT_WIDTH
+  #define simd_real               simd_float
+  #define simd_real_load          simd_float_load
+  #define simd_real_store         simd_float_store
+  #define simd_real_set1          simd_float_set1
+  #define simd_real_zero          simd_float_zero
+  #define simd_real_add           simd_float_add
+  #define simd_real_sub           simd_float_sub
+  #define simd_real_mul           simd_float_mul
+  #define simd_real_div           simd_float_div
+  #define simd_real_abs           simd_float_abs
+  #define simd_real_min           simd_float_min
+  #define simd_real_max           simd_float_max
+  #define simd_real_pow2n         simd_float_pow2n
+  #define simd_real_fmadd         simd_float_fmadd
+  #define simd_real_reduce        simd_float_reduce
+  #define SIMD_REAL_SCALAR_FMADD  SIMD_FLOAT_SCALAR_FMADD
+  #define simd_double_load_real   simd_double_load_float
+  #define simd_double_store_real  simd_double_store_float
+#else
+  #define SIMD_REAL_WIDTH         SIMD_DOUBLE_WIDTH
+  #define simd_real               simd_double
+  #define simd_real_load          simd_double_load
+  #define simd_real_store         simd_double_store
+  #define simd_real_set1          simd_double_set1
+  #define simd_real_zero          simd_double_zero
+  #define simd_real_add           simd_double_add
+  #define simd_real_sub           simd_double_sub
+  #define simd_real_mul           simd_double_mul
+  #define simd_real_div           simd_double_div
+  #define simd_real_abs           simd_double_abs
+  #define simd_real_min           simd_double_min
+  #define simd_real_max           simd_double_max
+  #define simd_real_pow2n         simd_double_pow2n
+  #define simd_real_fmadd         simd_double_fmadd
+  #define simd_real_reduce        simd_double_reduce
+  #define SIMD_REAL_SCALAR_FMADD  SIMD_DOUBLE_SCALAR_FMADD
+  #define simd_double_load_real   simd_double_load
+  #define simd_double_store_real  simd_double_store
+#endif
+
+#define SIMD_CONCAT_(name, isa) name##_##isa
+#define SIMD_CONCAT(name, isa) SIMD_CONCAT_(name, isa)
+#define SIMD_FUNCTION(name) SIMD_CONCAT(name, SIMD_ISA)
+
+static double
+SIMD_FUNCTION(dot) (const real_t* const x,
+                    const real_t* const y,
+                    const size_t        n)
+{
+  // Four independent accumulators hide the latency of the multiply-adds.
+  simd_real sum0 = simd_real_zero(),
+            sum1 = simd_real_zero(),
+            sum2 = simd_real_zero(),
+            sum3 = simd_real_zero();
+  size_t i = 0;
+  for (; i + 4 * SIMD_REAL_WIDTH <= n; i += 4 * SIMD_REAL_WIDTH)
+  {
+    sum0 = simd_real_fmadd(simd_real_load(x + i), simd_real_load(y + i), sum0);
+    sum1 = simd_real_fmadd(simd_real_load(x + i + SIMD_REAL_WIDTH), simd_real_load(y + i + SIMD_REAL_WIDTH), sum1);
+    sum2 = simd_real_fmadd(simd_real_load(x + i + 2 * SIMD_REAL_WIDTH), simd_real_load(y + i + 2 * SIMD_REAL_WIDTH), sum2);
+    sum3 = simd_real_fmadd(simd_real_load(x + i + 3 * SIMD_REAL_WIDTH), simd_real_load(y + i + 3 * SIMD_REAL_WIDTH), sum3);
+  }
+  for (; i + SIMD_REAL_WIDTH <= n; i += SIMD_REAL_WIDTH)
+  {
+    sum0 = simd_real_fmadd(simd_real_load(x + i), simd_real_load(y + i), sum0);
+  }
+
+  real_t sum = simd_real_reduce(simd_real_add(simd_real_add(sum0, sum1), simd_real_add(sum2, sum3)));
+  for (; i < n; ++i)
+  {
+    sum = SIMD_REAL_SCALAR_FMADD(x[i], y[i], sum);
+  }
+  return sum;
+}
+
+static void
+SIMD_FUNCTION(axpy) (const real_t        a,
+                     const real_t* const x,
+                     real_t*       const y,
+                     const size_t        n)
+{
+  const simd_real va = simd_real_set1(a);
+  size_t i = 0;
+  for (; i + 2 * SIMD_REAL_WIDTH <= n; i += 2 * SIMD_REAL_WIDTH)
+  {
+    simd_real_store(y + i, simd_real_fmadd(va, simd_real_load(x + i), simd_real_load(y + i)));
+    simd_real_store(y + i + SIMD_REAL_WIDTH,
+                    simd_real_fmadd(va, simd_real_load(x + i + SIMD_REAL_WIDTH), simd_real_load(y + i + SIMD_REAL_WIDTH)));
+  }
+  for (; i + SIMD_REAL_WIDTH <= n; i += SIMD_REAL_WIDTH)
+  {
+    simd_real_store(y + i, simd_real_fmadd(va, simd_real_load(x + i), simd_real_load(y + i)));
+  }
+  for (; i < n; ++i)
+  {
+    y[i] = SIMD_REAL_SCALAR_FMADD(a, x[i], y[i]);
+  }
+}
+
+static void
+SIMD_FUNCTION(outer_product_accumulate) (const real_t* const x,
+                                         const size_t        m,
+                                         const real_t* const y,
+                                         const size_t        n,
+                                         double*       const a)
+{
+  size_t i, j;
+  for (i = 0; i < m; ++i)
+  {
+    const double xi = x[i];
+    const simd_double vxi = simd_double_set1(xi);
+    double* const row = a + i * n;
+    for (j = 0; j + SIMD_DOUBLE_WIDTH <= n; j += SIMD_DOUBLE_WIDTH)
+    {
+      simd_double_store(row + j, simd_double_fmadd(vxi, simd_double_load_real(y + j), simd_double_load(row + j)));
+    }
+    for (; j < n; ++j)
+    {
+      row[j] = SIMD_DOUBLE_SCALAR_FMADD(xi, (double) y[j], row[j]);
+    }
+  }
+}
+
+static void
+SIMD_FUNCTION(batch_outer_product_accumulate) (const real_t* const x,
+                                               const size_t        x_stride,
+                                               const size_t        m,
+                                               const real_t* const y,
+                                               const size_t        y_stride,
+                                               const size_t        n,
+                                               const size_t        batch_size,
+                                               double*       const a)
+{
+  // Every block of a is kept in registers for the whole batch, and still
+  // receives the products in batch order, like outer_product_accumulate() would.
+  size_t i, j, b;
+  for (i = 0; i < m; ++i)
+  {
+    double* const row = a + i * n;
+    for (j = 0; j + 4 * SIMD_DOUBLE_WIDTH <= n; j += 4 * SIMD_DOUBLE_WIDTH)
+    {
+      simd_double sum0 = simd_double_load(row + j),
+                  sum1 = simd_double_load(row + j + SIMD_DOUBLE_WIDTH),
+                  sum2 = simd_double_load(row + j + 2 * SIMD_DOUBLE_WIDTH),
+                  sum3 = simd_double_load(row + j + 3 * SIMD_DOUBLE_WIDTH);
+      for (b = 0; b < batch_size; ++b)
+      {
+        const simd_double xb = simd_double_set1(x[b * x_stride + i]);
+        const real_t* const yb = y + b * y_stride + j;
+        sum0 = simd_double_fmadd(xb, simd_double_load_real(yb), sum0);
+        sum1 = simd_double_fmadd(xb, simd_double_load_real(yb + SIMD_DOUBLE_WIDTH), sum1);
+        sum2 = simd_double_fmadd(xb, simd_double_load_real(yb + 2 * SIMD_DOUBLE_WIDTH), sum2);
+        sum3 = simd_double_fmadd(xb, simd_double_load_real(yb + 3 * SIMD_DOUBLE_WIDTH), sum3);
+      }
+      simd_double_store(row + j, sum0);
+      simd_double_store(row + j + SIMD_DOUBLE_WIDTH, sum1);
+      simd_double_store(row + j + 2 * SIMD_DOUBLE_WIDTH, sum2);
+      simd_double_store(row + j + 3 * SIMD_DOUBLE_WIDTH, sum3);
+    }
+    for (; j + SIMD_DOUBLE_WIDTH <= n; j += SIMD_DOUBLE_WIDTH)
+    {
+      simd_double sum = simd_double_load(row + j);
+      for (b = 0; b < batch_size; ++b)
+      {
+        sum = simd_double_fmadd(simd_double_set1(x[b * x_stride + i]),
+                                simd_double_load_real(y + b * y_stride + j), sum);
+      }
+      simd_double_store(row + j, sum);
+    }
+    for (; j < n; ++j)
+    {
+      double sum = row[j];
+      for (b = 0; b < batch_size; ++b)
+      {
+        sum = SIMD_DOUBLE_SCALAR_FMADD((double) x[b * x_stride + i], (double) y[b * y_stride + j], sum);
+      }
+      row[j] = sum;
+    }
+  }
+}
+
+static void
+SIMD_FUNCTION(elliott) (const real_t* const x,
+                        real_t*       const y,
+                        const size_t        n,
+                        const real_t        scale,
+                        const real_t        offset)
+{
+  const simd_real vslope = simd_real_set1(ELLIOTT_SLOPE),
+                  vscale = simd_real_set1(scale),
+                  voffset = simd_real_set1(offset),
+                  vone = simd_real_set1(1.0);
+  size_t i = 0;
+  for (; i + SIMD_REAL_WIDTH <= n; i += SIMD_REAL_WIDTH)
+  {
+    const simd_real t = simd_real_mul(simd_real_load(x + i), vslope);
+    simd_real_store(y + i, simd_real_add(simd_real_div(simd_real_mul(vscale, t),
+                                                       simd_real_add(vone, simd_real_abs(t))), voffset));
+  }
+  for (; i < n; ++i)
+  {
+    const real_t t = x[i] * (real_t) ELLIOTT_SLOPE;
+    y[i] = (scale * t) / ((real_t) 1.0 + (t < 0 ? -t : t)) + offset;
+  }
+}
+
+static void
+SIMD_FUNCTION(elliott_derivative) (const real_t* const x,
+                                   real_t*       const d,
+                                   const size_t        n,
+                                   const real_t        scale)
+{
+  const simd_real vslope = simd_real_set1(ELLIOTT_SLOPE),
+                  vscale = simd_real_set1(scale),
+                  vone = simd_real_set1(1.0);
+  size_t i = 0;
+  for (; i + SIMD_REAL_WIDTH <= n; i += SIMD_REAL_WIDTH)
+  {
+    const simd_real t = simd_real_add(vone, simd_real_abs(simd_real_mul(simd_real_load(x + i), vslope)));
+    simd_real_store(d + i, simd_real_div(vslope, simd_real_mul(simd_real_mul(vscale, t), t)));
+  }
+  for (; i < n; ++i)
+  {
+    const real_t u = x[i] * (real_t) ELLIOTT_SLOPE;
+    const real_t t = (real_t) 1.0 + (u < 0 ? -u : u);
+    d[i] = (real_t) ELLIOTT_SLOPE / (scale * t * t);
+  }
+}
+
+static void
+SIMD_FUNCTION(sigmoid_derivative) (const real_t* const y,
+                                   real_t*       const d,
+                                   const size_t        n)
+{
+  const simd_real vone = simd_real_set1(1.0);
+  size_t i = 0;
+  for (; i + SIMD_REAL_WIDTH <= n; i += SIMD_REAL_WIDTH)
+  {
+    const simd_real v = simd_real_load(y + i);
+    simd_real_store(d + i, simd_real_mul(v, simd_real_sub(vone, v)));
+  }
+  for (; i < n; ++i)
+  {
+    d[i] = y[i] * ((real_t) 1.0 - y[i]);
+  }
+}
+
+static void
+SIMD_FUNCTION(tanh_derivative) (const real_t* const y,
+                                real_t*       const d,
+                                const size_t        n)
+{
+  const simd_real vone = simd_real_set1(1.0);
+  size_t i = 0;
+  for (; i + SIMD_REAL_WIDTH <= n; i += SIMD_REAL_WIDTH)
+  {
+    const simd_real v = simd_real_load(y + i);
+    simd_real_store(d + i, simd_real_sub(vone, simd_real_mul(v, v)));
+  }
+  for (; i < n; ++i)
+  {
+    d[i] = (real_t) 1.0 - y[i] * y[i];
+  }
+}
+
+static inline simd_real
+SIMD_FUNCTION(fast_exp) (simd_real x)
+{
+  x = simd_real_min(simd_real_max(x, simd_real_set1(FAST_EXP_MIN)), simd_real_set1(FAST_EXP_MAX));
+  const simd_real magic = simd_real_set1(FAST_EXP_ROUND_MAGIC);
+  const simd_real t = simd_real_add(simd_real_mul(x, simd_real_set1(FAST_EXP_LOG2E)), magic);
+  const simd_real n = simd_real_sub(t, magic);
+  simd_real r = simd_real_fmadd(n, simd_real_set1(-FAST_EXP_LN2_HIGH), x);
+  r = simd_real_fmadd(n, simd_real_set1(-FAST_EXP_LN2_LOW), r);
+
+  simd_real p = simd_real_set1(fast_exp_coefficients[FAST_EXP_DEGREE]);
+  int k;
+  for (k = FAST_EXP_DEGREE; k > 0; --k)
+  {
+    p = simd_real_fmadd(p, r, simd_real_set1(fast_exp_coefficients[k - 1]));
+  }
+  return simd_real_mul(p, simd_real_pow2n(t));
+}
+
+static inline simd_real
+SIMD_FUNCTION(fast_sigmoid_vector) (const simd_real x)
+{
+  const simd_real vone = simd_real_set1(1.0);
+  return simd_real_div(vone, simd_real_add(vone, SIMD_FUNCTION(fast_exp)(simd_real_sub(simd_real_zero(), x))));
+}
+
+static inline simd_real
+SIMD_FUNCTION(fast_tanh_vector) (const simd_real x)
+{
+  const simd_real vone = simd_real_set1(1.0);
+  const simd_real e = SIMD_FUNCTION(fast_exp)(simd_real_add(x, x));
+  return simd_real_sub(vone, simd_real_div(simd_real_set1(2.0), simd_real_add(e, vone)));
+}
+
+/*
+  The tails are computed in a zero-padded vector, so that every element gets the same
+  result wherever it is in the array.
+  */
+#define SIMD_MAP_VECTOR_FUNCTION(vector_function, x, y, n)                \
+  do                                                                      \
+  {                                                                       \
+    size_t i = 0;                                                         \
+    for (; i + SIMD_REAL_WIDTH <= (n); i += SIMD_REAL_WIDTH)              \
+    {                                                                     \
+      simd_real_store((y) + i, vector_function(simd_real_load((x) + i))); \
+    }                                                                     \
+    if (i < (n))                                                          \
+    {                                                                     \
+      real_t buffer[SIMD_REAL_WIDTH] = { 0 };                             \
+      memcpy(buffer, (x) + i, ((n) - i) * sizeof(real_t));                \
+      simd_real_store(buffer, vector_function(simd_real_load(buffer)));   \
+      memcpy((y) + i, buffer, ((n) - i) * sizeof(real_t));                \
+    }                                                                     \
+  } while (0)
+
+static void
+SIMD_FUNCTION(fast_sigmoid) (const real_t* const x,
+                             real_t*       const y,
+                             const size_t        n)
+{
+  SIMD_MAP_VECTOR_FUNCTION(SIMD_FUNCTION(fast_sigmoid_vector), x, y, n);
+}
+
+static void
+SIMD_FUNCTION(fast_tanh) (const real_t* const x,
+                          real_t*       const y,
+                          const size_t        n)
+{
+  SIMD_MAP_VECTOR_FUNCTION(SIMD_FUNCTION(fast_tanh_vector), x, y, n);
+}
+
+/*
+  The sign of \b x, 0 within RPROP_ZERO_TOLERANCE of 0, with the same comparisons as the
+  scalar _rprop_sign(), so that NaN gives -1 in both.
+  */
+static inline simd_double
+SIMD_FUNCTION(rprop_sign) (const simd_double x)
+{
+  const simd_double vzero = simd_double_zero();
+  return simd_double_select_less(simd_double_abs(x), simd_double_set1(RPROP_ZERO_TOLERANCE), vzero,
+                                 simd_double_select_less(vzero, x, simd_double_set1(1.0), simd_double_set1(-1.0)));
+}
+
+static void
+SIMD_FUNCTION(irprop_plus) (double* const gradients,
+                            double* const previous_gradients,
+                            real_t* const update_values,
+                            real_t* const previous_weight_changes,
+                            real_t* const weights,
+                            const size_t  n,
+                            const bool    is_error_increasing)
+{
+  // The three cases of the scalar update are computed for every lane and selected
+  // by the sign of the gradient change: above 0.5, below -0.5, or 0 in between.
+  const simd_double vzero = simd_double_zero();
+  const simd_double vhalf = simd_double_set1(0.5);
+  const simd_double vminus_half = simd_double_set1(-0.5);
+  const simd_double vminus_one = simd_double_set1(-1.0);
+  const simd_double vincrease = simd_double_set1(RPROP_CHANGE_IF_POSITIVE);
+  const simd_double vdecrease = simd_double_set1(RPROP_CHANGE_IF_NEGATIVE);
+  const simd_double vdelta_max = simd_double_set1(RPROP_DELTA_MAX);
+  const simd_double vdelta_min = simd_double_set1(RPROP_DELTA_MIN);
+  size_t i;
+  for (i = 0; i + SIMD_DOUBLE_WIDTH <= n; i += SIMD_DOUBLE_WIDTH)
+  {
+    const simd_double gradient = simd_double_load(gradients + i);
+    const simd_double update_value = simd_double_load_real(update_values + i);
+    const simd_double gradient_change = SIMD_FUNCTION(rprop_sign)(simd_double_mul(gradient, simd_double_load(previous_gradients + i)));
+
+    const simd_double increased = simd_double_min(simd_double_mul(update_value, vincrease), vdelta_max);
+    const simd_double decreased = simd_double_max(simd_double_mul(update_value, vdecrease), vdelta_min);
+    const simd_double delta = simd_double_select_less(vhalf, gradient_change, increased,
+                                                      simd_double_select_less(gradient_change, vminus_half, decreased, update_value));
+    const simd_double reverted = is_error_increasing
+                                 ? simd_double_mul(vminus_one, simd_double_load_real(previous_weight_changes + i))
+                                 : vzero;
+    const simd_double weight_change = simd_double_select_less(gradient_change, vminus_half, reverted,
+                                                              simd_double_mul(SIMD_FUNCTION(rprop_sign)(gradient), delta));
+
+    simd_double_store_real(update_values + i, delta);
+    simd_double_store(previous_gradients + i, simd_double_select_less(gradient_change, vminus_half, vzero, gradient));
+    simd_double_store_real(previous_weight_changes + i, weight_change);
+    simd_double_store_real(weights + i, simd_double_add(simd_double_load_real(weights + i), weight_change));
+    simd_double_store(gradients + i, vzero);
+  }
+  for (; i < n; ++i)
+  {
+    _irprop_plus_update(gradients, previous_gradients, update_values, previous_weight_changes,
+                        weights, i, is_error_increasing);
+  }
+}
+
+static const simd_kernels_t SIMD_FUNCTION(simd_kernels) =
+{
+  SIMD_ISA_NAME,
+  &SIMD_FUNCTION(dot),
+  &SIMD_FUNCTION(axpy),
+  &SIMD_FUNCTION(outer_product_accumulate),
+  &SIMD_FUNCTION(batch_outer_product_accumulate),
+  &SIMD_FUNCTION(elliott),
+  &SIMD_FUNCTION(elliott_derivative),
+  &SIMD_FUNCTION(sigmoid_derivative),
+  &SIMD_FUNCTION(tanh_derivative),
+  &SIMD_FUNCTION(fast_sigmoid),
+  &SIMD_FUNCTION(fast_tanh),
+  &SIMD_FUNCTION(irprop_plus)
+};
+
+#undef SIMD_MAP_VECTOR_FUNCTION
+#undef SIMD_FUNCTION
+#undef SIMD_CONCAT
+#undef SIMD_CONCAT_
+
+#undef SIMD_REAL_WIDTH
+#undef simd_real
+#undef simd_real_load
+#undef simd_real_store
+#undef simd_real_set1
+#undef simd_real_zero
+#undef simd_real_add
+#undef simd_real_sub
+#undef simd_real_mul
+#undef simd_real_div
+#undef simd_real_abs
+#undef simd_real_min
+#undef simd_real_max
+#undef simd_real_fmadd
+#undef simd_real_reduce
+#undef simd_real_pow2n
+#undef SIMD_REAL_SCALAR_FMADD
+#undef simd_double_load_real
+#undef simd_double_store_real
+
+#undef SIMD_ISA
+#undef SIMD_ISA_NAME
+#undef SIMD_FLOAT_WIDTH
+#undef simd_float
+#undef simd_float_load
+#undef simd_float_store
+#undef simd_float_set1
+#undef simd_float_zero
+#undef simd_float_add
+#undef simd_float_sub
+#undef simd_float_mul
+#undef simd_float_div
+#undef simd_float_abs
+#undef simd_float_min
+#undef simd_float_max
+#undef simd_float_fmadd
+#undef simd_float_reduce
+#undef SIMD_FLOAT_SCALAR_FMADD
+#undef simd_float_pow2n
+#undef SIMD_DOUBLE_WIDTH
+#undef simd_double
+#undef simd_double_load
+#undef simd_double_store
+#undef simd_double_set1
+#undef simd_double_zero
+#undef simd_double_add
+#undef simd_double_sub
+#undef simd_double_mul
+#undef simd_double_div
+#undef simd_double_abs
+#undef simd_double_min
+#undef simd_double_max
+#undef simd_double_fmadd
+#undef simd_double_reduce
+#undef simd_double_load_float
+#undef simd_double_store_float
+#undef simd_double_select_less
+#undef SIMD_DOUBLE_SCALAR_FMADD
+#undef simd_double_pow2n
@@ -0,0 +1,501 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "util/util.h"
+
+#include "activation-functions.h"
+#include "resilient-propagation.h"
+#include "simd-kernels.h"
+
+/*
+  The approximation of exp(x) used by the fast_* activation kernels:
+  exp(x) = 2^n * exp(r), where n = round(x * log2(e)) and r = x - n * ln(2), with ln(2)
+  split in two parts (Cody and Waite) so that n * FAST_EXP_LN2_HIGH is exact. exp(r) is
+  the Taylor polynomial of degree FAST_EXP_DEGREE, as |r| <= ln(2) / 2. Adding
+  FAST_EXP_ROUND_MAGIC rounds to an integer and leaves n in the low mantissa bits,
+  from which simd_*_pow2n() build 2^n directly.
+  */
+#ifdef CANN_SINGLE_PRECISION
+  #define FAST_EXP_DEGREE       6
+  #define FAST_EXP_MIN          -87.0f
+  #define FAST_EXP_MAX          88.0f
+  #define FAST_EXP_ROUND_MAGIC  12582912.0f
+  #define FAST_EXP_LN2_HIGH     0.693359375f
+  #define FAST_EXP_LN2_LOW      -2.12194440e-4f
+#else
+  #define FAST_EXP_DEGREE       12
+  #define FAST_EXP_MIN          -708.0
+  #define FAST_EXP_MAX          709.0
+  #define FAST_EXP_ROUND_MAGIC  6755399441055744.0
+  #define FAST_EXP_LN2_HIGH     6.93145751953125e-1
+  #define FAST_EXP_LN2_LOW      1.42860682030941723212e-6
+#endif
+#define FAST_EXP_LOG2E          1.44269504088896340736
+
+static const real_t fast_exp_coefficients[] =
+{
+  1.0, 1.0, 1.0 / 2, 1.0 / 6, 1.0 / 24, 1.0 / 120, 1.0 / 720, 1.0 / 5040, 1.0 / 40320,
+  1.0 / 362880, 1.0 / 3628800, 1.0 / 39916800, 1.0 / 479001600
+};
+
+static double
+dot_scalar (const real_t* const x,
+            const real_t* const y,
+            const size_t        n)
+{
+  // The sum is kept in double, so the single-precision build does not lose bits in long rows.
+  double sum = 0.0;
+  size_t i;
+  for (i = 0; i < n; ++i)
+  {
+    sum += (double) x[i] * (double) y[i];
+  }
+  return sum;
+}
+
+static void
+axpy_scalar (const real_t        a,
+             const real_t* const x,
+             real_t*       const y,
+             const size_t        n)
+{
+  size_t i;
+  for (i = 0; i < n; ++i)
+  {
+    y[i] += a * x[i];
+  }
+}
+
+static void
+outer_product_accumulate_scalar (const real_t* const x,
+                                 const size_t        m,
+                                 const real_t* const y,
+                                 const size_t        n,
+                                 double*       const a)
+{
+  size_t i, j;
+  for (i = 0; i < m; ++i)
+  {
+    const double xi = x[i];
+    double* const row = a + i * n;
+    for (j = 0; j < n; ++j)
+    {
+      row[j] += xi * (double) y[j];
+    }
+  }
+}
+
+static void
+batch_outer_product_accumulate_scalar (const real_t* const x,
+                                       const size_t        x_stride,
+                                       const size_t        m,
+                                       const real_t* const y,
+                                       const size_t        y_stride,
+                                       const size_t        n,
+                                       const size_t        batch_size,
+                                       double*       const a)
+{
+  size_t b;
+  for (b = 0; b < batch_size; ++b)
+  {
+    outer_product_accumulate_scalar(x + b * x_stride, m, y + b * y_stride, n, a);
+  }
+}
+
+static void
+elliott_scalar (const real_t* const x,
+                real_t*       const y,
+                const size_t        n,
+                const real_t        scale,
+                const real_t        offset)
+{
+  size_t i;
+  for (i = 0; i < n; ++i)
+  {
+    const real_t t = x[i] * (real_t) ELLIOTT_SLOPE;
+    y[i] = (scale * t) / ((real_t) 1.0 + (t < 0 ? -t : t)) + offset;
+  }
+}
+
+static void
+elliott_derivative_scalar (const real_t* const x,
+                           real_t*       const d,
+                           const size_t        n,
+                           const real_t        scale)
+{
+  size_t i;
+  for (i = 0; i < n; ++i)
+  {
+    const real_t u = x[i] * (real_t) ELLIOTT_SLOPE;
+    const real_t t = (real_t) 1.0 + (u < 0 ? -u : u);
+    d[i] = (real_t) ELLIOTT_SLOPE / (scale * t * t);
+  }
+}
+
+static void
+sigmoid_derivative_scalar (const real_t* const y,
+                           real_t*       const d,
+                           const size_t        n)
+{
+  size_t i;
+  for (i = 0; i < n; ++i)
+  {
+    d[i] = y[i] * ((real_t) 1.0 - y[i]);
+  }
+}
+
+static void
+tanh_derivative_scalar (const real_t* const y,
+                        real_t*       const d,
+                        const size_t        n)
+{
+  size_t i;
+  for (i = 0; i < n; ++i)
+  {
+    d[i] = (real_t) 1.0 - y[i] * y[i];
+  }
+}
+
+// Without vectors, the polynomial is no faster than libm, so the scalar kernels use it.
+static void
+fast_sigmoid_scalar (const real_t* const x,
+                     real_t*       const y,
+                     const size_t        n)
+{
+  size_t i;
+  for (i = 0; i < n; ++i)
+  {
+    y[i] = 1.0 / (1.0 + exp(-1.0 * x[i]));
+  }
+}
+
+static void
+fast_tanh_scalar (const real_t* const x,
+                  real_t*       const y,
+                  const size_t        n)
+{
+  size_t i;
+  for (i = 0; i < n; ++i)
+  {
+    y[i] = tanh(x[i]);
+  }
+}
+
+static inline double
+_rprop_sign (const double x)
+{
+  if (fabs(x) < RPROP_ZERO_TOLERANCE)
+    return 0.0;
+  else if (x > 0)
+    return 1.0;
+  else
+    return -1.0;
+}
+
+/*
+  Updates weight \b i, see simd_kernels_t::irprop_plus. The vector kernels use it for tails.
+  */
+static inline void
+_irprop_plus_update (double* const gradients,
+                     double* const previous_gradients,
+                     real_t* const update_values,
+                     real_t* const previous_weight_changes,
+                     real_t* const weights,
+                     const size_t  i,
+                     const bool    is_error_increasing)
+{
+  double weight_change = 0.0, delta;
+  const double gradient_change = _rprop_sign(gradients[i] * previous_gradients[i]);
+  if (gradient_change > 0)
+  {
+    delta = fmin(update_values[i] * RPROP_CHANGE_IF_POSITIVE, RPROP_DELTA_MAX);
+    weight_change = _rprop_sign(gradients[i]) * delta;
+    previous_gradients[i] = gradients[i];
+  }
+  else if (gradient_change < 0)
+  {
+    delta = fmax(update_values[i] * RPROP_CHANGE_IF_NEGATIVE, RPROP_DELTA_MIN);
+    if (is_error_increasing)
+      weight_change = -(previous_weight_changes[i]);
+
+    previous_gradients[i] = 0.0;
+  }
+  else
+  {
+    delta = update_values[i];
+    weight_change = _rprop_sign(gradients[i]) * delta;
+    previous_gradients[i] = gradients[i];
+  }
+
+  update_values[i] = delta;
+  previous_weight_changes[i] = weight_change;
+  weights[i] += weight_change;
+  gradients[i] = 0.0;
+}
+
+static void
+irprop_plus_scalar (double* const gradients,
+                    double* const previous_gradients,
+                    real_t* const update_values,
+                    real_t* const previous_weight_changes,
+                    real_t* const weights,
+                    const size_t  n,
+                    const bool    is_error_increasing)
+{
+  size_t i;
+  for (i = 0; i < n; ++i)
+  {
+    _irprop_plus_update(gradients, previous_gradients, update_values, previous_weight_changes,
+                        weights, i, is_error_increasing);
+  }
+}
+
+static const simd_kernels_t simd_kernels_scalar =
+{
+  "scalar",
+  &dot_scalar,
+  &axpy_scalar,
+  &outer_product_accumulate_scalar,
+  &batch_outer_product_accumulate_scalar,
+  &elliott_scalar,
+  &elliott_derivative_scalar,
+  &sigmoid_derivative_scalar,
+  &tanh_derivative_scalar,
+  &fast_sigmoid_scalar,
+  &fast_tanh_scalar,
+  &irprop_plus_scalar
+};
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_KERNELS_X86
+
+#include <immintrin.h>
+
+// SSE2
+#pragma GCC push_options
+#pragma GCC target("sse2")
+
+static inline double
+_reduce_sse2_pd (const __m128d v)
+{
+  return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v)));
+}
+
+static inline float
+_reduce_sse2_ps (const __m128 v)
+{
+  const __m128 pairs = _mm_add_ps(v, _mm_movehl_ps(v, v));
+  return _mm_cvtss_f32(_mm_add_ss(pairs, _mm_shuffle_ps(pairs, pairs, 1)));
+}
+
+static inline __m128d
+_select_less_sse2_pd (const __m128d a,
+                      const __m128d b,
+                      const __m128d x,
+                      const __m128d y)
+{
+  const __m128d mask = _mm_cmplt_pd(a, b);
+  return _mm_or_pd(_mm_and_pd(mask, x), _mm_andnot_pd(mask, y));
+}
+
+#define SIMD_ISA                        sse2
+#define SIMD_ISA_NAME                   "sse2"
+#define SIMD_FLOAT_WIDTH                4
+#define simd_float                      __m128
+#define simd_float_load                 _mm_loadu_ps
+#define simd_float_store                _mm_storeu_ps
+#define simd_float_set1                 _mm_set1_ps
+#define simd_float_zero                 _mm_setzero_ps
+#define simd_float_add                  _mm_add_ps
+#define simd_float_sub                  _mm_sub_ps
+#define simd_float_mul                  _mm_mul_ps
+#define simd_float_div                  _mm_div_ps
+#define simd_float_abs(a)               _mm_andnot_ps(_mm_set1_ps(-0.0f), (a))
+#define simd_float_min                  _mm_min_ps
+#define simd_float_max                  _mm_max_ps
+#define simd_float_fmadd(a, b, c)       _mm_add_ps(_mm_mul_ps((a), (b)), (c))
+#define simd_float_reduce               _reduce_sse2_ps
+#define SIMD_FLOAT_SCALAR_FMADD(a, b, c) ((a) * (b) + (c))
+#define simd_float_pow2n(t)             _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_castps_si128(t), _mm_set1_epi32(127)), 23))
+#define SIMD_DOUBLE_WIDTH               2
+#define simd_double                     __m128d
+#define simd_double_load                _mm_loadu_pd
+#define simd_double_store               _mm_storeu_pd
+#define simd_double_set1                _mm_set1_pd
+#define simd_double_zero                _mm_setzero_pd
+#define simd_double_add                 _mm_add_pd
+#define simd_double_sub                 _mm_sub_pd
+#define simd_double_mul                 _mm_mul_pd
+#define simd_double_div                 _mm_div_pd
+#define simd_double_abs(a)              _mm_andnot_pd(_mm_set1_pd(-0.0), (a))
+#define simd_double_min                 _mm_min_pd
+#define simd_double_max                 _mm_max_pd
+#define simd_double_fmadd(a, b, c)      _mm_add_pd(_mm_mul_pd((a), (b)), (c))
+#define simd_double_reduce              _reduce_sse2_pd
+#define simd_double_load_float(p)       _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64((const __m128i*) (p))))
+#define simd_double_store_float(p, a)   _mm_storel_pi((__m64*) (p), _mm_cvtpd_ps(a))
+#define simd_double_select_less         _select_less_sse2_pd
+#define SIMD_DOUBLE_SCALAR_FMADD(a, b, c) ((a) * (b) + (c))
+#define simd_double_pow2n(t)            _mm_castsi128_pd(_mm_slli_epi64(_mm_add_epi64(_mm_castpd_si128(t), _mm_set1_epi64x(1023)), 52))
+#include "simd-kernels-template.h"
+
+#pragma GCC pop_options
+
+// AVX2 + FMA
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+
+static inline double
+_reduce_avx2_pd (const __m256d v)
+{
+  return _reduce_sse2_pd(_mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1)));
+}
+
+static inline float
+_reduce_avx2_ps (const __m256 v)
+{
+  return _reduce_sse2_ps(_mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1)));
+}
+
+#define SIMD_ISA                        avx2
+#define SIMD_ISA_NAME                   "avx2"
+#define SIMD_FLOAT_WIDTH                8
+#define simd_float                      __m256
+#define simd_float_load                 _mm256_loadu_ps
+#define simd_float_store                _mm256_storeu_ps
+#define simd_float_set1                 _mm256_set1_ps
+#define simd_float_zero                 _mm256_setzero_ps
+#define simd_float_add                  _mm256_add_ps
+#define simd_float_sub                  _mm256_sub_ps
+#define simd_float_mul                  _mm256_mul_ps
+#define simd_float_div                  _mm256_div_ps
+#define simd_float_abs(a)               _mm256_andnot_ps(_mm256_set1_ps(-0.0f), (a))
+#define simd_float_min                  _mm256_min_ps
+#define simd_float_max                  _mm256_max_ps
+#define simd_float_fmadd                _mm256_fmadd_ps
+#define simd_float_reduce               _reduce_avx2_ps
+#define SIMD_FLOAT_SCALAR_FMADD(a, b, c) _mm_cvtss_f32(_mm_fmadd_ss(_mm_set_ss(a), _mm_set_ss(b), _mm_set_ss(c)))
+#define simd_float_pow2n(t)             _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(_mm256_castps_si256(t), _mm256_set1_epi32(127)), 23))
+#define SIMD_DOUBLE_WIDTH               4
+#define simd_double                     __m256d
+#define simd_double_load                _mm256_loadu_pd
+#define simd_double_store               _mm256_storeu_pd
+#define simd_double_set1                _mm256_set1_pd
+#define simd_double_zero                _mm256_setzero_pd
+#define simd_double_add                 _mm256_add_pd
+#define simd_double_sub                 _mm256_sub_pd
+#define simd_double_mul                 _mm256_mul_pd
+#define simd_double_div                 _mm256_div_pd
+#define simd_double_abs(a)              _mm256_andnot_pd(_mm256_set1_pd(-0.0), (a))
+#define simd_double_min                 _mm256_min_pd
+#define simd_double_max                 _mm256_max_pd
+#define simd_double_fmadd               _mm256_fmadd_pd
+#define simd_double_reduce              _reduce_avx2_pd
+#define simd_double_load_float(p)       _mm256_cvtps_pd(_mm_loadu_ps(p))
+#define simd_double_store_float(p, a)   _mm_storeu_ps((p), _mm256_cvtpd_ps(a))
+#define simd_double_select_less(a, b, x, y) _mm256_blendv_pd((y), (x), _mm256_cmp_pd((a), (b), _CMP_LT_OQ))
+#define SIMD_DOUBLE_SCALAR_FMADD(a, b, c) _mm_cvtsd_f64(_mm_fmadd_sd(_mm_set_sd(a), _mm_set_sd(b), _mm_set_sd(c)))
+#define simd_double_pow2n(t)            _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_add_epi64(_mm256_castpd_si256(t), _mm256_set1_epi64x(1023)), 52))
+#include "simd-kernels-template.h"
+
+#pragma GCC pop_options
+
+// AVX-512F
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx2,fma")
+
+#define SIMD_ISA                        avx512
+#define SIMD_ISA_NAME                   "avx512"
+#define SIMD_FLOAT_WIDTH                16
+#define simd_float                      __m512
+#define simd_float_load                 _mm512_loadu_ps
+#define simd_float_store                _mm512_storeu_ps
+#define simd_float_set1                 _mm512_set1_ps
+#define simd_float_zero                 _mm512_setzero_ps
+#define simd_float_add                  _mm512_add_ps
+#define simd_float_sub                  _mm512_sub_ps
+#define simd_float_mul                  _mm512_mul_ps
+#define simd_float_div                  _mm512_div_ps
+#define simd_float_abs                  _mm512_abs_ps
+#define simd_float_min                  _mm512_min_ps
+#define simd_float_max                  _mm512_max_ps
+#define simd_float_fmadd                _mm512_fmadd_ps
+#define simd_float_reduce               _mm512_reduce_add_ps
+#define SIMD_FLOAT_SCALAR_FMADD(a, b, c) _mm_cvtss_f32(_mm_fmadd_ss(_mm_set_ss(a), _mm_set_ss(b), _mm_set_ss(c)))
+#define simd_float_pow2n(t)             _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_add_epi32(_mm512_castps_si512(t), _mm512_set1_epi32(127)), 23))
+#define SIMD_DOUBLE_WIDTH               8
+#define simd_double                     __m512d
+#define simd_double_load                _mm512_loadu_pd
+#define simd_double_store               _mm512_storeu_pd
+#define simd_double_set1                _mm512_set1_pd
+#define simd_double_zero                _mm512_setzero_pd
+#define simd_double_add                 _mm512_add_pd
+#define simd_double_sub                 _mm512_sub_pd
+#define simd_double_mul                 _mm512_mul_pd
+#define simd_double_div                 _mm512_div_pd
+#define simd_double_abs                 _mm512_abs_pd
+#define simd_double_min                 _mm512_min_pd
+#define simd_double_max                 _mm512_max_pd
+#define simd_double_fmadd               _mm512_fmadd_pd
+#define simd_double_reduce              _mm512_reduce_add_pd
+#define simd_double_load_float(p)       _mm512_cvtps_pd(_mm256_loadu_ps(p))
+#define simd_double_store_float(p, a)   _mm256_storeu_ps((p), _mm512_cvtpd_ps(a))
+#define simd_double_select_less(a, b, x, y) _mm512_mask_blend_pd(_mm512_cmp_pd_mask((a), (b), _CMP_LT_OQ), (y), (x))
+#define SIMD_DOUBLE_SCALAR_FMADD(a, b, c) _mm_cvtsd_f64(_mm_fmadd_sd(_mm_set_sd(a), _mm_set_sd(b), _mm_set_sd(c)))
+#define simd_double_pow2n(t)            _mm512_castsi512_pd(_mm512_slli_epi64(_mm512_add_epi64(_mm512_castpd_si512(t), _mm512_set1_epi64(1023)), 52))
+#include "simd-kernels-template.h"
+
+#pragma GCC pop_options
+#endif
+
+static const simd_kernels_t* selected_simd_kernels = NULL;
+
+static const simd_kernels_t*
+_select_simd_kernels ()
+{
+  // Ordered from the most to the least preferred.
+  const simd_kernels_t* supported[4];
+  size_t num_supported = 0;
+#ifdef SIMD_KERNELS_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))
+    supported[num_supported++] = &simd_kernels_avx512;
+
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    supported[num_supported++] = &simd_kernels_avx2;
+
+  supported[num_supported++] = &simd_kernels_sse2;
+#endif
+  supported[num_supported++] = &simd_kernels_scalar;
+
+  const char* const requested = getenv(SIMD_KERNELS_ENVIRONMENT_VARIABLE);
+  if (requested != NULL)
+  {
+    size_t i;
+    for (i = 0; i < num_supported; ++i)
+    {
+      if (strcmp(supported[i]->name, requested) == 0)
+        return supported[i];
+    }
+    printferr("%s=%s is not supported by this processor, using %s instead.\n",
+              SIMD_KERNELS_ENVIRONMENT_VARIABLE, requested, supported[0]->name);
+  }
+
+  return supported[0];
+}
+
+__attribute__((constructor)) static void
+_initialize_simd_kernels ()
+{
+  selected_simd_kernels = _select_simd_kernels();
+}
+
+const simd_kernels_t*
+get_simd_kernels ()
+{
+  if (selected_simd_kernels == NULL)
+    selected_simd_kernels = _select_simd_kernels();
+
+  return selected_simd_kernels;
+}
@@ -0,0 +1,149 @@
+/*!
+  \file simd-kernels.h
+  \brief Runtime-dispatched vector kernels used by the training and inference loops.
+  \author Hellyna Ng (hellyna@hellyna.com)
+  */
+#ifndef SIMD_KERNELS_H_5B0E7C1A_3F2D_4C8E_A6B1_9D4E2F7A8C30
+#define SIMD_KERNELS_H_5B0E7C1A_3F2D_4C8E_A6B1_9D4E2F7A8C30
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "precision.h"
+
+/*!
+  The environment variable that can force a specific kernel set.
+
+  Its value is one of the simd_kernels_t::name values, eg. \b CANN_SIMD=sse2.
+  A kernel set that the processor does not support is never selected.
+  */
+#define SIMD_KERNELS_ENVIRONMENT_VARIABLE "CANN_SIMD"
+
+/*!
+  The simd_kernels_t \b struct.
+
+  A table of kernels compiled for one instruction set. The best table supported by
+  the processor is selected once at startup, see get_simd_kernels().
+
+  Results may differ in the last bits between tables, because the vector kernels
+  sum in a different order and may use fused multiply-add, but a given table always
+  produces the same results for the same inputs.
+  */
+struct simd_kernels_t
+{
+  /*!
+    The name of the instruction set: "avx512", "avx2", "sse2" or "scalar".
+    */
+  const char* name;
+  /*!
+    Computes the dot product of \b x and \b y, both of length \b n.
+    */
+  double      (*dot) (const real_t* const x,
+                      const real_t* const y,
+                      const size_t        n);
+  /*!
+    Computes y[i] += a * x[i] for i from 0 to \b n - 1.
+    */
+  void        (*axpy) (const real_t        a,
+                       const real_t* const x,
+                       real_t*       const y,
+                       const size_t        n);
+  /*!
+    Computes a[i * n + j] += x[i] * y[j] for i from 0 to \b m - 1 and j from 0 to \b n - 1,
+    ie. accumulates the outer product of \b x and \b y into the row-major \b m x \b n matrix \b a.
+    The products and the sums are computed in double precision.
+    */
+  void        (*outer_product_accumulate) (const real_t* const x,
+                                           const size_t        m,
+                                           const real_t* const y,
+                                           const size_t        n,
+                                           double*       const a);
+  /*!
+    Accumulates the outer products of \b batch_size pairs of vectors into the row-major
+    \b m x \b n matrix \b a: pair \b b is x[b * x_stride] to x[b * x_stride + m - 1] and
+    y[b * y_stride] to y[b * y_stride + n - 1].
+
+    The result is bitwise identical to calling outer_product_accumulate() for every pair in
+    order, but every block of \b a stays in registers for the whole batch.
+    */
+  void        (*batch_outer_product_accumulate) (const real_t* const x,
+                                                 const size_t        x_stride,
+                                                 const size_t        m,
+                                                 const real_t* const y,
+                                                 const size_t        y_stride,
+                                                 const size_t        n,
+                                                 const size_t        batch_size,
+                                                 double*       const a);
+  /*!
+    Computes y[i] = scale * t / (1 + |t|) + offset, where t = x[i] * ELLIOTT_SLOPE, for i from 0 to \b n - 1.
+    A \b scale and \b offset of 0.5 give elliott_activation(), 1 and 0 give elliott_symmetric_activation().
+    */
+  void        (*elliott) (const real_t* const x,
+                          real_t*       const y,
+                          const size_t        n,
+                          const real_t        scale,
+                          const real_t        offset);
+  /*!
+    Computes d[i] = ELLIOTT_SLOPE / (scale * t * t), where t = 1 + |x[i] * ELLIOTT_SLOPE|, for i from 0 to \b n - 1.
+    A \b scale of 2 gives elliott_derivative(), 1 gives elliott_symmetric_derivative().
+    */
+  void        (*elliott_derivative) (const real_t* const x,
+                                     real_t*       const d,
+                                     const size_t        n,
+                                     const real_t        scale);
+  /*!
+    Computes d[i] = y[i] * (1 - y[i]) for i from 0 to \b n - 1, ie. sigmoid_derivative() of the activated values \b y.
+    */
+  void        (*sigmoid_derivative) (const real_t* const y,
+                                     real_t*       const d,
+                                     const size_t        n);
+  /*!
+    Computes d[i] = 1 - y[i] * y[i] for i from 0 to \b n - 1, ie. tanh_derivative() of the activated values \b y.
+    */
+  void        (*tanh_derivative) (const real_t* const y,
+                                  real_t*       const d,
+                                  const size_t        n);
+  /*!
+    Computes y[i] = 1 / (1 + exp(-x[i])) for i from 0 to \b n - 1, with a polynomial
+    approximation of exp(). See fast_sigmoid_activation() for its accuracy.
+    */
+  void        (*fast_sigmoid) (const real_t* const x,
+                               real_t*       const y,
+                               const size_t        n);
+  /*!
+    Computes y[i] = 1 - 2 / (exp(2 * x[i]) + 1) = tanh(x[i]) for i from 0 to \b n - 1, with a
+    polynomial approximation of exp(). See fast_tanh_activation() for its accuracy.
+    */
+  void        (*fast_tanh) (const real_t* const x,
+                            real_t*       const y,
+                            const size_t        n);
+  /*!
+    Runs one iRPROP+ step over \b n weights, see resilient_propagation_loop(): updates
+    \b update_values, \b previous_gradients, \b previous_weight_changes and \b weights from
+    \b gradients, then clears \b gradients. \b is_error_increasing reverts the previous
+    change of the weights whose gradient changed sign. The results are bitwise identical
+    for every table.
+    */
+  void        (*irprop_plus) (double* const gradients,
+                              double* const previous_gradients,
+                              real_t* const update_values,
+                              real_t* const previous_weight_changes,
+                              real_t* const weights,
+                              const size_t  n,
+                              const bool    is_error_increasing);
+};
+
+typedef struct simd_kernels_t simd_kernels_t;
+
+/*!
+  Gets the kernel table selected for this processor.
+
+  The selection happens once, using CPUID, and can be lowered with the
+  \b SIMD_KERNELS_ENVIRONMENT_VARIABLE environment variable.
+
+  \return the selected simd_kernels_t table.
+  */
+const simd_kernels_t*
+get_simd_kernels ();
+
+#endif
@@ -0,0 +1,101 @@
+#include "util/util.h"
+#include "util/thread-pool.h"
+
+#include "stochastic-gradient-descent.h"
+
+stochastic_gradient_descent_data_t*
+construct_stochastic_gradient_descent_data (const neural_network_t* nn,
+                                            const double            learning_rate,
+                                            const double            momentum,
+                                            const bool              is_nesterov)
+{
+  // MALLOC: data
+  stochastic_gradient_descent_data_t* data =
+    malloc_exit_if_null(sizeof(stochastic_gradient_descent_data_t));
+
+  // INIT: data->learning_rate, data->momentum, data->is_nesterov
+  data->learning_rate = learning_rate;
+  data->momentum = momentum;
+  data->is_nesterov = is_nesterov;
+
+  // MALLOC: data->_velocities
+  // INIT: data->_velocities
+  data->_velocities = construct_neural_network_weight_buffer(nn);
+
+  return data;
+}
+
+void
+destruct_stochastic_gradient_descent_data (stochastic_gradient_descent_data_t* data,
+                                           const neural_network_t*             nn)
+{
+  (void) nn;
+  // FREE: data->_velocities
+  destruct_neural_network_weight_buffer(data->_velocities);
+
+  // FREE: data
+  free_and_null(data);
+}
+
+/*
+  The arguments of the parallel loop of stochastic_gradient_descent_loop().
+  */
+struct stochastic_gradient_descent_step_t
+{
+  const stochastic_gradient_descent_data_t* data;
+  const neural_network_t*                   nn;
+  const training_t*                         training;
+};
+
+typedef struct stochastic_gradient_descent_step_t stochastic_gradient_descent_step_t;
+
+static void
+_update_weights (void*        step_data,
+                 const size_t begin,
+                 const size_t end,
+                 const size_t slot)
+{
+  (void) slot;
+  const stochastic_gradient_descent_step_t* const step = (const stochastic_gradient_descent_step_t*) step_data;
+  const double learning_rate = step->data->learning_rate;
+  const double momentum = step->data->momentum;
+  double* const gradients = step->training->gradients;
+  real_t* const velocities = step->data->_velocities;
+  real_t* const weights = step->nn->weights;
+  size_t wi;
+  if (step->data->is_nesterov)
+  {
+    for (wi = begin; wi < end; ++wi)
+    {
+      const double step_change = learning_rate * gradients[wi];
+      const double velocity = momentum * velocities[wi] + step_change;
+      velocities[wi] = velocity;
+      weights[wi] += momentum * velocity + step_change;
+      gradients[wi] = 0.0;
+    }
+  }
+  else
+  {
+    for (wi = begin; wi < end; ++wi)
+    {
+      const double velocity = momentum * velocities[wi] + learning_rate * gradients[wi];
+      velocities[wi] = velocity;
+      weights[wi] += velocity;
+      gradients[wi] = 0.0;
+    }
+  }
+}
+
+void
+stochastic_gradient_descent_loop (void*                    stochastic_gradient_descent_data,
+                                  const neural_network_t*  nn,
+                                  const training_t*        training)
+{
+  stochastic_gradient_descent_step_t step;
+  step.data = (const stochastic_gradient_descent_data_t*) stochastic_gradient_descent_data;
+  step.nn = nn;
+  step.training = training;
+
+  run_thread_pool_parallel_for(get_shared_thread_pool(), 0, nn->weights_size, SGD_BLOCK_SIZE,
+                               get_training_num_threads(training), &_update_weights, &step);
+}
@@ -0,0 +1,86 @@
+/*!
+  \file stochastic-gradient-descent.h
+  \brief Mini-batch stochastic gradient descent with classical or Nesterov momentum.
+  \author Hellyna Ng (hellyna@hellyna.com)
+  */
+
+#ifndef STOCHASTIC_GRADIENT_DESCENT_H_67955BEB_9ACA_4067_8EF7_B85A40D38307
+#define STOCHASTIC_GRADIENT_DESCENT_H_67955BEB_9ACA_4067_8EF7_B85A40D38307
+
+#include <stdbool.h>
+
+#include "neural-network.h"
+#include "training.h"
+
+/*!
+  The number of weights updated at a time by one thread of stochastic_gradient_descent_loop().
+  Networks with fewer weights are updated by the calling thread alone.
+  */
+#define SGD_BLOCK_SIZE            16384
+
+/*!
+  Data used by this stochastic gradient descent implementation.
+  */
+struct stochastic_gradient_descent_data_t
+{
+  /*!
+    The step taken along the summed gradients of a mini-batch.
+    */
+  double           learning_rate;
+  /*!
+    The fraction of the previous weight change carried into the next one, from 0 to below 1.
+    */
+  double           momentum;
+  /*!
+    Set this to true to use Nesterov momentum, which evaluates the step at the weights
+    the momentum is about to move to.
+    */
+  bool             is_nesterov;
+  real_t*          _velocities;
+};
+
+typedef struct stochastic_gradient_descent_data_t stochastic_gradient_descent_data_t;
+
+/*!
+  Constructs a stochastic_gradient_descent_data_t instance, recursively allocating the memory for it.
+  \param nn the associated neural_network_t instance to get data essential to the construction from.
+  \param learning_rate the step taken along the summed gradients of a mini-batch. As they are
+         sums, it scales with the mini-batch size, eg. 0.01 / mini_batch_size.
+  \param momentum the fraction of the previous weight change carried into the next one, eg. 0.9.
+  \param is_nesterov set this to true to use Nesterov momentum instead of classical momentum.
+  \return a new stochastic_gradient_descent_data_t instance.
+  */
+stochastic_gradient_descent_data_t*
+construct_stochastic_gradient_descent_data (const neural_network_t* nn,
+                                            const double            learning_rate,
+                                            const double            momentum,
+                                            const bool              is_nesterov);
+
+/*!
+  Destructs and recursively free a stochastic_gradient_descent_data_t instance.
+  \param data the stochastic_gradient_descent_data_t instance to free and destruct.
+  \param nn the associated neural_network_t instance to get data essential to the destruction from.
+  */
+void
+destruct_stochastic_gradient_descent_data (stochastic_gradient_descent_data_t* data,
+                                           const neural_network_t*             nn);
+
+/*!
+  The stochastic gradient descent loop to be inserted as a parameter in
+  train_neural_network_in_mini_batches(), or in train_neural_network() for full-batch
+  gradient descent.
+
+  With g the summed gradients (which point downhill) and v the velocity of a weight:
+  v = momentum * v + learning_rate * g, then the weight moves by v, or by
+  momentum * v + learning_rate * g with Nesterov momentum. The gradients are then cleared.
+
+  \param stochastic_gradient_descent_data the \b void pointer to the stochastic_gradient_descent_data_t instance.
+  \param nn the associated neural_network_t instance to perform the loop on.
+  \param training the associated training_t instance to perform the loop on.
+  */
+void
+stochastic_gradient_descent_loop (void*                    stochastic_gradient_descent_data,
+                                  const neural_network_t*  nn,
+                                  const training_t*        training);
+
+#endif
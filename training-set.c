@@ -2,118 +2,339 @@
 #include <float.h>
 
 #include "util/util.h"
+#include "util/thread-pool.h"
 #include "libcsv/csv.h"
-#include "validation.h"
 
 #include "training-set.h"
 
-training_set_t*
-construct_training_set (const char* const input_data_path,
-                        const char* const output_data_path)
+/*
+  The initial number of elements of the growable arrays of training_set_chunk_t.
+  */
+#define TRAINING_SET_INITIAL_CAPACITY 64
+
+/*
+  The lines of a chunk of a training set file, parsed straight into numbers as the parser
+  finds their entries, with the range of every column. The first chunk starts with the
+  descriptions, which are kept as strings.
+  */
+struct training_set_chunk_t
 {
-  // MALLOC: ts
-  training_set_t* ts = malloc_exit_if_null(sizeof(training_set_t));
+  bool    has_descs;
+  size_t  desc_count;
+  size_t  desc_capacity;
+  char**  descs;
+  // The number of entries of every line, which is that of the first one.
+  size_t  width;
+  size_t  line_count;
+  // The number of entries of the line being parsed.
+  size_t  line_entry_count;
+  size_t  value_count;
+  size_t  value_capacity;
+  real_t* values;
+  size_t  range_capacity;
+  double* min;
+  double* max;
+};
+
+typedef struct training_set_chunk_t training_set_chunk_t;
+
+/*
+  A training set file loaded by construct_training_set(), and the chunks it is split into.
+  */
+struct training_set_file_t
+{
+  const char*           path;
+  const csv_file_t*     file;
+  size_t*               chunk_offsets;
+  training_set_chunk_t* chunks;
+  char**                descs;
+  size_t                width;
+  size_t                line_count;
+  real_t*               values;
+  double*               min;
+  double*               max;
+};
+
+typedef struct training_set_file_t training_set_file_t;
+
+/*
+  Grows \b array to hold at least \b size elements of \b element_size bytes.
+  */
+static void*
+_reserve (void*        array,
+          size_t*      capacity,
+          const size_t size,
+          const size_t element_size)
+{
+  if (size <= *capacity)
+    return array;
 
-  csv_data_t* input_data = construct_csv_data(input_data_path);
-  csv_data_t* output_data = construct_csv_data(output_data_path);
+  while (*capacity < size)
+  {
+    *capacity *= 2;
+  }
+  return realloc_exit_if_null(array, *capacity * element_size);
+}
 
-  // INIT: ts->training_set_size
-  ts->training_set_size = validate_csv_io_data_line_count(input_data, output_data) - 1;
+/*
+  Empties \b size ranges, so that any value becomes both their minimum and maximum.
+  */
+static void
+_reset_ranges (double*      min,
+               double*      max,
+               const size_t size)
+{
+  size_t j;
+  for (j = 0; j < size; ++j)
+  {
+    min[j] = DBL_MAX;
+    max[j] = -DBL_MAX;
+  }
+}
 
-  // INIT: ts->input_size
-  ts->input_size = validate_csv_data_entry_counts(input_data);
+static void
+_add_training_set_entry (void* entry, size_t entry_length, void* training_set_chunk)
+{
+  training_set_chunk_t* const chunk = (training_set_chunk_t*) training_set_chunk;
+  if (chunk->has_descs)
+  {
+    // MALLOC: chunk->descs[chunk->desc_count]
+    chunk->descs = _reserve(chunk->descs, &chunk->desc_capacity, chunk->desc_count + 1, SIZEOF_PTR);
+    chunk->descs[chunk->desc_count] = malloc_exit_if_null(entry_length + 1);
+    // The parser appends a null character to every entry.
+    memcpy(chunk->descs[chunk->desc_count], entry, entry_length + 1);
+    ++chunk->desc_count;
+    return;
+  }
 
-  // INIT: ts->output_size
-  ts->output_size = validate_csv_data_entry_counts(output_data);
+  const size_t column = chunk->line_entry_count;
+  if (column >= chunk->range_capacity)
+  {
+    const size_t range_size = chunk->range_capacity;
+    size_t capacity = range_size;
+    chunk->min = _reserve(chunk->min, &capacity, column + 1, sizeof(double));
+    chunk->max = _reserve(chunk->max, &chunk->range_capacity, column + 1, sizeof(double));
+    _reset_ranges(chunk->min + range_size, chunk->max + range_size, chunk->range_capacity - range_size);
+  }
 
-  // MALLOC: ts->target_inputs
-  // INIT: ts->target_inputs
-  // MALLOC: ts->target_outputs
-  // INIT: ts->target_outputs
-  ts->target_inputs = malloc_exit_if_null(SIZEOF_PTR * ts->training_set_size);
-  ts->target_outputs = malloc_exit_if_null(SIZEOF_PTR * ts->training_set_size);
+  const real_t value = strtod((const char*) entry, NULL);
+  chunk->values = _reserve(chunk->values, &chunk->value_capacity, chunk->value_count + 1, sizeof(real_t));
+  chunk->values[chunk->value_count] = value;
+  ++chunk->value_count;
+  if (chunk->min[column] > value)
+    chunk->min[column] = value;
 
-  size_t i, j;
-  for (i = 0; i < ts->training_set_size; ++i)
+  if (chunk->max[column] < value)
+    chunk->max[column] = value;
+
+  ++chunk->line_entry_count;
+}
+
+static void
+_add_training_set_line (int delim, void* training_set_chunk)
+{
+  (void) delim;
+  training_set_chunk_t* const chunk = (training_set_chunk_t*) training_set_chunk;
+  if (chunk->has_descs)
   {
-    ts->target_inputs[i] = malloc_exit_if_null(ts->input_size * sizeof(double));
-    for (j = 0; j < ts->input_size; ++j)
-    {
-      ts->target_inputs[i][j] = strtod(input_data->data[i + 1][j], NULL);
-    }
+    chunk->has_descs = false;
+    chunk->width = chunk->desc_count;
+    return;
+  }
 
-    ts->target_outputs[i] = malloc_exit_if_null(ts->output_size * sizeof(double));
-    for (j = 0; j < ts->output_size; ++j)
+  if (chunk->line_count == 0 && chunk->width == 0)
+    chunk->width = chunk->line_entry_count;
+  else if (chunk->line_entry_count != chunk->width)
+    putserr_and_exit("Malformed csv data file.");
+
+  ++chunk->line_count;
+  chunk->line_entry_count = 0;
+}
+
+static void
+_parse_training_set_chunks (void*        data,
+                            const size_t begin,
+                            const size_t end,
+                            const size_t slot)
+{
+  (void) slot;
+  training_set_file_t* const file = (training_set_file_t*) data;
+  size_t i;
+  for (i = begin; i < end; ++i)
+  {
+    training_set_chunk_t* const chunk = &file->chunks[i];
+    // MALLOC: chunk->descs, chunk->values, chunk->min, chunk->max
+    chunk->has_descs = i == 0;
+    chunk->desc_count = 0;
+    chunk->desc_capacity = TRAINING_SET_INITIAL_CAPACITY;
+    chunk->descs = malloc_exit_if_null(chunk->desc_capacity * SIZEOF_PTR);
+    chunk->width = 0;
+    chunk->line_count = 0;
+    chunk->line_entry_count = 0;
+    chunk->value_count = 0;
+    chunk->value_capacity = TRAINING_SET_INITIAL_CAPACITY;
+    chunk->values = malloc_exit_if_null(chunk->value_capacity * sizeof(real_t));
+    chunk->range_capacity = TRAINING_SET_INITIAL_CAPACITY;
+    chunk->min = malloc_exit_if_null(chunk->range_capacity * sizeof(double));
+    chunk->max = malloc_exit_if_null(chunk->range_capacity * sizeof(double));
+    _reset_ranges(chunk->min, chunk->max, chunk->range_capacity);
+
+    csv_parser parser;
+    exit_if_not_zero(csv_init(&parser, CSV_STRICT | CSV_APPEND_NULL));
+    const size_t size = file->chunk_offsets[i + 1] - file->chunk_offsets[i];
+    if (csv_parse(&parser, file->file->contents + file->chunk_offsets[i], size,
+                  _add_training_set_entry, _add_training_set_line, chunk) != size
+        || csv_fini(&parser, _add_training_set_entry, _add_training_set_line, chunk) != 0)
     {
-      ts->target_outputs[i][j] = strtod(output_data->data[i + 1][j], NULL);
+      printferr_and_exit("Error while parsing file: %s\n", csv_strerror(csv_error(&parser)));
     }
+    csv_free(&parser);
   }
+}
 
-  // MALLOC: ts->input_entries_desc
-  // MALLOC: ts->input_entries_max
-  // MALLOC: ts->input_entries_min
-  size_t size = ts->input_size * SIZEOF_PTR;
-  ts->input_entries_desc = malloc_exit_if_null(size);
-  ts->input_entries_min = malloc_exit_if_null(ts->input_size * sizeof(double));
-  ts->input_entries_max = calloc_exit_if_null(ts->input_size, sizeof(double));
-  for (i = 0; i < ts->input_size; ++i)
+/*
+  Loads a training set file in chunks parsed by the threads of the pool, and joins their
+  values and ranges in order.
+  */
+static void
+_load_training_set_file (void* data)
+{
+  training_set_file_t* const file = (training_set_file_t*) data;
+  csv_file_t* const csv_file = construct_csv_file(file->path);
+  file->file = csv_file;
+
+  // MALLOC: file->chunk_offsets
+  const size_t max_chunks = get_csv_file_max_chunks(csv_file, 0);
+  file->chunk_offsets = malloc_exit_if_null((max_chunks + 1) * sizeof(size_t));
+  const size_t num_chunks = split_csv_file(csv_file, max_chunks, 0, file->chunk_offsets);
+
+  // MALLOC: file->chunks
+  file->chunks = malloc_exit_if_null(num_chunks * sizeof(training_set_chunk_t));
+  if (num_chunks > 1)
+    run_thread_pool_parallel_for(get_shared_thread_pool(), 0, num_chunks, 1, 0, &_parse_training_set_chunks, file);
+  else
+    _parse_training_set_chunks(file, 0, 1, 0);
+
+  training_set_chunk_t* const first_chunk = &file->chunks[0];
+  if (first_chunk->has_descs || first_chunk->desc_count == 0)
+    putserr_and_exit("Malformed csv data file.");
+
+  // INIT: file->descs, file->width, file->line_count
+  file->descs = first_chunk->descs;
+  file->width = first_chunk->desc_count;
+  file->line_count = 0;
+  size_t i, j;
+  for (i = 0; i < num_chunks; ++i)
   {
-    size = (strlen(input_data->data[0][i]) + 1) * sizeof(char);
-    ts->input_entries_desc[i] = malloc_exit_if_null(size);
-    strncpy(ts->input_entries_desc[i], input_data->data[0][i], strlen(input_data->data[0][i]));
-    ts->input_entries_min[i] = DBL_MAX;
+    if (file->chunks[i].line_count > 0 && file->chunks[i].width != file->width)
+      putserr_and_exit("Malformed csv data file.");
+
+    file->line_count += file->chunks[i].line_count;
   }
 
-  // MALLOC: ts->output_entries_desc
-  // MALLOC: ts->output_entries_max
-  // MALLOC: ts->output_entries_min
-  size = ts->output_size * SIZEOF_PTR;
-  ts->output_entries_desc = malloc_exit_if_null(size);
-  ts->output_entries_min = malloc_exit_if_null(ts->output_size * sizeof(double));
-  ts->output_entries_max = calloc_exit_if_null(ts->output_size, sizeof(double));
-  for (i = 0; i < ts->output_size; ++i)
+  // MALLOC: file->values, file->min, file->max
+  // INIT: file->values, file->min, file->max
+  file->min = malloc_exit_if_null(file->width * sizeof(double));
+  file->max = malloc_exit_if_null(file->width * sizeof(double));
+  _reset_ranges(file->min, file->max, file->width);
+  // The values of a single chunk are handed over.
+  if (num_chunks == 1)
+  {
+    file->values = first_chunk->values;
+    first_chunk->values = NULL;
+  }
+  else
   {
-    size = (strlen(output_data->data[0][i]) + 1) * sizeof(char);
-    ts->output_entries_desc[i] = malloc_exit_if_null(size);
-    strncpy(ts->output_entries_desc[i], output_data->data[0][i], strlen(output_data->data[0][i]));
-    ts->output_entries_min[i] = DBL_MAX;
+    file->values = malloc_exit_if_null((file->line_count > 0 ? file->line_count * file->width : 1) * sizeof(real_t));
   }
 
-  // INIT: ts->input_entries_min, ts->input_entries_max
-  for (j = 0; j < ts->input_size; ++j) {
-    for (i = 0; i < ts->training_set_size; ++i)
+  size_t value_count = 0;
+  for (i = 0; i < num_chunks; ++i)
+  {
+    training_set_chunk_t* const chunk = &file->chunks[i];
+    if (chunk->values != NULL)
+      memcpy(file->values + value_count, chunk->values, chunk->value_count * sizeof(real_t));
+    value_count += chunk->value_count;
+    for (j = 0; j < file->width && chunk->line_count > 0; ++j)
     {
-      size = ts->target_inputs[i][j];
-      if (ts->input_entries_min[j] > size)
-        ts->input_entries_min[j] = size;
+      if (file->min[j] > chunk->min[j])
+        file->min[j] = chunk->min[j];
 
-      if (ts->input_entries_max[j] < size)
-        ts->input_entries_max[j] = size;
+      if (file->max[j] < chunk->max[j])
+        file->max[j] = chunk->max[j];
     }
+
+    // FREE: chunk->descs but the first, chunk->values, chunk->min, chunk->max
+    if (i > 0)
+      free_and_null(chunk->descs);
+    free_and_null(chunk->values);
+    free_and_null(chunk->min);
+    free_and_null(chunk->max);
   }
 
-  // INIT: ts->output_entries_min, ts->output_entries_max
-  for (j = 0; j < ts->output_size; ++j) {
-    for (i = 0; i < ts->training_set_size; ++i)
-    {
-      size = ts->target_outputs[i][j];
-      if (ts->output_entries_min[j] > size)
-        ts->output_entries_min[j] = size;
+  // FREE: file->chunks, file->chunk_offsets
+  free_and_null(file->chunks);
+  free_and_null(file->chunk_offsets);
+  destruct_csv_file(csv_file);
+}
 
-      if (ts->output_entries_max[j] < size)
-        ts->output_entries_max[j] = size;
-    }
+training_set_t*
+construct_training_set (const char* const input_data_path,
+                        const char* const output_data_path)
+{
+  // MALLOC: ts
+  training_set_t* ts = malloc_exit_if_null(sizeof(training_set_t));
+
+  // The output file is loaded by another thread of the pool while this one loads the input file,
+  // and the threads left over help parse the chunks of both.
+  thread_pool_t* const pool = get_shared_thread_pool();
+  thread_pool_task_group_t group;
+  training_set_file_t input_file, output_file;
+  input_file.path = input_data_path;
+  output_file.path = output_data_path;
+  reset_thread_pool_task_group(&group);
+  fork_thread_pool_task(pool, &group, &_load_training_set_file, &output_file);
+  _load_training_set_file(&input_file);
+  join_thread_pool_task_group(pool, &group);
+
+  if (input_file.line_count != output_file.line_count)
+    putserr_and_exit("The number of lines in the output file and the input file is not equal.");
+
+  // INIT: ts->training_set_size, ts->input_size, ts->output_size
+  ts->training_set_size = input_file.line_count;
+  ts->input_size = input_file.width;
+  ts->output_size = output_file.width;
+
+  // INIT: ts->input_entries_desc, ts->input_entries_min, ts->input_entries_max, ts->_inputs
+  // INIT: ts->output_entries_desc, ts->output_entries_min, ts->output_entries_max, ts->_outputs
+  ts->input_entries_desc = input_file.descs;
+  ts->input_entries_min = input_file.min;
+  ts->input_entries_max = input_file.max;
+  ts->_inputs = input_file.values;
+  ts->output_entries_desc = output_file.descs;
+  ts->output_entries_min = output_file.min;
+  ts->output_entries_max = output_file.max;
+  ts->_outputs = output_file.values;
+
+  // MALLOC: ts->target_inputs
+  // INIT: ts->target_inputs
+  // MALLOC: ts->target_outputs
+  // INIT: ts->target_outputs
+  ts->target_inputs = malloc_exit_if_null(SIZEOF_PTR * (ts->training_set_size > 0 ? ts->training_set_size : 1));
+  ts->target_outputs = malloc_exit_if_null(SIZEOF_PTR * (ts->training_set_size > 0 ? ts->training_set_size : 1));
+  size_t i;
+  for (i = 0; i < ts->training_set_size; ++i)
+  {
+    ts->target_inputs[i] = ts->_inputs + i * ts->input_size;
+    ts->target_outputs[i] = ts->_outputs + i * ts->output_size;
   }
 
   // INIT: ts->_is_normalized
   ts->_is_normalized = false;
 
-  destruct_csv_data(input_data);
-  destruct_csv_data(output_data);
   return ts;
 }
 
-
 void
 destruct_training_set (training_set_t* const ts)
 {
@@ -140,13 +361,10 @@ destruct_training_set (training_set_t* const ts)
   free_and_null(ts->output_entries_min);
   free_and_null(ts->output_entries_max);
 
-  // FREE: ts->target_inputs
-  // FREE: ts->target_outputs
-  for (i = 0; i < ts->training_set_size; ++i)
-  {
-    free_and_null(ts->target_inputs[i]);
-    free_and_null(ts->target_outputs[i]);
-  }
+  // FREE: ts->target_inputs, ts->_inputs
+  // FREE: ts->target_outputs, ts->_outputs
+  free_and_null(ts->_inputs);
+  free_and_null(ts->_outputs);
   free_and_null(ts->target_inputs);
   free_and_null(ts->target_outputs);
 
@@ -241,6 +459,22 @@ denormalize_training_set (training_set_t* const ts)
   ts->_is_normalized = false;
 }
 
+double
+normalize_training_set_input (const training_set_t* const ts,
+                              const size_t                index,
+                              const double                entry)
+{
+  return _normalize(entry, ts->input_entries_min[index], ts->input_entries_max[index]);
+}
+
+double
+denormalize_training_set_output (const training_set_t* const ts,
+                                 const size_t                index,
+                                 const double                entry)
+{
+  return _denormalize(entry, ts->output_entries_min[index], ts->output_entries_max[index]);
+}
+
 void
 debug_training_set (const training_set_t* const ts)
 {
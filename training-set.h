@@ -10,6 +10,8 @@
 #include <stdbool.h>
 #include <stddef.h>
 
+#include "precision.h"
+
 /*!
   The training_set_t \b struct.
   */
@@ -37,7 +39,7 @@ struct training_set_t {
   /*!
     The target inputs of this training set
     */
-  double**  target_inputs;
+  real_t**  target_inputs;
   /*!
     The output size of this training set.
     */
@@ -57,17 +59,28 @@ struct training_set_t {
   /*!
     The target outputs of this training set
     */
-  double**  target_outputs;
+  real_t**  target_outputs;
   /*!
     Used internally. Sets to true if data is already normalized. Defaults to false.
     */
   bool      _is_normalized;
+  real_t*   _inputs;
+  real_t*   _outputs;
 };
 
 typedef struct training_set_t   training_set_t;
 
 /*!
   Constructs and recursively allocate memory for a new training_set_t instance.
+
+  The input and output files are loaded at the same time, the output file by a thread of
+  get_shared_thread_pool(). Each is mapped into memory and split by split_csv_file() into
+  chunks whose entries are parsed straight into numbers, and the range of every column is
+  found in the same pass. The samples of each file are then in a single allocation, in
+  order, which \b target_inputs and \b target_outputs point into.
+
+  This function will exit if the files are malformed or have different numbers of lines.
+
   \param input_data_path the path to the file holding the input data set.
   \param output_data_path the path to the file holding the output data set.
   \return a new training_set_t instance
@@ -97,6 +110,32 @@ normalize_training_set (training_set_t* const ts);
 void
 denormalize_training_set (training_set_t* const ts);
 
+/*!
+  Normalizes a single input entry with the ranges of a training set, the way
+  normalize_training_set() does.
+  \param ts the training_set_t instance holding the ranges.
+  \param index the input entry index.
+  \param entry the value to normalize.
+  \return the normalized value.
+  */
+double
+normalize_training_set_input (const training_set_t* const ts,
+                              const size_t                index,
+                              const double                entry);
+
+/*!
+  Denormalizes a single output entry with the ranges of a training set, the way
+  denormalize_training_set() does.
+  \param ts the training_set_t instance holding the ranges.
+  \param index the output entry index.
+  \param entry the normalized value.
+  \return the value in the original range of that output.
+  */
+double
+denormalize_training_set_output (const training_set_t* const ts,
+                                 const size_t                index,
+                                 const double                entry);
+
 /*!
   Debug the associated training set, printing its contents
   \param ts the training_set_t instance to debug.
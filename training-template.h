@@ -0,0 +1,145 @@
+/*!
+  \file training-template.h
+  \brief The back-propagation of a batch, written once against the TRAINING_* macros and
+         included by training.c once per derivative function.
+
+  Before including this file, training.c defines:
+  - \b TRAINING_VARIANT: the derivative token, appended to every function name.
+  - \b TRAINING_DERIVATIVE(training, value_before_activation, value_after_activation):
+    the derivative of one neuron, as a double expression.
+
+  Each inclusion defines two functions, without and with the flat-spot fix, so that
+  the derivative and the fix are inlined into the loops instead of being called or
+  tested for every neuron. This file undefines the above when done. There is
+  intentionally no include guard.
+  */
+
+#define TRAINING_CONCAT_(name, variant) name##_##variant
+#define TRAINING_CONCAT(name, variant) TRAINING_CONCAT_(name, variant)
+#define TRAINING_FUNCTION(name) TRAINING_CONCAT(name, TRAINING_VARIANT)
+
+/*
+  Back-propagates the samples [first_index, first_index + batch_size), which must
+  have just been fed forward by the same worker, and accumulates their gradients
+  and errors into the worker.
+
+  The gradients of every weight layer are accumulated as a rank-batch_size update,
+  blocked so that a block of gradient rows stays in cache for the whole batch.
+  Every gradient still receives its per-sample contributions in sample order, so
+  the full-batch gradients are bitwise identical for every batch size.
+  */
+static inline __attribute__((always_inline)) void
+TRAINING_FUNCTION(_back_propagate) (const training_t*       training,
+                                    training_worker_t*      worker,
+                                    const neural_network_t* nn,
+                                    const training_set_t*   ts,
+                                    const size_t            first_index,
+                                    const size_t            batch_size,
+                                    const double            flat_spot_fix)
+{ // current_layer_index
+  size_t  cli,
+  // next_layer_index
+          nli,
+  // current_layer_neuron_index,
+          clni,
+  // batch_index
+          bi;
+  // Only the generic derivative uses it.
+  (void) training;
+  const simd_kernels_t* const kernels = get_simd_kernels();
+  cli = nn->config_size - 1;
+  double error;
+  for (bi = 0; bi < batch_size; ++bi)
+  {
+    const real_t* const target_outputs = ts->target_outputs[first_index + bi];
+    const size_t offset = bi * nn->config[cli];
+    for (clni = 0; clni < nn->config[cli]; ++clni)
+    {
+#ifdef CANN_DEBUG
+      printf("Trained output %d: %g\n", clni, worker->_post_activated_sums[cli][offset + clni]);
+      printf("Target output %d: %g\n", clni, target_outputs[clni]);
+#endif
+      error = update_error(worker->_error_data,
+          target_outputs[clni], worker->_post_activated_sums[cli][offset + clni]);
+      worker->_deltas[cli - 1][offset + clni] =
+        error * (TRAINING_DERIVATIVE(training,
+                                     worker->_pre_activated_sums[cli][offset + clni],
+                                     worker->_post_activated_sums[cli][offset + clni]) + flat_spot_fix);
+    }
+  }
+
+  for (nli = nn->config_size - 1; nli > 0; --nli)
+  {
+    cli = nli - 1;
+    const size_t num_neurons = nn->config[cli];
+    const size_t num_next_neurons = nn->config[nli];
+    const real_t* const weights = get_neural_network_weight_layer(nn, cli);
+    double* const gradients = get_gradient_buffer_layer(nn, worker->_gradients, cli);
+    const real_t* const outputs = worker->_post_activated_sums[cli];
+    const real_t* const deltas = worker->_deltas[cli];
+
+    const size_t row_block = _block_rows(num_next_neurons);
+    size_t row_begin, row_end;
+    for (row_begin = 0; row_begin < num_neurons; row_begin = row_end)
+    {
+      row_end = _min(row_begin + row_block, num_neurons);
+      kernels->batch_outer_product_accumulate(outputs + row_begin, num_neurons, row_end - row_begin,
+                                              deltas, num_next_neurons, num_next_neurons,
+                                              batch_size, gradients + row_begin * num_next_neurons);
+
+      // The input layer has no delta.
+      if (cli == 0)
+        continue;
+
+      for (bi = 0; bi < batch_size; ++bi)
+      {
+        const real_t* const sample_deltas = deltas + bi * num_next_neurons;
+        const real_t* const pre_activated_sums = worker->_pre_activated_sums[cli] + bi * num_neurons;
+        const real_t* const post_activated_sums = worker->_post_activated_sums[cli] + bi * num_neurons;
+        real_t* const previous_deltas = worker->_deltas[cli - 1] + bi * num_neurons;
+        // Most derivatives only use one of them.
+        (void) pre_activated_sums;
+        (void) post_activated_sums;
+        for (clni = row_begin; clni < row_end; ++clni)
+        {
+          error = kernels->dot(weights + clni * num_next_neurons, sample_deltas, num_next_neurons);
+          previous_deltas[clni] =
+            error * (TRAINING_DERIVATIVE(training, pre_activated_sums[clni], post_activated_sums[clni])
+                     + flat_spot_fix);
+        }
+      }
+    }
+  }
+#ifdef CANN_DEBUG
+  printf("\n");
+#endif
+}
+
+static void
+TRAINING_FUNCTION(_process_training_data) (const training_t*       training,
+                                           training_worker_t*      worker,
+                                           const neural_network_t* nn,
+                                           const training_set_t*   ts,
+                                           const size_t            first_index,
+                                           const size_t            batch_size)
+{
+  TRAINING_FUNCTION(_back_propagate)(training, worker, nn, ts, first_index, batch_size, 0.0);
+}
+
+static void
+TRAINING_FUNCTION(_process_training_data_flat_spot) (const training_t*       training,
+                                                     training_worker_t*      worker,
+                                                     const neural_network_t* nn,
+                                                     const training_set_t*   ts,
+                                                     const size_t            first_index,
+                                                     const size_t            batch_size)
+{
+  TRAINING_FUNCTION(_back_propagate)(training, worker, nn, ts, first_index, batch_size, TRAINING_FLAT_SPOT_FIX);
+}
+
+#undef TRAINING_FUNCTION
+#undef TRAINING_CONCAT
+#undef TRAINING_CONCAT_
+
+#undef TRAINING_VARIANT
+#undef TRAINING_DERIVATIVE
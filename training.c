@@ -1,21 +1,321 @@
+#define _POSIX_C_SOURCE 200112L
 #undef NN_DEBUG
 //#define CANN_DEBUG
 
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 
 #include <float.h>
 #include <stdbool.h>
 #include <math.h>
 
-#ifdef _OPENMP
-#include <omp.h>
-#endif
-
 #include "util/util.h"
+#include "util/thread-pool.h"
 #include "validation.h"
+#include "simd-kernels.h"
+#include "prediction.h"
 
 #include "training.h"
 
+static void
+_construct_worker (training_worker_t*       worker,
+                   const training_t*        training,
+                   const neural_network_t*  nn)
+{
+  // MALLOC: worker->_post_activated_sums
+  size_t i;
+  worker->_post_activated_sums = malloc_exit_if_null(nn->config_size * SIZEOF_PTR);
+  for (i = 0; i < nn->config_size; ++i)
+  {
+    worker->_post_activated_sums[i] = malloc_exit_if_null(training->_batch_size * nn->config[i] * sizeof(real_t));
+  }
+
+  // MALLOC: worker->_pre_activated_sums
+  worker->_pre_activated_sums = malloc_exit_if_null(nn->config_size * SIZEOF_PTR);
+  for (i = 0; i < nn->config_size; ++i)
+  {
+    worker->_pre_activated_sums[i] = malloc_exit_if_null(training->_batch_size * nn->config[i] * sizeof(real_t));
+  }
+
+  // MALLOC: worker->_deltas
+  const size_t num_weight_layers = nn->config_size - 1;
+  worker->_deltas = malloc_exit_if_null(num_weight_layers * SIZEOF_PTR);
+  for (i = 0; i < num_weight_layers; ++i)
+  {
+    worker->_deltas[i] = malloc_exit_if_null(training->_batch_size * nn->config[i + 1] * sizeof(real_t));
+  }
+
+  // INIT: worker->_gradients, worker->_error_data
+  // They point to the buffers of the partition being processed.
+  worker->_gradients = NULL;
+  worker->_error_data = NULL;
+}
+
+static void
+_destruct_worker (training_worker_t*       worker,
+                  const neural_network_t*  nn)
+{
+  // FREE: worker->_post_activated_sums
+  size_t i;
+  for (i = 0; i < nn->config_size; ++i)
+  {
+    free_and_null(worker->_post_activated_sums[i]);
+  }
+  free_and_null(worker->_post_activated_sums);
+
+  // FREE: worker->_pre_activated_sums
+  for (i = 0; i < nn->config_size; ++i)
+  {
+    free_and_null(worker->_pre_activated_sums[i]);
+  }
+  free_and_null(worker->_pre_activated_sums);
+
+  // FREE: worker->_deltas
+  for (i = 0; i < nn->config_size - 1; ++i)
+  {
+    free_and_null(worker->_deltas[i]);
+  }
+  free_and_null(worker->_deltas);
+}
+
+static void
+_construct_workers (training_t*             training,
+                    const neural_network_t* nn)
+{
+  // MALLOC: training->_workers
+  training->_workers = malloc_exit_if_null(training->_num_threads * sizeof(training_worker_t));
+  size_t i;
+  for (i = 0; i < training->_num_threads; ++i)
+  {
+    _construct_worker(&training->_workers[i], training, nn);
+  }
+}
+
+static void
+_destruct_workers (training_t*             training,
+                   const neural_network_t* nn)
+{
+  // FREE: training->_workers
+  size_t i;
+  for (i = 0; i < training->_num_threads; ++i)
+  {
+    _destruct_worker(&training->_workers[i], nn);
+  }
+  free_and_null(training->_workers);
+}
+
+static inline size_t
+_min (const size_t a,
+      const size_t b)
+{
+  return a < b ? a : b;
+}
+
+/*
+  Applies the activation function to the `n` sums of a layer.
+  */
+static inline void
+_activate (const training_t*       training,
+           const real_t*           sums,
+           real_t*                 post_activated_sums,
+           const size_t            n)
+{
+  if (training->_activation_array_function != NULL)
+  {
+    (*(training->_activation_array_function)) (sums, post_activated_sums, n);
+    return;
+  }
+
+  size_t i;
+  for (i = 0; i < n; ++i)
+  {
+    post_activated_sums[i] = (*(training->_activation_function)) (sums[i]);
+  }
+}
+
+/*
+  Number of rows of a row-major matrix with `columns` columns that fit in
+  NEURAL_NETWORK_CACHE_BLOCK_SIZE bytes.
+  */
+static inline size_t
+_block_rows (const size_t columns)
+{
+  const size_t rows = NEURAL_NETWORK_CACHE_BLOCK_SIZE / (columns * sizeof(real_t));
+  return rows > 0 ? rows : 1;
+}
+
+/*
+  Feeds the samples [first_index, first_index + batch_size) through the network,
+  keeping the activations of every layer in the worker for _process_training_data().
+  */
+static inline void
+_feed_forward (const training_t*        training,
+               training_worker_t*       worker,
+               const neural_network_t*  nn,
+               const training_set_t*    ts,
+               const size_t             first_index,
+               const size_t             batch_size)
+{
+  // current_layer_index
+  size_t cli,
+  // previous_layer_index
+         pli,
+  // current_layer_neuron_index
+         clni,
+  // batch_index
+         bi;
+
+  cli = 0;
+  for (bi = 0; bi < batch_size; ++bi)
+  {
+    const real_t* const target_inputs = ts->target_inputs[first_index + bi];
+    real_t* const pre_activated_sums = worker->_pre_activated_sums[cli] + bi * nn->config[cli];
+    real_t* const post_activated_sums = worker->_post_activated_sums[cli] + bi * nn->config[cli];
+    for (clni = 0; clni < nn->config[cli]; ++clni)
+    {
+      pre_activated_sums[clni] = target_inputs[clni];
+      post_activated_sums[clni] = target_inputs[clni];
+#ifdef CANN_DEBUG
+      printf("Input %d: %g\n", clni, target_inputs[clni]);
+#endif
+    }
+  }
+
+  for (cli = 1; cli < nn->config_size; ++cli)
+  {
+    pli = cli - 1;
+    const size_t num_outputs = nn->config[cli];
+    real_t* const sums = worker->_pre_activated_sums[cli];
+    compute_neural_network_layer_sums(nn, pli, worker->_post_activated_sums[pli], sums, batch_size);
+
+    _activate(training, sums, worker->_post_activated_sums[cli], batch_size * num_outputs);
+  }
+}
+
+static inline double
+_elliott_derivative (const double value_before_activation,
+                     const double scale)
+{
+  const double temp = 1.0 + fabs(value_before_activation * ELLIOTT_SLOPE);
+  return ELLIOTT_SLOPE / (scale * temp * temp);
+}
+
+#define TRAINING_FLAT_SPOT_FIX 0.1
+
+#define TRAINING_VARIANT elliott
+#define TRAINING_DERIVATIVE(training, value_before_activation, value_after_activation) \
+  _elliott_derivative((value_before_activation), 2.0)
+#include "training-template.h"
+
+#define TRAINING_VARIANT elliott_symmetric
+#define TRAINING_DERIVATIVE(training, value_before_activation, value_after_activation) \
+  _elliott_derivative((value_before_activation), 1.0)
+#include "training-template.h"
+
+#define TRAINING_VARIANT tanh
+#define TRAINING_DERIVATIVE(training, value_before_activation, value_after_activation) \
+  (1.0 - (double) (value_after_activation) * (value_after_activation))
+#include "training-template.h"
+
+#define TRAINING_VARIANT sigmoid
+#define TRAINING_DERIVATIVE(training, value_before_activation, value_after_activation) \
+  ((double) (value_after_activation) * (1.0 - (value_after_activation)))
+#include "training-template.h"
+
+#define TRAINING_VARIANT generic
+#define TRAINING_DERIVATIVE(training, value_before_activation, value_after_activation) \
+  (*((training)->_derivative_function)) ((value_before_activation), (value_after_activation))
+#include "training-template.h"
+
+static const struct
+{
+  double                                (*derivative_function) (const double,
+                                                                const double);
+  process_training_data_function_t      process_training_data;
+  process_training_data_function_t      process_training_data_flat_spot;
+} specialized_training_loops[] =
+{
+  { &elliott_derivative, &_process_training_data_elliott, &_process_training_data_flat_spot_elliott },
+  { &elliott_symmetric_derivative, &_process_training_data_elliott_symmetric,
+    &_process_training_data_flat_spot_elliott_symmetric },
+  { &tanh_derivative, &_process_training_data_tanh, &_process_training_data_flat_spot_tanh },
+  { &sigmoid_derivative, &_process_training_data_sigmoid, &_process_training_data_flat_spot_sigmoid }
+};
+
+/*
+  Picks the back-propagation specialized for a derivative function defined in
+  activation-functions.h, or the generic one that calls it through its pointer.
+  */
+static process_training_data_function_t
+_select_process_training_data (double     (*derivative_function) (const double,
+                                                                  const double),
+                               const bool fix_flat_spot)
+{
+  size_t i;
+  for (i = 0; i < sizeof(specialized_training_loops) / sizeof(specialized_training_loops[0]); ++i)
+  {
+    if (specialized_training_loops[i].derivative_function == derivative_function)
+      return fix_flat_spot ? specialized_training_loops[i].process_training_data_flat_spot
+                           : specialized_training_loops[i].process_training_data;
+  }
+  return fix_flat_spot ? &_process_training_data_flat_spot_generic : &_process_training_data_generic;
+}
+
+/*
+  The progress of a training run towards its stopping policy.
+  */
+struct training_progress_t
+{
+  size_t                  epoch;
+  double                  best_error;
+  size_t                  minor_improvement_cycles;
+  uint64_t                shuffle_state;
+  double                  elapsed_seconds;
+};
+
+typedef struct training_progress_t training_progress_t;
+
+/*
+  What the next training run continues from, after resume_training_from_checkpoint().
+  The weights, gradients and errors are loaded straight into the neural network and the
+  training_t instance.
+  */
+struct training_resume_t
+{
+  bool                    is_resuming;
+  training_progress_t     progress;
+  size_t                  training_set_size;
+  // The rows of the shuffled training set as indexes into it, or NULL if it is not shuffled.
+  size_t*                 order;
+  bool                    has_validation;
+  double                  best_validation_error;
+  size_t                  num_stale_validations;
+  // The best validated weights, or NULL if there are none yet.
+  real_t*                 best_weights;
+  // The weights that were being validated in the background, or NULL.
+  real_t*                 pending_weights;
+};
+
+typedef struct training_resume_t training_resume_t;
+
+static void
+_clear_resume (training_resume_t* resume)
+{
+  // FREE: resume->order, resume->best_weights, resume->pending_weights
+  free_and_null(resume->order);
+  if (resume->best_weights != NULL)
+    destruct_neural_network_weight_buffer(resume->best_weights);
+  if (resume->pending_weights != NULL)
+    destruct_neural_network_weight_buffer(resume->pending_weights);
+
+  // INIT: resume->is_resuming, resume->order, resume->best_weights, resume->pending_weights
+  resume->is_resuming = false;
+  resume->order = NULL;
+  resume->best_weights = NULL;
+  resume->pending_weights = NULL;
+}
+
 training_t*
 construct_training (const neural_network_t* nn,
                     double                  (*activation_function) (const double),
@@ -32,284 +332,1084 @@ construct_training (const neural_network_t* nn,
   // INIT: training->_derivative_function
   training->_derivative_function = derivative_function;
 
+  // INIT: training->_activation_array_function
+  const activation_functions_t* const functions = find_activation_functions(activation_function);
+  training->_activation_array_function = functions != NULL ? functions->activation_array_function : NULL;
+
   // INIT: training->_fix_flat_spot
   training->_fix_flat_spot = fix_flat_spot;
 
-  // MALLOC: training->_post_activated_sums
+  // INIT: training->_process_training_data
+  training->_process_training_data = _select_process_training_data(derivative_function, fix_flat_spot);
+
+  // INIT: training->_batch_size
+  training->_batch_size = DEFAULT_TRAINING_BATCH_SIZE;
+
+  // INIT: training->_num_threads
+  training->_num_threads = 1;
+
+  // INIT: training->_shuffle_seed
+  training->_shuffle_seed = DEFAULT_TRAINING_SHUFFLE_SEED;
+
+  // INIT: training->_stopping_policy
+  training->_stopping_policy = get_default_training_stopping_policy();
+
+  // MALLOC: training->gradients
+  training->gradients = construct_neural_network_gradient_buffer(nn);
+
+  // MALLOC: training->previous_gradients
+  training->previous_gradients = construct_neural_network_gradient_buffer(nn);
+
+  // MALLOC: nn->error_data
+  training->error_data = construct_error_data();
+
+  // INIT: training->_validation_set, training->_validation_interval, training->_validation_patience,
+  //       training->_is_validation_in_background
+  training->_validation_set = NULL;
+  training->_validation_interval = 1;
+  training->_validation_patience = 0;
+  training->_is_validation_in_background = false;
+
+  // MALLOC: training->validation_error_data
+  training->validation_error_data = construct_error_data();
+
+  // INIT: training->_checkpoint_path, training->_checkpoint_interval, training->_save_propagation_data
+  training->_checkpoint_path = NULL;
+  training->_checkpoint_interval = 1;
+  training->_save_propagation_data = NULL;
+
+  // MALLOC: training->_resume
+  // INIT: training->_resume
+  training->_resume = calloc_exit_if_null(1, sizeof(training_resume_t));
+
+  // MALLOC: training->_workers
+  _construct_workers(training, nn);
+
+  return training;
+}
+
+void
+destruct_training(training_t*             training,
+                  const neural_network_t* nn)
+{
+  // FREE: training->_workers
+  _destruct_workers(training, nn);
+
+  // FREE: training->error_data
+  destruct_error_data(training->error_data);
+
+  // FREE: training->validation_error_data
+  destruct_error_data(training->validation_error_data);
+
+  // FREE: training->_resume
+  _clear_resume(training->_resume);
+  free_and_null(training->_resume);
+
+  // FREE: training->_checkpoint_path
+  free_and_null(training->_checkpoint_path);
+
+  // FREE: training->gradients
+  destruct_neural_network_weight_buffer(training->gradients);
+
+  // FREE: training->previous_gradients
+  destruct_neural_network_weight_buffer(training->previous_gradients);
+
+  // FREE: training
+  free_and_null(training);
+}
+
+void
+set_training_batch_size (training_t*             training,
+                         const neural_network_t* nn,
+                         const size_t            batch_size)
+{
+  if (batch_size == 0)
+    putserr_and_exit("The training batch size must be at least 1.");
+
+  _destruct_workers(training, nn);
+  training->_batch_size = batch_size;
+  _construct_workers(training, nn);
+}
+
+void
+set_training_num_threads (training_t*             training,
+                          const neural_network_t* nn,
+                          const size_t            num_threads)
+{
+  _destruct_workers(training, nn);
+  training->_num_threads = num_threads == 0 ? get_shared_thread_pool()->num_threads : num_threads;
+  _construct_workers(training, nn);
+}
+
+size_t
+get_training_num_threads (const training_t* training)
+{
+  return training->_num_threads;
+}
+
+void
+set_training_shuffle_seed (training_t*    training,
+                           const uint64_t seed)
+{
+  training->_shuffle_seed = seed;
+}
+
+training_stopping_policy_t
+get_default_training_stopping_policy ()
+{
+  training_stopping_policy_t policy;
+  policy.max_epochs = 0;
+  policy.target_error = 0.0;
+  policy.time_limit = 0.0;
+  policy.min_improvement = DEFAULT_MIN_IMPROVEMENT;
+  policy.is_min_improvement_relative = false;
+  policy.improvement_window = DEFAULT_CYCLES_OVER_DEFAULT_MIN_IMPROVEMENT;
+  return policy;
+}
+
+void
+set_training_stopping_policy (training_t*                       training,
+                              const training_stopping_policy_t* policy)
+{
+  if (policy->max_epochs == 0 && policy->target_error <= 0.0 && policy->time_limit <= 0.0
+      && policy->improvement_window == 0)
+    putserr_and_exit("The training stopping policy must enable at least one criterion.");
+
+  training->_stopping_policy = *policy;
+}
+
+void
+set_training_validation (training_t*             training,
+                         const neural_network_t* nn,
+                         const training_set_t*   validation_set,
+                         const size_t            validate_every_x_epoch,
+                         const size_t            patience,
+                         const bool              is_in_background)
+{
+  if (validation_set != NULL)
+    validate_matching_neural_network_and_training_set(nn, validation_set);
+  if (validate_every_x_epoch == 0)
+    putserr_and_exit("The validation interval must be at least 1 epoch.");
+
+  training->_validation_set = validation_set;
+  training->_validation_interval = validate_every_x_epoch;
+  training->_validation_patience = patience;
+  training->_is_validation_in_background = is_in_background;
+}
+
+void
+set_training_checkpoint (training_t*                    training,
+                         const char*                    path,
+                         const size_t                   checkpoint_every_x_epoch,
+                         training_checkpoint_function_t save_propagation_data)
+{
+  if (checkpoint_every_x_epoch == 0)
+    putserr_and_exit("The checkpoint interval must be at least 1 epoch.");
+
+  // FREE: training->_checkpoint_path
+  free_and_null(training->_checkpoint_path);
+  training->_checkpoint_path = NULL;
+  if (path != NULL)
+  {
+    // MALLOC: training->_checkpoint_path
+    const size_t length = strlen(path) + 1;
+    training->_checkpoint_path = malloc_exit_if_null(length);
+    memcpy(training->_checkpoint_path, path, length);
+  }
+  training->_checkpoint_interval = checkpoint_every_x_epoch;
+  training->_save_propagation_data = save_propagation_data;
+}
+
+/*
+  The gradients and errors accumulated from one fixed range of the training set.
+  */
+struct training_partition_t
+{
+  double*           gradients;
+  error_data_t*     error_data;
+};
+
+typedef struct training_partition_t training_partition_t;
+
+/*
+  The number of partitions \b size samples are split in: one per TRAINING_MIN_PARTITION_SIZE
+  samples, up to TRAINING_MAX_PARTITIONS.
+  */
+static size_t
+_count_partitions (const size_t size)
+{
+  size_t count = (size + TRAINING_MIN_PARTITION_SIZE - 1) / TRAINING_MIN_PARTITION_SIZE;
+  if (count > TRAINING_MAX_PARTITIONS)
+    count = TRAINING_MAX_PARTITIONS;
+  if (count == 0)
+    count = 1;
+
+  return count;
+}
+
+/*
+  Allocates the partitions of up to \b max_size samples. The first partition accumulates
+  straight into training->gradients and training->error_data.
+  */
+static training_partition_t*
+_construct_partitions (const training_t*       training,
+                       const neural_network_t* nn,
+                       const size_t            max_size,
+                       size_t*                 num_partitions)
+{
+  const size_t count = _count_partitions(max_size);
+
+  // MALLOC: partitions
+  training_partition_t* partitions = malloc_exit_if_null(count * sizeof(training_partition_t));
+  partitions[0].gradients = training->gradients;
+  partitions[0].error_data = training->error_data;
   size_t i;
-  training->_post_activated_sums = malloc_exit_if_null(nn->config_size * SIZEOF_PTR);
-  for (i = 0; i < nn->config_size; ++i)
+  for (i = 1; i < count; ++i)
   {
-    training->_post_activated_sums[i] = malloc_exit_if_null(nn->config[i] * sizeof(double));
+    partitions[i].gradients = construct_neural_network_gradient_buffer(nn);
+    partitions[i].error_data = construct_error_data();
   }
 
-  // MALLOC: training->_pre_activated_sums
-  training->_pre_activated_sums = malloc_exit_if_null(nn->config_size * SIZEOF_PTR);
-  for (i = 0; i < nn->config_size; ++i)
+  *num_partitions = count;
+  return partitions;
+}
+
+static void
+_destruct_partitions (training_partition_t* partitions,
+                      const size_t          num_partitions)
+{
+  // FREE: partitions
+  size_t i;
+  for (i = 1; i < num_partitions; ++i)
   {
-    training->_pre_activated_sums[i] = malloc_exit_if_null(nn->config[i] * sizeof(double));
+    destruct_neural_network_weight_buffer(partitions[i].gradients);
+    destruct_error_data(partitions[i].error_data);
   }
+  free_and_null(partitions);
+}
 
-  // MALLOC: training->_deltas
-  const size_t num_weight_layers = nn->config_size - 1;
-  training->_deltas = malloc_exit_if_null(num_weight_layers * SIZEOF_PTR);
-  for (i = 0; i < num_weight_layers; ++i)
+/*
+  The arguments of the parallel loops of _train_range().
+  */
+struct training_epoch_t
+{
+  const training_t*       training;
+  const neural_network_t* nn;
+  const training_set_t*   ts;
+  size_t                  first_index;
+  size_t                  size;
+  training_partition_t*   partitions;
+  size_t                  num_partitions;
+};
+
+typedef struct training_epoch_t training_epoch_t;
+
+/*
+  The number of gradients merged at a time by _merge_gradients().
+  */
+#define TRAINING_MERGE_BLOCK_SIZE 512
+
+/*
+  Feeds partitions \b begin to \b end - 1 forward and back, in the buffers of worker \b slot.
+  */
+static void
+_train_partitions (void*        data,
+                   const size_t begin,
+                   const size_t end,
+                   const size_t slot)
+{
+  const training_epoch_t* const epoch = (const training_epoch_t*) data;
+  const training_t* const training = epoch->training;
+  const training_set_t* const ts = epoch->ts;
+  training_worker_t* const worker = &training->_workers[slot];
+  size_t partition;
+  for (partition = begin; partition < end; ++partition)
   {
-    training->_deltas[i] = malloc_exit_if_null(nn->config[i + 1] * sizeof(double));
+    const size_t first_index = epoch->first_index + partition * epoch->size / epoch->num_partitions;
+    const size_t last_index = epoch->first_index + (partition + 1) * epoch->size / epoch->num_partitions;
+    worker->_gradients = epoch->partitions[partition].gradients;
+    worker->_error_data = epoch->partitions[partition].error_data;
+
+    size_t index, current_batch_size;
+    for (index = first_index; index < last_index; index += current_batch_size)
+    {
+      current_batch_size = _min(training->_batch_size, last_index - index);
+      _feed_forward(training, worker, epoch->nn, ts, index, current_batch_size);
+      (*(training->_process_training_data)) (training, worker, epoch->nn, ts, index, current_batch_size);
+    }
   }
+}
 
-  // MALLOC: training->gradients
-  training->gradients = malloc_exit_if_null(num_weight_layers * SIZEOF_PTR);
-  size_t j;
-  for (i = 0; i < num_weight_layers; ++i)
+/*
+  Sums blocks \b begin to \b end - 1 of the partition gradients into the first partition,
+  as a pairwise tree in partition order: at every level, partition i receives partition
+  i + stride, for i a multiple of 2 * stride. The other partitions are cleared for the
+  next epoch.
+  */
+static void
+_merge_gradients (void*        data,
+                  const size_t begin,
+                  const size_t end,
+                  const size_t slot)
+{
+  (void) slot;
+  const training_epoch_t* const epoch = (const training_epoch_t*) data;
+  const training_partition_t* const partitions = epoch->partitions;
+  const size_t num_partitions = epoch->num_partitions;
+  const size_t first_weight = begin * TRAINING_MERGE_BLOCK_SIZE;
+  const size_t last_weight = _min(end * TRAINING_MERGE_BLOCK_SIZE, epoch->nn->weights_size);
+  size_t stride, i, wi;
+  for (stride = 1; stride < num_partitions; stride *= 2)
   {
-    training->gradients[i] = malloc_exit_if_null(nn->config[i] * SIZEOF_PTR);
-    for (j = 0; j < nn->config[i]; ++j)
+    for (i = 0; i + stride < num_partitions; i += 2 * stride)
     {
-      training->gradients[i][j] = calloc_exit_if_null(nn->config[i + 1], sizeof(double));
+      double* const gradients = partitions[i].gradients;
+      const double* const other_gradients = partitions[i + stride].gradients;
+      for (wi = first_weight; wi < last_weight; ++wi)
+      {
+        gradients[wi] += other_gradients[wi];
+      }
     }
   }
+  for (i = 1; i < num_partitions; ++i)
+  {
+    memset(partitions[i].gradients + first_weight, 0, (last_weight - first_weight) * sizeof(double));
+  }
+}
 
-  // MALLOC: training->previous_gradients
-  training->previous_gradients = malloc_exit_if_null(num_weight_layers * SIZEOF_PTR);
-  for (i = 0; i < num_weight_layers; ++i)
+/*
+  Sums the partition errors into the first partition, in the same order as _merge_gradients().
+  */
+static void
+_merge_error_data (const training_partition_t* const partitions,
+                   const size_t                      num_partitions)
+{
+  size_t stride, i;
+  for (stride = 1; stride < num_partitions; stride *= 2)
   {
-    training->previous_gradients[i] = malloc_exit_if_null(nn->config[i] * SIZEOF_PTR);
-    for (j = 0; j < nn->config[i]; ++j)
+    for (i = 0; i + stride < num_partitions; i += 2 * stride)
     {
-      training->previous_gradients[i][j] = calloc_exit_if_null(nn->config[i + 1], sizeof(double));
+      partitions[i].error_data->square_sum_error += partitions[i + stride].error_data->square_sum_error;
+      partitions[i].error_data->square_sum_error_count += partitions[i + stride].error_data->square_sum_error_count;
     }
   }
+  for (i = 1; i < num_partitions; ++i)
+  {
+    reset_error_data(partitions[i].error_data);
+  }
+}
 
-  // MALLOC: nn->error_data
-  training->error_data = construct_error_data();
+/*
+  Feeds the samples from \b first_index to \b last_index - 1 forward and back, adding their
+  gradients and errors to training->gradients and training->error_data.
 
-  return training;
+  Partition p holds the samples [first_index + p * size / num_partitions, first_index + (p + 1) * size / num_partitions),
+  where size = last_index - first_index and num_partitions = _count_partitions(size). They are
+  always accumulated in sample order, by whichever thread takes the partition. As the partitions
+  only depend on the range and are merged in a fixed order, the results are bitwise identical
+  for every number of threads and every batch size.
+  */
+static void
+_train_range (const training_t*           training,
+              const neural_network_t*     nn,
+              const training_set_t*       ts,
+              const size_t                first_index,
+              const size_t                last_index,
+              training_partition_t* const partitions)
+{
+  thread_pool_t* const pool = get_shared_thread_pool();
+  training_epoch_t epoch;
+  epoch.training = training;
+  epoch.nn = nn;
+  epoch.ts = ts;
+  epoch.first_index = first_index;
+  epoch.size = last_index - first_index;
+  epoch.partitions = partitions;
+  epoch.num_partitions = _count_partitions(epoch.size);
+
+  run_thread_pool_parallel_for(pool, 0, epoch.num_partitions, 1, training->_num_threads, &_train_partitions, &epoch);
+  if (epoch.num_partitions > 1)
+  {
+    const size_t num_blocks = (nn->weights_size + TRAINING_MERGE_BLOCK_SIZE - 1) / TRAINING_MERGE_BLOCK_SIZE;
+    run_thread_pool_parallel_for(pool, 0, num_blocks, 1, training->_num_threads, &_merge_gradients, &epoch);
+    _merge_error_data(partitions, epoch.num_partitions);
+  }
 }
 
-void
-destruct_training(training_t*             training,
-                  const neural_network_t* nn)
+/*
+  The state of the validation of a training run.
+  */
+struct training_validation_t
 {
-  // FREE: training->error_data
-  destruct_error_data(training->error_data);
+  const training_t*       training;
+  // A copy of the trained neural network whose weights are those being validated.
+  neural_network_t        nn;
+  real_t*                 snapshot;
+  real_t*                 best_weights;
+  prediction_workspace_t* workspace;
+  real_t*                 inputs;
+  real_t*                 outputs;
+  error_data_t*           error_data;
+  thread_pool_task_group_t group;
+  bool                    is_pending;
+  bool                    has_best_weights;
+  double                  best_error;
+  size_t                  num_stale_validations;
+};
 
-  // FREE: training->gradients
-  size_t i, j;
-  for (i = 0; i < nn->config_size - 1; ++i)
+typedef struct training_validation_t training_validation_t;
+
+static void
+_construct_validation (training_validation_t*  validation,
+                       const training_t*       training,
+                       const neural_network_t* nn)
+{
+  validation->training = training;
+  validation->nn = *nn;
+
+  // MALLOC: validation->snapshot, validation->best_weights
+  validation->snapshot = training->_is_validation_in_background ? construct_neural_network_weight_buffer(nn) : NULL;
+  validation->best_weights = construct_neural_network_weight_buffer(nn);
+
+  // MALLOC: validation->workspace, validation->inputs, validation->outputs
+  validation->workspace = construct_prediction_workspace(nn, training->_activation_function, training->_batch_size);
+  validation->inputs = malloc_exit_if_null(training->_batch_size * nn->config[0] * sizeof(real_t));
+  validation->outputs = malloc_exit_if_null(training->_batch_size * nn->config[nn->config_size - 1] * sizeof(real_t));
+
+  // MALLOC: validation->error_data
+  validation->error_data = construct_error_data();
+
+  // INIT: validation->is_pending, validation->has_best_weights, validation->best_error,
+  //       validation->num_stale_validations
+  validation->is_pending = false;
+  validation->has_best_weights = false;
+  validation->best_error = DBL_MAX;
+  validation->num_stale_validations = 0;
+}
+
+static void
+_destruct_validation (training_validation_t* validation)
+{
+  // FREE: validation->error_data
+  destruct_error_data(validation->error_data);
+
+  // FREE: validation->workspace, validation->inputs, validation->outputs
+  destruct_prediction_workspace(validation->workspace);
+  free_and_null(validation->inputs);
+  free_and_null(validation->outputs);
+
+  // FREE: validation->snapshot, validation->best_weights
+  if (validation->snapshot != NULL)
+    destruct_neural_network_weight_buffer(validation->snapshot);
+  destruct_neural_network_weight_buffer(validation->best_weights);
+}
+
+/*
+  Feeds the validation set forward through validation->nn, accumulating its errors in
+  validation->error_data. It runs on any thread of the pool in the background mode.
+  */
+static void
+_validate (void* data)
+{
+  training_validation_t* const validation = (training_validation_t*) data;
+  const training_set_t* const vs = validation->training->_validation_set;
+  const neural_network_t* const nn = &validation->nn;
+  const size_t num_inputs = nn->config[0];
+  const size_t num_outputs = nn->config[nn->config_size - 1];
+  reset_error_data(validation->error_data);
+  size_t first_index, count, i, j;
+  for (first_index = 0; first_index < vs->training_set_size; first_index += count)
   {
-    for (j = 0; j < nn->config[i]; ++j)
+    count = _min(validation->workspace->batch_size, vs->training_set_size - first_index);
+    for (i = 0; i < count; ++i)
     {
-      free_and_null(training->gradients[i][j]);
+      memcpy(validation->inputs + i * num_inputs, vs->target_inputs[first_index + i], num_inputs * sizeof(real_t));
+    }
+    predict_neural_network(nn, validation->workspace, validation->inputs, validation->outputs, count);
+    for (i = 0; i < count; ++i)
+    {
+      const real_t* const target_outputs = vs->target_outputs[first_index + i];
+      for (j = 0; j < num_outputs; ++j)
+      {
+        update_error(validation->error_data, target_outputs[j], validation->outputs[i * num_outputs + j]);
+      }
     }
-    free_and_null(training->gradients[i]);
   }
-  free_and_null(training->gradients);
+}
 
-  // FREE: training->previous_gradients
-  for (i = 0; i < nn->config_size - 1; ++i)
+/*
+  Keeps the weights just validated if they have the lowest validation error so far.
+  */
+static void
+_finish_validation (training_validation_t* validation)
+{
+  const double error = calculate_error(validation->error_data, MEAN_SQUARE);
+  if (error < validation->best_error)
   {
-    for (j = 0; j < nn->config[i]; ++j)
+    validation->best_error = error;
+    validation->num_stale_validations = 0;
+    validation->has_best_weights = true;
+    *validation->training->validation_error_data = *validation->error_data;
+    if (validation->snapshot != NULL)
+    {
+      real_t* const best_weights = validation->best_weights;
+      validation->best_weights = validation->snapshot;
+      validation->snapshot = best_weights;
+    }
+    else
     {
-      free_and_null(training->previous_gradients[i][j]);
+      memcpy(validation->best_weights, validation->nn.weights, validation->nn.weights_size * sizeof(real_t));
     }
-    free_and_null(training->previous_gradients[i]);
   }
-  free_and_null(training->previous_gradients);
+  else
+  {
+    ++validation->num_stale_validations;
+  }
+}
 
-  // FREE: training->_post_activated_sums
-  for (i = 0; i < nn->config_size; ++i)
+/*
+  Waits for the validation running in the background, if any, and takes its result.
+  */
+static void
+_join_validation (training_validation_t* validation)
+{
+  if (!validation->is_pending)
+    return;
+
+  join_thread_pool_task_group(get_shared_thread_pool(), &validation->group);
+  validation->is_pending = false;
+  _finish_validation(validation);
+}
+
+/*
+  Starts validating validation->snapshot in the background.
+  */
+static void
+_fork_validation (training_validation_t* validation)
+{
+  validation->nn.weights = validation->snapshot;
+  reset_thread_pool_task_group(&validation->group);
+  fork_thread_pool_task(get_shared_thread_pool(), &validation->group, &_validate, validation);
+  validation->is_pending = true;
+}
+
+/*
+  Validates the current weights of \b nn, either now or, in the background mode, on a
+  snapshot of them while the training goes on, after taking the result of the previous one.
+  Returns true once the validation error has not improved for the patience of the training.
+  */
+static bool
+_run_validation (training_validation_t*  validation,
+                 const neural_network_t* nn)
+{
+  if (validation->snapshot != NULL)
   {
-    free_and_null(training->_post_activated_sums[i]);
+    _join_validation(validation);
+    memcpy(validation->snapshot, nn->weights, nn->weights_size * sizeof(real_t));
+    _fork_validation(validation);
   }
-  free_and_null(training->_post_activated_sums);
+  else
+  {
+    validation->nn.weights = nn->weights;
+    _validate(validation);
+    _finish_validation(validation);
+  }
+
+  const size_t patience = validation->training->_validation_patience;
+  return patience != 0 && validation->num_stale_validations >= patience;
+}
 
-  // FREE: training->_pre_activated_sums
+static const char _checkpoint_magic[8] = {'C', 'A', 'N', 'N', 'C', 'K', 'P', 'T'};
+
+/*
+  Sizes and flags are saved as 64-bit unsigned integers, whatever the size of size_t.
+  */
+static void
+_write_size (FILE*        fp,
+             const size_t value)
+{
+  const uint64_t value64 = value;
+  fwrite_exit_if_failed(&value64, sizeof(uint64_t), 1, fp);
+}
+
+static size_t
+_read_size (FILE* fp)
+{
+  uint64_t value64;
+  fread_exit_if_failed(&value64, sizeof(uint64_t), 1, fp);
+  return (size_t) value64;
+}
+
+static void
+_write_double (FILE*        fp,
+               const double value)
+{
+  fwrite_exit_if_failed(&value, sizeof(double), 1, fp);
+}
+
+static double
+_read_double (FILE* fp)
+{
+  double value;
+  fread_exit_if_failed(&value, sizeof(double), 1, fp);
+  return value;
+}
+
+static void
+_write_error_data (FILE*               fp,
+                   const error_data_t* ed)
+{
+  _write_double(fp, ed->square_sum_error);
+  _write_size(fp, ed->square_sum_error_count);
+}
+
+static void
+_read_error_data (FILE*         fp,
+                  error_data_t* ed)
+{
+  ed->square_sum_error = _read_double(fp);
+  ed->square_sum_error_count = _read_size(fp);
+}
+
+/*
+  Saves a checkpoint of the training before epoch progress->epoch, see set_training_checkpoint().
+  \b order is NULL unless the training set is shuffled, and \b validation is NULL unless
+  there is a validation set.
+  */
+static void
+_save_checkpoint (const training_t*            training,
+                  const neural_network_t*      nn,
+                  const training_progress_t*   progress,
+                  const size_t                 training_set_size,
+                  const size_t*                order,
+                  const training_validation_t* validation,
+                  void* const                  propagation_data)
+{
+  // MALLOC: temporary_path
+  const size_t path_length = strlen(training->_checkpoint_path);
+  char* const temporary_path = malloc_exit_if_null(path_length + sizeof(TRAINING_CHECKPOINT_TEMPORARY_SUFFIX));
+  memcpy(temporary_path, training->_checkpoint_path, path_length);
+  memcpy(temporary_path + path_length, TRAINING_CHECKPOINT_TEMPORARY_SUFFIX, sizeof(TRAINING_CHECKPOINT_TEMPORARY_SUFFIX));
+
+  FILE* fp = fopen(temporary_path, "wb");
+  exit_if_null(fp);
+
+  fwrite_exit_if_failed(_checkpoint_magic, 1, sizeof(_checkpoint_magic), fp);
+  _write_size(fp, TRAINING_CHECKPOINT_VERSION);
+  _write_size(fp, sizeof(real_t));
+  _write_size(fp, nn->config_size);
+  size_t i;
   for (i = 0; i < nn->config_size; ++i)
   {
-    free_and_null(training->_pre_activated_sums[i]);
+    _write_size(fp, nn->config[i]);
   }
-  free_and_null(training->_pre_activated_sums);
 
-  // FREE: training->_deltas
-  for (i = 0; i < nn->config_size - 1; ++i)
+  fwrite_exit_if_failed(nn->weights, sizeof(real_t), nn->weights_size, fp);
+  fwrite_exit_if_failed(training->gradients, sizeof(double), nn->weights_size, fp);
+  fwrite_exit_if_failed(training->previous_gradients, sizeof(double), nn->weights_size, fp);
+  _write_error_data(fp, training->error_data);
+  _write_error_data(fp, training->validation_error_data);
+
+  _write_size(fp, progress->epoch);
+  _write_double(fp, progress->best_error);
+  _write_size(fp, progress->minor_improvement_cycles);
+  fwrite_exit_if_failed(&progress->shuffle_state, sizeof(uint64_t), 1, fp);
+  _write_double(fp, progress->elapsed_seconds);
+  _write_size(fp, training_set_size);
+  _write_size(fp, order != NULL);
+  if (order != NULL)
   {
-    free_and_null(training->_deltas[i]);
+    for (i = 0; i < training_set_size; ++i)
+    {
+      _write_size(fp, order[i]);
+    }
   }
-  free_and_null(training->_deltas);
 
-  // FREE: training
-  free_and_null(training);
-}
+  _write_size(fp, validation != NULL);
+  if (validation != NULL)
+  {
+    _write_double(fp, validation->best_error);
+    _write_size(fp, validation->num_stale_validations);
+    _write_size(fp, validation->has_best_weights);
+    if (validation->has_best_weights)
+      fwrite_exit_if_failed(validation->best_weights, sizeof(real_t), nn->weights_size, fp);
+    // The validation running in the background is started again on resuming.
+    _write_size(fp, validation->is_pending);
+    if (validation->is_pending)
+      fwrite_exit_if_failed(validation->nn.weights, sizeof(real_t), nn->weights_size, fp);
+  }
 
-static inline void
-_update_delta (const training_t*       training,
-               const double            error,
-               const size_t            current_layer_index,
-               const size_t            current_layer_neuron_index)
-{
-  double flat_spot_fix = 0.0;
-  if (training->_fix_flat_spot)
-    flat_spot_fix = 0.1;
+  if (training->_save_propagation_data != NULL)
+    (*(training->_save_propagation_data)) (fp, propagation_data, nn);
+
+  // The checkpoint only replaces the previous one once it is entirely on disk.
+  exit_if_not_zero(fflush(fp));
+  exit_if_not_zero(fsync(fileno(fp)));
+  exit_if_not_zero(fclose(fp));
+  exit_if_not_zero(rename(temporary_path, training->_checkpoint_path));
 
-  training->_deltas[current_layer_index - 1][current_layer_neuron_index] =
-    error * ((*(training->_derivative_function))
-      (training->_pre_activated_sums[current_layer_index][current_layer_neuron_index],
-       training->_post_activated_sums[current_layer_index][current_layer_neuron_index]) + flat_spot_fix);
+  // FREE: temporary_path
+  free_and_null(temporary_path);
 }
 
-static inline void
-_feed_forward (const training_t*        training,
-               const neural_network_t*  nn,
-               const training_set_t*    ts,
-               const size_t             training_set_index)
+void
+resume_training_from_checkpoint (training_t*                    training,
+                                 const neural_network_t*        nn,
+                                 const char*                    path,
+                                 training_checkpoint_function_t load_propagation_data,
+                                 void*                          propagation_data)
 {
-  // current_layer_index
-  size_t cli,
-  // previous_layer_index
-         pli,
-  // current_layer_neuron_index
-         clni,
-  // previous_layer_neuron_index
-         plni;
+  training_resume_t* const resume = training->_resume;
+  _clear_resume(resume);
 
-  double sum, target_input;
-  cli = 0;
-  for (clni = 0; clni < nn->config[cli]; ++clni)
+  FILE* fp = fopen(path, "rb");
+  exit_if_null(fp);
+
+  char magic[sizeof(_checkpoint_magic)];
+  fread_exit_if_failed(magic, 1, sizeof(magic), fp);
+  if (memcmp(magic, _checkpoint_magic, sizeof(magic)) != 0)
+    printferr_and_exit("%s is not a training checkpoint.\n", path);
+  const size_t version = _read_size(fp);
+  if (version != TRAINING_CHECKPOINT_VERSION)
+    printferr_and_exit("The training checkpoint %s has version %zu instead of %d.\n", path, version,
+                       TRAINING_CHECKPOINT_VERSION);
+  if (_read_size(fp) != sizeof(real_t))
+    printferr_and_exit("The training checkpoint %s was saved with another precision.\n", path);
+  bool is_matching = _read_size(fp) == nn->config_size;
+  size_t i;
+  for (i = 0; is_matching && i < nn->config_size; ++i)
   {
-    target_input = ts->target_inputs[training_set_index][clni];
-    training->_pre_activated_sums[cli][clni] = target_input;
-    training->_post_activated_sums[cli][clni] = target_input;
-#ifdef CANN_DEBUG
-    printf("Input %d: %g\n", clni, ts->target_inputs[training_set_index][clni]);
-#endif
+    is_matching = _read_size(fp) == nn->config[i];
   }
+  if (!is_matching)
+    printferr_and_exit("The training checkpoint %s does not match the neural network.\n", path);
 
-  for (cli = 1; cli < nn->config_size; ++cli)
+  fread_exit_if_failed(nn->weights, sizeof(real_t), nn->weights_size, fp);
+  fread_exit_if_failed(training->gradients, sizeof(double), nn->weights_size, fp);
+  fread_exit_if_failed(training->previous_gradients, sizeof(double), nn->weights_size, fp);
+  _read_error_data(fp, training->error_data);
+  _read_error_data(fp, training->validation_error_data);
+
+  resume->progress.epoch = _read_size(fp);
+  resume->progress.best_error = _read_double(fp);
+  resume->progress.minor_improvement_cycles = _read_size(fp);
+  fread_exit_if_failed(&resume->progress.shuffle_state, sizeof(uint64_t), 1, fp);
+  resume->progress.elapsed_seconds = _read_double(fp);
+  resume->training_set_size = _read_size(fp);
+  if (_read_size(fp))
   {
-    pli = cli - 1;
-    for (clni = 0; clni < nn->config[cli]; ++clni)
+    // MALLOC: resume->order
+    resume->order = malloc_exit_if_null(resume->training_set_size * sizeof(size_t));
+    for (i = 0; i < resume->training_set_size; ++i)
     {
-      sum = 0.0;
-      for (plni = 0; plni < nn->config[pli]; ++plni)
-      {
-        sum += training->_post_activated_sums[pli][plni] * nn->weights[pli][plni][clni];
-      }
-      training->_pre_activated_sums[cli][clni] = sum;
-      training->_post_activated_sums[cli][clni] = (*(training->_activation_function)) (sum);
+      resume->order[i] = _read_size(fp);
+      if (resume->order[i] >= resume->training_set_size)
+        printferr_and_exit("The training checkpoint %s is corrupted.\n", path);
+    }
+  }
+
+  resume->has_validation = _read_size(fp);
+  if (resume->has_validation)
+  {
+    resume->best_validation_error = _read_double(fp);
+    resume->num_stale_validations = _read_size(fp);
+    if (_read_size(fp))
+    {
+      // MALLOC: resume->best_weights
+      resume->best_weights = construct_neural_network_weight_buffer(nn);
+      fread_exit_if_failed(resume->best_weights, sizeof(real_t), nn->weights_size, fp);
+    }
+    if (_read_size(fp))
+    {
+      // MALLOC: resume->pending_weights
+      resume->pending_weights = construct_neural_network_weight_buffer(nn);
+      fread_exit_if_failed(resume->pending_weights, sizeof(real_t), nn->weights_size, fp);
     }
   }
+
+  if (load_propagation_data != NULL)
+    (*load_propagation_data) (fp, propagation_data, nn);
+  if (fgetc(fp) != EOF)
+    printferr_and_exit("The training checkpoint %s holds more propagation data than was loaded.\n", path);
+  fclose(fp);
+
+  resume->is_resuming = true;
 }
 
-static inline void
-_process_training_data (const training_t*       training,
-                        const neural_network_t* nn,
-                        const training_set_t*   ts,
-                        const size_t            training_set_index)
-{ // current_layer_index
-  size_t  cli,
-  // next_layer_index
-          nli,
-  // current_layer_neuron_index,
-          clni,
-  // next_layer_neuron_index,
-          nlni;
-  cli = nn->config_size - 1;
-  double errors[nn->config[cli]], output, delta;
-  for (clni = 0; clni < nn->config[cli]; ++clni)
-  {
-    errors[clni] =
-      update_error(training->error_data,
-        ts->target_outputs[training_set_index][clni], training->_post_activated_sums[cli][clni]);
-  }
-
-  for (clni = 0; clni < nn->config[cli]; ++clni)
+/*
+  Continues a training run from the checkpoint loaded by resume_training_from_checkpoint(),
+  with its progress, the order of the shuffled training set and its validation.
+  */
+static void
+_resume_training (training_resume_t*     resume,
+                  training_progress_t*   progress,
+                  const training_set_t*  ts,
+                  training_set_t*        view,
+                  size_t*                order,
+                  training_validation_t* validation)
+{
+  if (resume->training_set_size != ts->training_set_size)
+    putserr_and_exit("The training checkpoint was saved while training on another training set.");
+  if ((resume->order != NULL) != (order != NULL) || resume->has_validation != (validation != NULL)
+      || (resume->pending_weights != NULL && (validation == NULL || validation->snapshot == NULL)))
+    putserr_and_exit("The training checkpoint was saved with other training settings.");
+
+  *progress = resume->progress;
+  size_t i;
+  if (order != NULL)
   {
-#ifdef CANN_DEBUG
-    printf("Trained output %d: %g\n", clni, training->_post_activated_sums[cli][clni]);
-    printf("Target output %d: %g\n", clni, ts->target_outputs[training_set_index][clni]);
-#endif
-    _update_delta(training, errors[clni], cli, clni);
+    for (i = 0; i < ts->training_set_size; ++i)
+    {
+      order[i] = resume->order[i];
+      view->target_inputs[i] = ts->target_inputs[order[i]];
+      view->target_outputs[i] = ts->target_outputs[order[i]];
+    }
   }
 
-  double error;
-  for (cli = nn->config_size - 2; cli > 0; --cli)
+  if (validation != NULL)
   {
-    nli = cli + 1;
-    for (clni = 0; clni < nn->config[cli]; ++clni)
+    validation->best_error = resume->best_validation_error;
+    validation->num_stale_validations = resume->num_stale_validations;
+    if (resume->best_weights != NULL)
     {
-      error = 0.0;
-      output = training->_post_activated_sums[cli][clni];
-      for (nlni = 0; nlni < nn->config[nli]; ++nlni)
-      {
-        delta = training->_deltas[cli][nlni];
-        training->gradients[cli][clni][nlni] += output * delta;
-        error += nn->weights[cli][clni][nlni] * delta;
-      }
-      _update_delta(training, error, cli, clni);
+      validation->has_best_weights = true;
+      memcpy(validation->best_weights, resume->best_weights, validation->nn.weights_size * sizeof(real_t));
+    }
+    if (resume->pending_weights != NULL)
+    {
+      memcpy(validation->snapshot, resume->pending_weights, validation->nn.weights_size * sizeof(real_t));
+      _fork_validation(validation);
     }
   }
-#ifdef CANN_DEBUG
-  printf("\n");
-#endif
+
+  _clear_resume(resume);
 }
 
-double
-train_neural_network (const training_t*       training,
-                      const neural_network_t* nn,
-                      const training_set_t*   ts,
-                      void                    (*propagation_loop) (void*,
-                                                                   const neural_network_t*,
-                                                                   const training_t*),
+/*
+  Shuffles the rows of \b ts in place, with the xorshift64* generator \b state, and their
+  indexes in \b order alike.
+  */
+static void
+_shuffle_training_set (training_set_t* const ts,
+                       size_t*         const order,
+                       uint64_t*       const state)
+{
+  size_t i;
+  for (i = ts->training_set_size; i > 1; --i)
+  {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    const size_t j = (*state * UINT64_C(2685821657736338717)) % i;
 
-                      void* const             propagation_data,
-                      const size_t            print_every_x_epoch)
+    real_t* const target_inputs = ts->target_inputs[i - 1];
+    ts->target_inputs[i - 1] = ts->target_inputs[j];
+    ts->target_inputs[j] = target_inputs;
+
+    real_t* const target_outputs = ts->target_outputs[i - 1];
+    ts->target_outputs[i - 1] = ts->target_outputs[j];
+    ts->target_outputs[j] = target_outputs;
+
+    const size_t index = order[i - 1];
+    order[i - 1] = order[j];
+    order[j] = index;
+  }
+}
+
+/*
+  Trains until the error stops improving, calling \b propagation_loop after every
+  \b mini_batch_size samples, or once per epoch if it is 0.
+  */
+static double
+_train (const training_t*       training,
+        const neural_network_t* nn,
+        const training_set_t*   ts,
+        void                    (*propagation_loop) (void*,
+                                                     const neural_network_t*,
+                                                     const training_t*),
+        void* const             propagation_data,
+        const size_t            mini_batch_size,
+        const bool              shuffle,
+        const size_t            print_every_x_epoch)
 {
   validate_matching_neural_network_and_training_set(nn, ts);
-  double best_error = DBL_MAX;
+  const size_t update_size = mini_batch_size == 0 ? ts->training_set_size : _min(mini_batch_size, ts->training_set_size);
+  size_t num_partitions;
+  training_partition_t* const partitions = _construct_partitions(training, nn, update_size, &num_partitions);
+
+  training_progress_t progress;
+  progress.epoch = 0;
+  progress.best_error = DBL_MAX;
+  progress.minor_improvement_cycles = 0;
+  progress.shuffle_state = training->_shuffle_seed != 0 ? training->_shuffle_seed : 1;
+  progress.elapsed_seconds = 0.0;
+
+  // A view of ts with its own row order, so that shuffling leaves ts alone.
+  training_set_t view = *ts;
+  size_t* order = NULL;
+  if (shuffle)
+  {
+    // MALLOC: view.target_inputs, view.target_outputs, order
+    view.target_inputs = malloc_exit_if_null(ts->training_set_size * SIZEOF_PTR);
+    view.target_outputs = malloc_exit_if_null(ts->training_set_size * SIZEOF_PTR);
+    memcpy(view.target_inputs, ts->target_inputs, ts->training_set_size * SIZEOF_PTR);
+    memcpy(view.target_outputs, ts->target_outputs, ts->training_set_size * SIZEOF_PTR);
+    order = malloc_exit_if_null(ts->training_set_size * sizeof(size_t));
+    size_t i;
+    for (i = 0; i < ts->training_set_size; ++i)
+    {
+      order[i] = i;
+    }
+  }
+
+  training_validation_t validation;
+  if (training->_validation_set != NULL)
+    _construct_validation(&validation, training, nn);
+
+  if (training->_resume->is_resuming)
+    _resume_training(training->_resume, &progress, ts, &view, order,
+                     training->_validation_set != NULL ? &validation : NULL);
+  else
+    reset_error_data(training->validation_error_data);
+
+  const double start_time = get_monotonic_seconds() - progress.elapsed_seconds;
   double current_error;
-  size_t minor_improvement_cycles = 0;
-  size_t training_set_index = 0;
-  size_t epoch = 0;
-  const size_t training_set_size = ts->training_set_size;
   while (true)
   {
     reset_error_data(training->error_data);
 
-    for (training_set_index = 0; training_set_index < training_set_size; ++training_set_index)
+    if (mini_batch_size == 0)
     {
-      _feed_forward(training, nn, ts, training_set_index);
-      _process_training_data(training, nn, ts, training_set_index);
+      _train_range(training, nn, ts, 0, ts->training_set_size, partitions);
     }
-    current_error = calculate_error(training->error_data, MEAN_SQUARE);
-
-    if (fabs(best_error - current_error) < DEFAULT_MIN_IMPROVEMENT)
+    else
     {
-      ++minor_improvement_cycles;
-      if (minor_improvement_cycles > DEFAULT_CYCLES_OVER_DEFAULT_MIN_IMPROVEMENT)
+      if (shuffle)
+        _shuffle_training_set(&view, order, &progress.shuffle_state);
+
+      size_t first_index, last_index;
+      for (first_index = 0; first_index < view.training_set_size; first_index = last_index)
       {
-        best_error = fmin(current_error, best_error);
-        printf("Training finished at epoch %d.\n", epoch);
-        break;
+        last_index = _min(first_index + update_size, view.training_set_size);
+        _train_range(training, nn, &view, first_index, last_index, partitions);
+        (*propagation_loop) (propagation_data, nn, training);
       }
+    }
+    current_error = calculate_error(training->error_data, MEAN_SQUARE);
+
+    const training_stopping_policy_t* const policy = &training->_stopping_policy;
+    const double min_improvement = policy->is_min_improvement_relative ? policy->min_improvement * progress.best_error
+                                                                       : policy->min_improvement;
+    bool is_finished = false;
+    if (fabs(progress.best_error - current_error) < min_improvement)
+    {
+      ++progress.minor_improvement_cycles;
+      if (policy->improvement_window != 0 && progress.minor_improvement_cycles > policy->improvement_window)
+        is_finished = true;
     } else {
-      minor_improvement_cycles = 0;
+      progress.minor_improvement_cycles = 0;
     }
+    if (policy->target_error > 0.0 && current_error <= policy->target_error)
+      is_finished = true;
+    if (policy->max_epochs != 0 && progress.epoch + 1 >= policy->max_epochs)
+      is_finished = true;
+    if (policy->time_limit > 0.0 && get_monotonic_seconds() - start_time >= policy->time_limit)
+      is_finished = true;
+    if (training->_validation_set != NULL && progress.epoch % training->_validation_interval == 0
+        && _run_validation(&validation, nn))
+      is_finished = true;
 
-    best_error = fmin(current_error, best_error);
-    if (print_every_x_epoch != 0 && epoch % print_every_x_epoch == 0)
+    progress.best_error = fmin(current_error, progress.best_error);
+    if (is_finished)
     {
-      printf("Epoch: %d, ", epoch);
+      printf("Training finished at epoch %zu.\n", progress.epoch);
+      break;
+    }
+
+    if (print_every_x_epoch != 0 && progress.epoch % print_every_x_epoch == 0)
+    {
+      printf("Epoch: %zu, ", progress.epoch);
       printf("Current error: %g\n", current_error);
     }
 #ifdef CANN_DEBUG
     printf("\n");
 #endif
-    (*propagation_loop) (propagation_data, nn, training);
+    if (mini_batch_size == 0)
+      (*propagation_loop) (propagation_data, nn, training);
 #ifdef CANN_DEBUG
     getchar();
 #endif
-    ++epoch;
+    ++progress.epoch;
+
+    if (training->_checkpoint_path != NULL && progress.epoch % training->_checkpoint_interval == 0)
+    {
+      progress.elapsed_seconds = get_monotonic_seconds() - start_time;
+      _save_checkpoint(training, nn, &progress, ts->training_set_size, order,
+                       training->_validation_set != NULL ? &validation : NULL, propagation_data);
+    }
+  }
+
+  if (training->_validation_set != NULL)
+  {
+    _join_validation(&validation);
+    if (validation.has_best_weights)
+      memcpy(nn->weights, validation.best_weights, nn->weights_size * sizeof(real_t));
+    _destruct_validation(&validation);
+  }
+
+  if (shuffle)
+  {
+    // FREE: view.target_inputs, view.target_outputs, order
+    free_and_null(view.target_inputs);
+    free_and_null(view.target_outputs);
+    free_and_null(order);
   }
-  return best_error;
+  _destruct_partitions(partitions, num_partitions);
+  return progress.best_error;
+}
+
+void
+compute_training_gradients (const training_t*       training,
+                            const neural_network_t* nn,
+                            const training_set_t*   ts)
+{
+  size_t num_partitions;
+  training_partition_t* const partitions = _construct_partitions(training, nn, ts->training_set_size, &num_partitions);
+  memset(training->gradients, 0, nn->weights_size * sizeof(double));
+  reset_error_data(training->error_data);
+  _train_range(training, nn, ts, 0, ts->training_set_size, partitions);
+  _destruct_partitions(partitions, num_partitions);
+}
+
+double
+train_neural_network (const training_t*       training,
+                      const neural_network_t* nn,
+                      const training_set_t*   ts,
+                      void                    (*propagation_loop) (void*,
+                                                                   const neural_network_t*,
+                                                                   const training_t*),
+
+                      void* const             propagation_data,
+                      const size_t            print_every_x_epoch)
+{
+  return _train(training, nn, ts, propagation_loop, propagation_data, 0, false, print_every_x_epoch);
+}
+
+double
+train_neural_network_in_mini_batches (const training_t*       training,
+                                      const neural_network_t* nn,
+                                      const training_set_t*   ts,
+                                      void                    (*propagation_loop) (void*,
+                                                                                   const neural_network_t*,
+                                                                                   const training_t*),
+
+                                      void* const             propagation_data,
+                                      const size_t            mini_batch_size,
+                                      const bool              shuffle,
+                                      const size_t            print_every_x_epoch)
+{
+  if (mini_batch_size == 0)
+    putserr_and_exit("The mini-batch size must be at least 1.");
+
+  return _train(training, nn, ts, propagation_loop, propagation_data, mini_batch_size, shuffle, print_every_x_epoch);
 }
@@ -7,10 +7,13 @@
 #define TRAINING_H_D7CB23D4_F49B_11E1_850E_303D6188709B
 
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
 
 #include "training-set.h"
 #include "error-data.h"
 #include "neural-network.h"
+#include "activation-functions.h"
 
 /*!
   The minimum improvement this training should have over \b DEFAULT_CYCLES_OVER_DEFAULT_MIN_IMPROVEMENT epoches
@@ -21,31 +24,163 @@
   */
 #define DEFAULT_CYCLES_OVER_DEFAULT_MIN_IMPROVEMENT 100
 
+/*!
+  The default number of training samples fed through the network at once. See set_training_batch_size().
+  */
+#define DEFAULT_TRAINING_BATCH_SIZE 32
+
+/*!
+  The default seed of the generator that shuffles the training set. See set_training_shuffle_seed().
+  */
+#define DEFAULT_TRAINING_SHUFFLE_SEED 0x853C49E6748FEA9BULL
+
+/*!
+  train_neural_network() splits the training set in at most this many partitions, whose
+  gradients are accumulated separately and merged at the end of every epoch. It bounds
+  the number of threads an epoch can use, and the number of gradient buffers allocated.
+  */
+#define TRAINING_MAX_PARTITIONS 64
+
+/*!
+  The minimum number of samples in a partition, so that small training sets are not
+  split in partitions too small to be worth a thread and a gradient buffer.
+  */
+#define TRAINING_MIN_PARTITION_SIZE 256
+
+/*!
+  The version of the checkpoint files written by train_neural_network(), see
+  set_training_checkpoint(). Files of other versions are refused.
+  */
+#define TRAINING_CHECKPOINT_VERSION 1
+
+/*!
+  The suffix of the file a checkpoint is written to before it replaces the previous one.
+  */
+#define TRAINING_CHECKPOINT_TEMPORARY_SUFFIX ".tmp"
+
+/*!
+  When train_neural_network() and train_neural_network_in_mini_batches() stop, see
+  set_training_stopping_policy(). Every criterion set to 0 is disabled, and the training
+  stops at the end of the first epoch that meets any of the others.
+  */
+struct training_stopping_policy_t
+{
+  /*!
+    The maximum number of epochs.
+    */
+  size_t            max_epochs;
+  /*!
+    The mean square error at or below which the training stops.
+    */
+  double            target_error;
+  /*!
+    The wall-clock time, in seconds from the start of the training, after which it stops.
+    The epoch that runs over it is finished first.
+    */
+  double            time_limit;
+  /*!
+    The smallest change of the error from the best error so far that counts as an improvement.
+    */
+  double            min_improvement;
+  /*!
+    Set this to true to make \link min_improvement min_improvement a fraction of the best error
+    so far instead of an absolute change.
+    */
+  bool              is_min_improvement_relative;
+  /*!
+    The training stops after more than this many epochs in a row whose error is within
+    \b min_improvement of the best error so far, on either side.
+    */
+  size_t            improvement_window;
+};
+
+typedef struct training_stopping_policy_t training_stopping_policy_t;
+
+/*!
+  The training_worker_t \b struct.
+
+  The buffers one thread of train_neural_network() works in, and the gradients and
+  errors of the partition it is processing.
+  */
+struct training_worker_t
+{
+  real_t**          _post_activated_sums;
+  real_t**          _pre_activated_sums;
+  real_t**          _deltas;
+  double*           _gradients;
+  error_data_t*     _error_data;
+};
+
+typedef struct training_worker_t training_worker_t;
+
+struct training_t;
+
+/*!
+  Back-propagates a batch of samples that has just been fed forward, see training.c.
+  */
+typedef void (*process_training_data_function_t) (const struct training_t* training,
+                                                  training_worker_t*       worker,
+                                                  const neural_network_t*  nn,
+                                                  const training_set_t*    ts,
+                                                  const size_t             first_index,
+                                                  const size_t             batch_size);
+
+/*!
+  Saves or loads the state of a propagation loop to or from a checkpoint file, see
+  set_training_checkpoint() and resume_training_from_checkpoint(), eg.
+  save_resilient_propagation_data() and load_resilient_propagation_data().
+  \param fp the checkpoint file, positioned where the state goes.
+  \param propagation_data the data of the propagation loop.
+  \param nn the associated neural_network_t instance.
+  */
+typedef void (*training_checkpoint_function_t) (FILE*                   fp,
+                                                void*                   propagation_data,
+                                                const neural_network_t* nn);
+
+struct training_resume_t;
+
 /*!
   The training_t \b struct
   */
 struct training_t
 {
-  double**          _post_activated_sums;
-  double**          _pre_activated_sums;
-  double**          _deltas;
+  size_t            _batch_size;
+  size_t            _num_threads;
+  uint64_t          _shuffle_seed;
+  training_stopping_policy_t _stopping_policy;
+  const training_set_t* _validation_set;
+  size_t            _validation_interval;
+  size_t            _validation_patience;
+  bool              _is_validation_in_background;
+  char*             _checkpoint_path;
+  size_t            _checkpoint_interval;
+  training_checkpoint_function_t _save_propagation_data;
+  struct training_resume_t* _resume;
+  training_worker_t* _workers;
   /*!
-    The gradients for this current training epoch.
+    The gradients for this current training epoch, laid out like neural_network_t::weights.
     */
-  double***         gradients;
+  double*           gradients;
   /*!
-    The gradients for the previous training epoch.
+    The gradients for the previous training epoch, laid out like neural_network_t::weights.
     */
-  double***         previous_gradients;
+  double*           previous_gradients;
   /*!
     The pointer to an associated error_data_t instance (for error tracking)
     */
   error_data_t*     error_data;
+  /*!
+    The errors of the best weights on the validation set of the last training, if any,
+    see set_training_validation().
+    */
+  error_data_t*     validation_error_data;
   double            (*_activation_function) (const double);
 
   double            (*_derivative_function) (const double,
                                              const double);
+  activation_array_function_t _activation_array_function;
   bool              _fix_flat_spot;
+  process_training_data_function_t _process_training_data;
 };
 
 typedef struct training_t training_t;
@@ -58,6 +193,12 @@ typedef struct training_t training_t;
   \param fix_flat_spot set this to true if you are using a sigmoid activation function.
          Sigmoid activation function are susceptible to the flat-spot problem.
   \return a new training_t instance.
+
+  The functions defined in activation-functions.h are applied a whole layer at a time,
+  through their array forms, and their derivatives are inlined into back-propagation
+  loops specialized for them and for \b fix_flat_spot. Other functions are called once per neuron. To trade some
+  accuracy for speed, pass fast_tanh_activation() or lookup_tanh_activation() instead
+  of tanh_activation(), and likewise for sigmoid_activation().
   */
 training_t*
 construct_training (const neural_network_t* nn,
@@ -76,11 +217,170 @@ destruct_training(training_t*             training,
                   const neural_network_t* nn);
 
 /*!
-  Trains the associated neural_network_t instance, with the training set instance training_set_t.
+  Sets the number of training samples that train_neural_network() feeds through the network at once.
+
+  Each batch is processed as blocked matrix-matrix products, which reuses every weight
+  block across the samples of the batch. The accumulated gradients are bitwise identical
+  for every batch size; only the memory access pattern changes.
+
+  \param training the training_t instance to configure.
+  \param nn the associated neural_network_t instance to derive essential data from.
+  \param batch_size the number of samples per batch, at least 1.
+  */
+void
+set_training_batch_size (training_t*             training,
+                         const neural_network_t* nn,
+                         const size_t            batch_size);
+
+/*!
+  Sets the number of threads that train_neural_network() splits every epoch across.
+
+  The training set is split in up to \b TRAINING_MAX_PARTITIONS partitions of at least
+  \b TRAINING_MIN_PARTITION_SIZE samples, which only depend on its size. The threads
+  take the partitions in any order, and accumulate the gradients and errors of each
+  one separately. They are summed as a pairwise tree in partition order before the
+  propagation loop runs, so that training is bitwise reproducible for every number of
+  threads. The threads come from get_shared_thread_pool(), which bounds their number.
+  The default is 1 thread.
+
+  \param training the training_t instance to configure.
+  \param nn the associated neural_network_t instance to derive essential data from.
+  \param num_threads the number of threads, or 0 to use every processor.
+  */
+void
+set_training_num_threads (training_t*             training,
+                          const neural_network_t* nn,
+                          const size_t            num_threads);
+
+/*!
+  Gets the number of threads set by set_training_num_threads(), which the propagation
+  loops may use too.
+  \param training the training_t instance.
+  \return the number of threads.
+  */
+size_t
+get_training_num_threads (const training_t* training);
+
+/*!
+  Sets the seed of the generator that shuffles the training set before every epoch of
+  train_neural_network_in_mini_batches(). Every call of it starts again from the seed,
+  so that the same seed and initial weights give the same training.
+  \param training the training_t instance to configure.
+  \param seed the seed, \b DEFAULT_TRAINING_SHUFFLE_SEED by default.
+  */
+void
+set_training_shuffle_seed (training_t*    training,
+                           const uint64_t seed);
+
+/*!
+  Gets the default stopping policy: the training stops after more than
+  \b DEFAULT_CYCLES_OVER_DEFAULT_MIN_IMPROVEMENT epochs in a row whose error is within
+  \b DEFAULT_MIN_IMPROVEMENT of the best error so far, with no other limit.
+  \return the default stopping policy, to be modified and given to set_training_stopping_policy().
+  */
+training_stopping_policy_t
+get_default_training_stopping_policy ();
+
+/*!
+  Sets when train_neural_network() and train_neural_network_in_mini_batches() stop.
+  \param training the training_t instance to configure.
+  \param policy the stopping policy, which is copied. It must enable at least one criterion.
+  */
+void
+set_training_stopping_policy (training_t*                       training,
+                              const training_stopping_policy_t* policy);
+
+/*!
+  Sets a validation set for train_neural_network() and train_neural_network_in_mini_batches()
+  to stop early on, before the network overfits the training set.
+
+  Every \b validate_every_x_epoch epochs, starting with the first one, the weights are fed
+  forward through the validation set without back-propagation. The weights with the lowest
+  mean square validation error are kept aside, and restored into the neural network when
+  the training stops, with their errors in training_t::validation_error_data. The training
+  stops when the stopping policy says so, or after \b patience validations in a row without
+  a lower validation error.
+
+  In the background mode, a snapshot of the weights is validated by a thread of
+  get_shared_thread_pool() while the training goes on, and its result is only taken at the
+  next validation. The training then stops one validation interval later than it would
+  otherwise, with the same best weights.
+
+  \param training the training_t instance to configure.
+  \param nn the associated neural_network_t instance to derive essential data from.
+  \param validation_set the validation set, which must outlive the training, or NULL to
+         not validate.
+  \param validate_every_x_epoch the number of epochs between validations, at least 1.
+  \param patience the number of validations without improvement to stop after, or 0 to
+         only keep the best weights.
+  \param is_in_background set this to true to validate in the background.
+  */
+void
+set_training_validation (training_t*             training,
+                         const neural_network_t* nn,
+                         const training_set_t*   validation_set,
+                         const size_t            validate_every_x_epoch,
+                         const size_t            patience,
+                         const bool              is_in_background);
+
+/*!
+  Makes train_neural_network() and train_neural_network_in_mini_batches() save a checkpoint
+  after every \b checkpoint_every_x_epoch epochs, to resume the training from with
+  resume_training_from_checkpoint() if it is interrupted.
+
+  A checkpoint holds the weights, the gradients and errors of the training_t instance, the
+  progress of the training towards its stopping policy, the order of the shuffled training
+  set, the state of the validation, and the state of the propagation loop saved by
+  \b save_propagation_data. It is written to \b path with the suffix
+  \b TRAINING_CHECKPOINT_TEMPORARY_SUFFIX, and then renamed to \b path, so that \b path
+  always holds a whole checkpoint. The file is in the byte order and precision of this
+  machine.
+
+  \param training the training_t instance to configure.
+  \param path the path of the checkpoint file, which is overwritten by every checkpoint,
+         or NULL to not save checkpoints.
+  \param checkpoint_every_x_epoch the number of epochs between checkpoints, at least 1.
+  \param save_propagation_data the function that saves the state of the propagation loop,
+         or NULL if it has none.
+  */
+void
+set_training_checkpoint (training_t*                    training,
+                         const char*                    path,
+                         const size_t                   checkpoint_every_x_epoch,
+                         training_checkpoint_function_t save_propagation_data);
+
+/*!
+  Loads a checkpoint saved by train_neural_network() or train_neural_network_in_mini_batches()
+  into a neural network, a training_t instance and the data of a propagation loop. The next
+  training with them continues from the epoch after the checkpoint, exactly as the training
+  that saved it did, provided that it is called with the same training set, propagation loop,
+  settings and validation set.
+
+  This function will exit if the checkpoint does not match the neural network or
+  \b load_propagation_data.
+
+  \param training the training_t instance to load into.
+  \param nn the neural_network_t instance to load the weights into, with the topology of
+         the neural network that was trained.
+  \param path the path of the checkpoint file.
+  \param load_propagation_data the function that loads the state of the propagation loop,
+         or NULL if it has none.
+  \param propagation_data the data of the propagation loop to load into.
+  */
+void
+resume_training_from_checkpoint (training_t*                    training,
+                                 const neural_network_t*        nn,
+                                 const char*                    path,
+                                 training_checkpoint_function_t load_propagation_data,
+                                 void*                          propagation_data);
+
+/*!
+  Trains the associated neural_network_t instance, with the training set instance training_set_t,
+  until the stopping policy of \b training is met, see set_training_stopping_policy().
   \param training the training_t instance to associate with.
   \param nn the neural_network_t instance to train
   \param ts the training_set_t instance to derive data from and train.
-  \param propagation_loop the propagation function. Currently only resilient_propagation_loop() is supported.
+  \param propagation_loop the propagation function, eg. resilient_propagation_loop().
   \param propagation_data the data associated with the propagation function to be passed along.
   \param print_every_x_epoch print a message every x epoch. If this value is 0, then no messages are printed.
   \return the final error rate for this training session.
@@ -95,4 +395,56 @@ train_neural_network (const training_t*       training,
 
                       void* const             propagation_data,
                       const size_t            print_every_x_epoch);
+
+/*!
+  Feeds a whole training set forward and back at the current weights, as an epoch of
+  train_neural_network() does, replacing training_t::gradients and training_t::error_data
+  with its gradients and errors. The results are those the epoch would get, bit for bit.
+
+  This is for propagation loops that evaluate other weights than those they keep, eg.
+  scaled_conjugate_gradient_loop(), so that every epoch ends on weights it has evaluated.
+
+  \param training the training_t instance of the training.
+  \param nn the neural_network_t instance, at the weights to evaluate.
+  \param ts the training_set_t instance to evaluate on.
+  */
+void
+compute_training_gradients (const training_t*       training,
+                            const neural_network_t* nn,
+                            const training_set_t*   ts);
+
+/*!
+  Trains a neural network like train_neural_network(), but calls \b propagation_loop after
+  every \b mini_batch_size samples instead of once per epoch, so that the weights are
+  updated many times per epoch. Each mini-batch is fed forward and back with the threads
+  and partitions of train_neural_network(), so its gradients are reproducible too.
+
+  training_t::gradients holds the sum of the gradients of the mini-batch when the loop is
+  called; the loop must clear it. training_t::error_data accumulates over the whole epoch,
+  with the weights changing as it goes.
+
+  \param training the training_t instance to train with.
+  \param nn the neural_network_t instance to train.
+  \param ts the training_set_t instance to train from. It is not modified.
+  \param propagation_loop the propagation loop, eg. stochastic_gradient_descent_loop().
+  \param propagation_data the data of \b propagation_loop.
+  \param mini_batch_size the number of samples per update, at least 1. The last mini-batch
+         of an epoch holds the remaining samples.
+  \param shuffle set this to true to visit the samples in a new random order every epoch,
+         see set_training_shuffle_seed().
+  \param print_every_x_epoch print the error every this many epochs, or 0 to never print it.
+  \return the best error of the training.
+  */
+double
+train_neural_network_in_mini_batches (const training_t*       training,
+                                      const neural_network_t* nn,
+                                      const training_set_t*   ts,
+                                      void                    (*propagation_loop) (void*,
+                                                                                   const neural_network_t*,
+                                                                                   const training_t*),
+
+                                      void* const             propagation_data,
+                                      const size_t            mini_batch_size,
+                                      const bool              shuffle,
+                                      const size_t            print_every_x_epoch);
 #endif
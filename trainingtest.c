@@ -0,0 +1,987 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <float.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "util/util.h"
+#include "libcsv/csv.h"
+#include "neural-network.h"
+#include "training.h"
+#include "activation-functions.h"
+#include "resilient-propagation.h"
+#include "stochastic-gradient-descent.h"
+#include "adaptive-moment-estimation.h"
+#include "levenberg-marquardt.h"
+#include "scaled-conjugate-gradient.h"
+#include "time-series.h"
+#include "prediction.h"
+#include "batch-prediction.h"
+#include "neural-network-model.h"
+#include "util/thread-pool.h"
+
+#define TRAINING_TEST_INPUT_PATH "trainingtest.in"
+#define TRAINING_TEST_OUTPUT_PATH "trainingtest.out"
+#define TRAINING_TEST_CHECKPOINT_PATH "trainingtest.checkpoint"
+#define TRAINING_TEST_MODEL_PATH "trainingtest.model"
+#define TRAINING_TEST_PREDICTION_INPUT_PATH "trainingtest.inputs"
+#define TRAINING_TEST_PREDICTION_PATH "trainingtest.predictions"
+#define TRAINING_TEST_PREDICTION_ROWS (3 * BATCH_PREDICTION_BLOCK_SIZE + 5)
+#define TRAINING_TEST_LARGE_INPUT_PATH "trainingtest.large.in"
+#define TRAINING_TEST_LARGE_OUTPUT_PATH "trainingtest.large.out"
+#define TRAINING_TEST_MALFORMED_PATH "trainingtest.malformed"
+#define TRAINING_TEST_QUOTED_CSV_PATH "trainingtest.quoted.csv"
+#define TRAINING_TEST_QUOTED_CSV_LINES 160000
+#define TRAINING_TEST_LARGE_LINES 40000
+#define TRAINING_TEST_LARGE_INPUT_SIZE 8
+#define TRAINING_TEST_LARGE_OUTPUT_SIZE 3
+#define TRAINING_TEST_UPDATES 20
+#define TRAINING_TEST_LEVENBERG_MARQUARDT_UPDATES 3
+#define TRAINING_TEST_MINI_BATCH_SIZE 1024
+#define TRAINING_TEST_WEIGHT_DECAY 0.01
+#define TRAINING_TEST_VALIDATION_INTERVAL 3
+#define TRAINING_TEST_CHECKPOINT_INTERVAL 5
+#define TRAINING_TEST_INTERRUPTED_EPOCHS 8
+#define TRAINING_TEST_MAX_EPOCHS 19
+#define TRAINING_TEST_ACTIVATION_SAMPLES 400001
+#define TRAINING_TEST_ACTIVATION_RANGE 20.0
+#ifdef CANN_SINGLE_PRECISION
+  #define TRAINING_TEST_REAL_EPSILON FLT_EPSILON
+  #define TRAINING_TEST_FAST_TANH_MAX_ERROR 3e-7
+  #define TRAINING_TEST_FAST_SIGMOID_MAX_ERROR 2e-7
+#else
+  #define TRAINING_TEST_REAL_EPSILON DBL_EPSILON
+  #define TRAINING_TEST_FAST_TANH_MAX_ERROR 5e-16
+  #define TRAINING_TEST_FAST_SIGMOID_MAX_ERROR 3e-16
+#endif
+#define TRAINING_TEST_LOOKUP_TANH_MAX_ERROR 7e-6
+#define TRAINING_TEST_LOOKUP_SIGMOID_MAX_ERROR 1e-6
+
+struct training_test_data_t
+{
+  void                          (*propagation_loop) (void*,
+                                                     const neural_network_t*,
+                                                     const training_t*);
+  void*                         propagation_data;
+  size_t                        num_updates;
+  size_t                        max_updates;
+};
+
+typedef struct training_test_data_t training_test_data_t;
+
+/*
+  Runs a fixed number of updates, then leaves the weights alone so that the training
+  stops once the error stays the same.
+  */
+static void
+_training_test_loop (void*                   training_test_data,
+                     const neural_network_t* nn,
+                     const training_t*       training)
+{
+  training_test_data_t* data = (training_test_data_t*) training_test_data;
+  if (data->num_updates < data->max_updates)
+  {
+    (*data->propagation_loop) (data->propagation_data, nn, training);
+  }
+  else
+  {
+    memset(training->gradients, 0, nn->weights_size * sizeof(double));
+  }
+  ++data->num_updates;
+}
+
+/*
+  Saves the number of updates of a training_test_data_t instance and the resilient
+  propagation data it wraps to a checkpoint.
+  */
+static void
+_save_training_test_data (FILE*                   fp,
+                          void*                   training_test_data,
+                          const neural_network_t* nn)
+{
+  training_test_data_t* data = (training_test_data_t*) training_test_data;
+  fwrite_exit_if_failed(&data->num_updates, sizeof(size_t), 1, fp);
+  save_resilient_propagation_data(fp, data->propagation_data, nn);
+}
+
+static void
+_load_training_test_data (FILE*                   fp,
+                          void*                   training_test_data,
+                          const neural_network_t* nn)
+{
+  training_test_data_t* data = (training_test_data_t*) training_test_data;
+  fread_exit_if_failed(&data->num_updates, sizeof(size_t), 1, fp);
+  load_resilient_propagation_data(fp, data->propagation_data, nn);
+}
+
+static double
+_train (const neural_network_t* initial_nn,
+        const training_set_t*   ts,
+        const size_t            num_threads,
+        const size_t            algorithm,
+        real_t*           const weights)
+{
+  neural_network_t* nn = construct_neural_network(initial_nn->config, initial_nn->config_size, -2.0, 2.0,
+                                                  &initialize_uniform_weights);
+  memcpy(nn->weights, initial_nn->weights, nn->weights_size * sizeof(real_t));
+  training_t* training = construct_training(nn, &elliott_activation, &elliott_derivative, false);
+  set_training_num_threads(training, nn, num_threads);
+  training_test_data_t data;
+  data.num_updates = 0;
+  data.max_updates = TRAINING_TEST_UPDATES;
+  double error;
+  if (algorithm == 1)
+  {
+    stochastic_gradient_descent_data_t* sgd_data =
+      construct_stochastic_gradient_descent_data(nn, 0.01 / TRAINING_TEST_MINI_BATCH_SIZE, 0.9, true);
+    data.propagation_loop = &stochastic_gradient_descent_loop;
+    data.propagation_data = sgd_data;
+    error = train_neural_network_in_mini_batches(training, nn, ts, &_training_test_loop, &data,
+                                                 TRAINING_TEST_MINI_BATCH_SIZE, true, 0);
+    destruct_stochastic_gradient_descent_data(sgd_data, nn);
+  }
+  else if (algorithm == 2)
+  {
+    levenberg_marquardt_data_t* lm_data = construct_levenberg_marquardt_data(nn, ts);
+    data.propagation_loop = &levenberg_marquardt_loop;
+    data.propagation_data = lm_data;
+    data.max_updates = TRAINING_TEST_LEVENBERG_MARQUARDT_UPDATES;
+    error = train_neural_network(training, nn, ts, &_training_test_loop, &data, 0);
+    destruct_levenberg_marquardt_data(lm_data, nn);
+  }
+  else if (algorithm == 3)
+  {
+    scaled_conjugate_gradient_data_t* scg_data = construct_scaled_conjugate_gradient_data(nn, ts);
+    data.propagation_loop = &scaled_conjugate_gradient_loop;
+    data.propagation_data = scg_data;
+    error = train_neural_network(training, nn, ts, &_training_test_loop, &data, 0);
+    destruct_scaled_conjugate_gradient_data(scg_data, nn);
+  }
+  else if (algorithm == 4 || algorithm == 5)
+  {
+    adaptive_moment_estimation_data_t* adam_data =
+      construct_adaptive_moment_estimation_data(nn, ADAM_DEFAULT_LEARNING_RATE,
+                                                algorithm == 5 ? TRAINING_TEST_WEIGHT_DECAY : 0.0);
+    data.propagation_loop = &adaptive_moment_estimation_loop;
+    data.propagation_data = adam_data;
+    error = train_neural_network_in_mini_batches(training, nn, ts, &_training_test_loop, &data,
+                                                 TRAINING_TEST_MINI_BATCH_SIZE, true, 0);
+    destruct_adaptive_moment_estimation_data(adam_data, nn);
+  }
+  else
+  {
+    resilient_propagation_data_t* rprop_data = construct_resilient_propagation_data(nn);
+    data.propagation_loop = &resilient_propagation_loop;
+    data.propagation_data = rprop_data;
+    error = train_neural_network(training, nn, ts, &_training_test_loop, &data, 0);
+    destruct_resilient_propagation_data(rprop_data, nn);
+  }
+  memcpy(weights, nn->weights, nn->weights_size * sizeof(real_t));
+
+  destruct_training(training, nn);
+  destruct_neural_network(nn);
+  return error;
+}
+
+/*
+  Computes the error of the weights of a neural network on a training set, with a training
+  that stops after its first epoch, before it updates them.
+  */
+static double
+_evaluate (const neural_network_t* nn,
+           const training_set_t*   ts)
+{
+  training_t* training = construct_training(nn, &elliott_activation, &elliott_derivative, false);
+  training_stopping_policy_t policy = get_default_training_stopping_policy();
+  policy.max_epochs = 1;
+  set_training_stopping_policy(training, &policy);
+  training_test_data_t data;
+  data.num_updates = 0;
+  data.max_updates = 0;
+  const double error = train_neural_network(training, nn, ts, &_training_test_loop, &data, 0);
+
+  destruct_training(training, nn);
+  return error;
+}
+
+/*
+  Trains with scaled conjugate gradient or Levenberg-Marquardt for every number of epochs
+  up to \b max_epochs, and checks that the returned error is that of the weights left in
+  the neural network.
+  */
+static bool
+_is_error_of_final_weights (const neural_network_t* initial_nn,
+                            const training_set_t*   ts,
+                            const size_t            algorithm,
+                            const size_t            max_epochs)
+{
+  bool is_error_of_final_weights = true;
+  size_t epochs;
+  for (epochs = 1; epochs <= max_epochs; ++epochs)
+  {
+    neural_network_t* nn = construct_neural_network(initial_nn->config, initial_nn->config_size, -2.0, 2.0,
+                                                    &initialize_uniform_weights);
+    memcpy(nn->weights, initial_nn->weights, nn->weights_size * sizeof(real_t));
+    training_t* training = construct_training(nn, &elliott_activation, &elliott_derivative, false);
+    training_stopping_policy_t policy = get_default_training_stopping_policy();
+    policy.max_epochs = epochs;
+    set_training_stopping_policy(training, &policy);
+    double error;
+    if (algorithm == 2)
+    {
+      levenberg_marquardt_data_t* lm_data = construct_levenberg_marquardt_data(nn, ts);
+      error = train_neural_network(training, nn, ts, &levenberg_marquardt_loop, lm_data, 0);
+      destruct_levenberg_marquardt_data(lm_data, nn);
+    }
+    else
+    {
+      scaled_conjugate_gradient_data_t* scg_data = construct_scaled_conjugate_gradient_data(nn, ts);
+      error = train_neural_network(training, nn, ts, &scaled_conjugate_gradient_loop, scg_data, 0);
+      destruct_scaled_conjugate_gradient_data(scg_data, nn);
+    }
+    is_error_of_final_weights = is_error_of_final_weights && error == _evaluate(nn, ts);
+
+    destruct_training(training, nn);
+    destruct_neural_network(nn);
+  }
+  return is_error_of_final_weights;
+}
+
+/*
+  Takes the first Adam or AdamW step from a neural network and checks that the bias
+  correction makes it move each weight by about learning_rate in the direction of its
+  gradient, after the weight decay.
+  */
+static bool
+_is_first_adam_step_exact (const neural_network_t* initial_nn,
+                           const training_set_t*   ts,
+                           const double            weight_decay)
+{
+  neural_network_t* nn = construct_neural_network(initial_nn->config, initial_nn->config_size, -2.0, 2.0,
+                                                  &initialize_uniform_weights);
+  memcpy(nn->weights, initial_nn->weights, nn->weights_size * sizeof(real_t));
+  training_t* training = construct_training(nn, &elliott_activation, &elliott_derivative, false);
+  adaptive_moment_estimation_data_t* adam_data =
+    construct_adaptive_moment_estimation_data(nn, ADAM_DEFAULT_LEARNING_RATE, weight_decay);
+  double* gradients = malloc_exit_if_null(nn->weights_size * sizeof(double));
+  compute_training_gradients(training, nn, ts);
+  memcpy(gradients, training->gradients, nn->weights_size * sizeof(double));
+  adaptive_moment_estimation_loop(adam_data, nn, training);
+
+  bool is_exact = true;
+  size_t wi;
+  for (wi = 0; is_exact && wi < nn->weights_size; ++wi)
+  {
+    // Far from epsilon, the corrected moments cancel down to the sign of the gradient.
+    const double direction = fabs(gradients[wi]) < 1e-6 ? 0.0 : gradients[wi] > 0 ? 1.0 : -1.0;
+    const double expected = (1.0 - ADAM_DEFAULT_LEARNING_RATE * weight_decay) * initial_nn->weights[wi]
+                            + ADAM_DEFAULT_LEARNING_RATE * direction;
+    is_exact = direction == 0.0 || fabs(nn->weights[wi] - expected) < 0.01 * ADAM_DEFAULT_LEARNING_RATE;
+  }
+
+  free_and_null(gradients);
+  destruct_adaptive_moment_estimation_data(adam_data, nn);
+  destruct_training(training, nn);
+  destruct_neural_network(nn);
+  return is_exact;
+}
+
+/*
+  Trains with resilient propagation, validating every TRAINING_TEST_VALIDATION_INTERVAL epochs,
+  and returns the validation error of the best weights.
+  */
+static double
+_train_with_validation (const neural_network_t* initial_nn,
+                        const training_set_t*   ts,
+                        const training_set_t*   vs,
+                        const bool              is_in_background,
+                        real_t*           const weights)
+{
+  neural_network_t* nn = construct_neural_network(initial_nn->config, initial_nn->config_size, -2.0, 2.0,
+                                                  &initialize_uniform_weights);
+  memcpy(nn->weights, initial_nn->weights, nn->weights_size * sizeof(real_t));
+  training_t* training = construct_training(nn, &elliott_activation, &elliott_derivative, false);
+  set_training_num_threads(training, nn, 0);
+  set_training_validation(training, nn, vs, TRAINING_TEST_VALIDATION_INTERVAL, 0, is_in_background);
+  resilient_propagation_data_t* rprop_data = construct_resilient_propagation_data(nn);
+  training_test_data_t data;
+  data.propagation_loop = &resilient_propagation_loop;
+  data.propagation_data = rprop_data;
+  data.num_updates = 0;
+  data.max_updates = TRAINING_TEST_UPDATES;
+  train_neural_network(training, nn, ts, &_training_test_loop, &data, 0);
+  const double error = calculate_error(training->validation_error_data, MEAN_SQUARE);
+  memcpy(weights, nn->weights, nn->weights_size * sizeof(real_t));
+
+  destruct_resilient_propagation_data(rprop_data, nn);
+  destruct_training(training, nn);
+  destruct_neural_network(nn);
+  return error;
+}
+
+/*
+  Trains with resilient propagation on shuffled mini-batches with a background validation,
+  either to the end, or until it is interrupted a few epochs after saving a checkpoint,
+  or to the end again from that checkpoint. Returns the best training error.
+  */
+static double
+_train_with_checkpoint (const neural_network_t* initial_nn,
+                        const training_set_t*   ts,
+                        const training_set_t*   vs,
+                        const bool              is_interrupted,
+                        const bool              is_resuming,
+                        real_t*           const weights)
+{
+  neural_network_t* nn = construct_neural_network(initial_nn->config, initial_nn->config_size, -2.0, 2.0,
+                                                  &initialize_uniform_weights);
+  memcpy(nn->weights, initial_nn->weights, nn->weights_size * sizeof(real_t));
+  training_t* training = construct_training(nn, &elliott_activation, &elliott_derivative, false);
+  set_training_num_threads(training, nn, 0);
+  set_training_validation(training, nn, vs, TRAINING_TEST_VALIDATION_INTERVAL, 0, true);
+  resilient_propagation_data_t* rprop_data = construct_resilient_propagation_data(nn);
+  training_test_data_t data;
+  data.propagation_loop = &resilient_propagation_loop;
+  data.propagation_data = rprop_data;
+  data.num_updates = 0;
+  data.max_updates = TRAINING_TEST_UPDATES;
+  if (is_interrupted)
+  {
+    training_stopping_policy_t policy = get_default_training_stopping_policy();
+    policy.max_epochs = TRAINING_TEST_INTERRUPTED_EPOCHS;
+    set_training_stopping_policy(training, &policy);
+    set_training_checkpoint(training, TRAINING_TEST_CHECKPOINT_PATH, TRAINING_TEST_CHECKPOINT_INTERVAL,
+                            &_save_training_test_data);
+  }
+  if (is_resuming)
+    resume_training_from_checkpoint(training, nn, TRAINING_TEST_CHECKPOINT_PATH, &_load_training_test_data, &data);
+  const double error = train_neural_network_in_mini_batches(training, nn, ts, &_training_test_loop, &data,
+                                                            TRAINING_TEST_MINI_BATCH_SIZE, true, 0);
+  memcpy(weights, nn->weights, nn->weights_size * sizeof(real_t));
+
+  destruct_resilient_propagation_data(rprop_data, nn);
+  destruct_training(training, nn);
+  destruct_neural_network(nn);
+  return error;
+}
+
+/*
+  Predicts every target input of a training set.
+  */
+static void
+_predict (const neural_network_t* nn,
+          const training_set_t*   ts,
+          real_t*           const inputs,
+          real_t*           const outputs)
+{
+  size_t i;
+  for (i = 0; i < ts->training_set_size; ++i)
+  {
+    memcpy(inputs + i * ts->input_size, ts->target_inputs[i], ts->input_size * sizeof(real_t));
+  }
+  prediction_workspace_t* workspace = construct_prediction_workspace(nn, &elliott_activation, ts->training_set_size);
+  predict_neural_network(nn, workspace, inputs, outputs, ts->training_set_size);
+  destruct_prediction_workspace(workspace);
+}
+
+/*
+  Saves a neural network as a model, maps it back, and checks that it has the same
+  weights and ranges, and predicts the training set exactly as the neural network does.
+  */
+static bool
+_is_model_exact (const neural_network_t* nn,
+                 const training_set_t*   ts)
+{
+  save_neural_network_model(nn, &elliott_activation, ts, TRAINING_TEST_MODEL_PATH);
+  neural_network_model_t* model = construct_neural_network_model(TRAINING_TEST_MODEL_PATH, true);
+  const size_t last = ts->output_size - 1;
+  bool is_exact = model->activation_functions->activation_function == &elliott_activation
+                  && model->nn.config_size == nn->config_size
+                  && memcmp(model->nn.config, nn->config, nn->config_size * sizeof(size_t)) == 0
+                  && model->nn.weights_size == nn->weights_size
+                  && memcmp(model->nn.weights, nn->weights, nn->weights_size * sizeof(real_t)) == 0
+                  && model->ranges != NULL
+                  && memcmp(model->ranges->input_entries_min, ts->input_entries_min, ts->input_size * sizeof(double)) == 0
+                  && memcmp(model->ranges->output_entries_max, ts->output_entries_max, ts->output_size * sizeof(double)) == 0
+                  && strcmp(model->ranges->output_entries_desc[last], ts->output_entries_desc[last]) == 0;
+
+  real_t* inputs = malloc_exit_if_null(ts->training_set_size * ts->input_size * sizeof(real_t));
+  real_t* expected_outputs = malloc_exit_if_null(ts->training_set_size * ts->output_size * sizeof(real_t));
+  real_t* outputs = malloc_exit_if_null(ts->training_set_size * ts->output_size * sizeof(real_t));
+  _predict(nn, ts, inputs, expected_outputs);
+  _predict(&model->nn, ts, inputs, outputs);
+  is_exact = is_exact && memcmp(outputs, expected_outputs, ts->training_set_size * ts->output_size * sizeof(real_t)) == 0;
+
+  free_and_null(outputs);
+  free_and_null(expected_outputs);
+  free_and_null(inputs);
+  destruct_neural_network_model(model);
+  return is_exact;
+}
+
+/*
+  Checks that a file written by the batch prediction holds a header line and, on each
+  following line, the outputs predict_neural_network() gives for one row at a time.
+  */
+static bool
+_is_prediction_file_exact (const neural_network_t* nn,
+                           const training_set_t*   ts,
+                           const char*             path)
+{
+  csv_data_t* data = construct_csv_data(path);
+  bool is_exact = data->line_count == ts->training_set_size + 1;
+  prediction_workspace_t* workspace = construct_prediction_workspace(nn, &elliott_activation, 1);
+  real_t* outputs = malloc_exit_if_null(ts->output_size * sizeof(real_t));
+  char buffer[64];
+  size_t i, j;
+  for (i = 0; is_exact && i < ts->training_set_size; ++i)
+  {
+    predict_neural_network(nn, workspace, ts->target_inputs[i], outputs, 1);
+    is_exact = data->entry_counts[i + 1] == ts->output_size;
+    for (j = 0; is_exact && j < ts->output_size; ++j)
+    {
+      sprintf(buffer, "%.9g", (double) outputs[j]);
+      is_exact = strcmp(data->data[i + 1][j], buffer) == 0;
+    }
+  }
+
+  free_and_null(outputs);
+  destruct_prediction_workspace(workspace);
+  destruct_csv_data(data);
+  return is_exact;
+}
+
+/*
+  Predicts the first rows of a training set, ending in a partial block, with
+  predict_training_set() and with predict_csv_file() on a file of the same inputs, and
+  checks both outputs row by row for each number of threads.
+  */
+static bool
+_is_batch_prediction_exact (const neural_network_t* nn,
+                            const training_set_t*   ts)
+{
+  training_set_t rows = *ts;
+  rows.training_set_size = TRAINING_TEST_PREDICTION_ROWS;
+
+  FILE* fp = fopen(TRAINING_TEST_PREDICTION_INPUT_PATH, "wb");
+  exit_if_null(fp);
+  size_t i, j;
+  for (j = 0; j < rows.input_size; ++j)
+  {
+    fprintf(fp, "Input %zu", j + 1);
+    fputc(j < rows.input_size - 1 ? ',' : '\n', fp);
+  }
+  for (i = 0; i < rows.training_set_size; ++i)
+  {
+    for (j = 0; j < rows.input_size; ++j)
+    {
+      fprintf(fp, "%.17g", (double) rows.target_inputs[i][j]);
+      fputc(j < rows.input_size - 1 ? ',' : '\n', fp);
+    }
+  }
+  fclose(fp);
+
+  const size_t num_threads[] = {1, 3, 0};
+  bool is_exact = true;
+  for (i = 0; is_exact && i < sizeof(num_threads) / sizeof(num_threads[0]); ++i)
+  {
+    predict_training_set(nn, &elliott_activation, &rows, TRAINING_TEST_PREDICTION_PATH, false, num_threads[i]);
+    is_exact = _is_prediction_file_exact(nn, &rows, TRAINING_TEST_PREDICTION_PATH);
+    predict_csv_file(nn, &elliott_activation, TRAINING_TEST_PREDICTION_INPUT_PATH, TRAINING_TEST_PREDICTION_PATH,
+                     NULL, num_threads[i]);
+    is_exact = is_exact && _is_prediction_file_exact(nn, &rows, TRAINING_TEST_PREDICTION_PATH);
+  }
+  return is_exact;
+}
+
+static const char* const activation_function_names[] =
+{
+  "elliott", "elliott_symmetric", "tanh", "sigmoid", "fast_tanh", "fast_sigmoid", "lookup_tanh", "lookup_sigmoid"
+};
+
+/*
+  Fills \b x with TRAINING_TEST_ACTIVATION_SAMPLES evenly spaced values from
+  -TRAINING_TEST_ACTIVATION_RANGE to TRAINING_TEST_ACTIVATION_RANGE.
+  */
+static void
+_sample_activation_range (real_t* const x)
+{
+  size_t i;
+  for (i = 0; i < TRAINING_TEST_ACTIVATION_SAMPLES; ++i)
+  {
+    x[i] = TRAINING_TEST_ACTIVATION_RANGE * (2.0 * i / (TRAINING_TEST_ACTIVATION_SAMPLES - 1) - 1.0);
+  }
+}
+
+/*
+  Checks that the derivative array function of every activation function gives the
+  derivatives of its scalar derivative function, up to a few rounding errors.
+  */
+static bool
+_are_derivative_arrays_exact ()
+{
+  real_t* x = malloc_exit_if_null(TRAINING_TEST_ACTIVATION_SAMPLES * sizeof(real_t));
+  real_t* y = malloc_exit_if_null(TRAINING_TEST_ACTIVATION_SAMPLES * sizeof(real_t));
+  real_t* derivatives = malloc_exit_if_null(TRAINING_TEST_ACTIVATION_SAMPLES * sizeof(real_t));
+  _sample_activation_range(x);
+  bool is_exact = true;
+  size_t i, j;
+  for (j = 0; is_exact && j < sizeof(activation_function_names) / sizeof(activation_function_names[0]); ++j)
+  {
+    const activation_functions_t* functions = find_activation_functions_by_name(activation_function_names[j]);
+    functions->activation_array_function(x, y, TRAINING_TEST_ACTIVATION_SAMPLES);
+    functions->derivative_array_function(x, y, derivatives, TRAINING_TEST_ACTIVATION_SAMPLES);
+    for (i = 0; is_exact && i < TRAINING_TEST_ACTIVATION_SAMPLES; ++i)
+    {
+      const double expected = functions->derivative_function(x[i], y[i]);
+      is_exact = fabs(derivatives[i] - expected) <= 4 * TRAINING_TEST_REAL_EPSILON;
+    }
+  }
+
+  free_and_null(derivatives);
+  free_and_null(y);
+  free_and_null(x);
+  return is_exact;
+}
+
+static double
+_sigmoid (const double x)
+{
+  return 1.0 / (1.0 + exp(-x));
+}
+
+/*
+  Checks that an approximated activation function stays within \b max_error of the exact
+  one over [-20, 20], both in its array form and in its scalar form.
+  */
+static bool
+_is_activation_within (const char* const name,
+                       double            (*exact_function) (double),
+                       const double      max_error)
+{
+  const activation_functions_t* functions = find_activation_functions_by_name(name);
+  real_t* x = malloc_exit_if_null(TRAINING_TEST_ACTIVATION_SAMPLES * sizeof(real_t));
+  real_t* y = malloc_exit_if_null(TRAINING_TEST_ACTIVATION_SAMPLES * sizeof(real_t));
+  _sample_activation_range(x);
+  functions->activation_array_function(x, y, TRAINING_TEST_ACTIVATION_SAMPLES);
+  bool is_within = true;
+  size_t i;
+  for (i = 0; is_within && i < TRAINING_TEST_ACTIVATION_SAMPLES; ++i)
+  {
+    const double expected = exact_function(x[i]);
+    is_within = fabs(y[i] - expected) < max_error
+                && fabs(functions->activation_function(x[i]) - expected) < max_error;
+  }
+
+  free_and_null(y);
+  free_and_null(x);
+  return is_within;
+}
+
+/*
+  Writes a csv file of \b TRAINING_TEST_QUOTED_CSV_LINES lines ending in CRLF, each with
+  its number and a varying number of entries, many of them quoted with commas, quotes, line feeds and
+  CRLF inside, so that the chunks of the file often start within a quoted entry.
+  */
+static void
+_write_quoted_csv_file (const char* path)
+{
+  static const char* const entries[] =
+  {
+    "plain", "\"a, b\"", "\"two\nlines\"", "\"crlf\r\ninside\"", "\"say \"\"hi\"\"\"", "", "\"\"", "12.5",
+    "\"\n\"", "\"trailing,\r\n\"", "\"x\"\"\ny\""
+  };
+  const size_t num_entries = sizeof(entries) / sizeof(entries[0]);
+  FILE* fp = fopen(path, "wb");
+  exit_if_null(fp);
+  unsigned int seed = 3;
+  size_t i, j;
+  for (i = 0; i < TRAINING_TEST_QUOTED_CSV_LINES; ++i)
+  {
+    seed = seed * 1664525u + 1013904223u;
+    const size_t width = (seed >> 16) % 12;
+    fprintf(fp, "%zu", i);
+    for (j = 0; j < width; ++j)
+    {
+      seed = seed * 1664525u + 1013904223u;
+      fputc(',', fp);
+      fputs(entries[(seed >> 16) % num_entries], fp);
+    }
+    fputs("\r\n", fp);
+  }
+  fclose(fp);
+}
+
+/*
+  Checks that construct_csv_data_in_parallel() reads a csv file of several chunks with
+  quoted line breaks exactly as construct_csv_data() does, for several numbers of threads.
+  */
+static bool
+_is_parallel_csv_data_exact ()
+{
+  _write_quoted_csv_file(TRAINING_TEST_QUOTED_CSV_PATH);
+  csv_data_t* expected_data = construct_csv_data(TRAINING_TEST_QUOTED_CSV_PATH);
+  const size_t num_threads[] = {1, 2, 3, 8};
+  bool is_exact = expected_data->line_count == TRAINING_TEST_QUOTED_CSV_LINES;
+  size_t i, j, k;
+  for (k = 0; is_exact && k < sizeof(num_threads) / sizeof(num_threads[0]); ++k)
+  {
+    csv_data_t* data = construct_csv_data_in_parallel(TRAINING_TEST_QUOTED_CSV_PATH, num_threads[k]);
+    is_exact = data->line_count == expected_data->line_count;
+    for (i = 0; is_exact && i < data->line_count; ++i)
+    {
+      is_exact = data->entry_counts[i] == expected_data->entry_counts[i];
+      for (j = 0; is_exact && j < data->entry_counts[i]; ++j)
+      {
+        is_exact = strcmp(data->data[i][j], expected_data->data[i][j]) == 0;
+      }
+    }
+    destruct_csv_data(data);
+  }
+
+  destruct_csv_data(expected_data);
+  return is_exact;
+}
+
+/*
+  Writes a training set file of \b line_count lines of \b width pseudo-random numbers of
+  various signs and magnitudes after a header line. Line \b bad_line, if it is below
+  \b line_count, gets one entry too many.
+  */
+static void
+_write_training_set_file (const char*  path,
+                          const size_t line_count,
+                          const size_t width,
+                          const size_t bad_line,
+                          unsigned int seed)
+{
+  FILE* fp = fopen(path, "wb");
+  exit_if_null(fp);
+  size_t i, j;
+  for (j = 0; j < width; ++j)
+  {
+    fprintf(fp, "Column %zu", j + 1);
+    fputc(j < width - 1 ? ',' : '\n', fp);
+  }
+  for (i = 0; i < line_count; ++i)
+  {
+    const size_t line_width = i == bad_line ? width + 1 : width;
+    for (j = 0; j < line_width; ++j)
+    {
+      seed = seed * 1664525u + 1013904223u;
+      const double value = ((double) (seed >> 8) / (1u << 24) - 0.5) * pow(10.0, (double) (seed % 9) - 3.0);
+      fprintf(fp, "%.17g", value);
+      fputc(j < line_width - 1 ? ',' : '\n', fp);
+    }
+  }
+  fclose(fp);
+}
+
+/*
+  Checks that the entries, ranges and descriptions of a loaded training set file are those
+  given by construct_csv_data() and strtod().
+  */
+static bool
+_is_training_set_file_exact (const char*   path,
+                             real_t* const* values,
+                             const size_t   line_count,
+                             const size_t   width,
+                             const double*  min,
+                             const double*  max,
+                             char* const*   descs)
+{
+  csv_data_t* data = construct_csv_data(path);
+  bool is_exact = data->line_count == line_count + 1 && data->entry_counts[0] == width;
+  size_t i, j;
+  for (j = 0; is_exact && j < width; ++j)
+  {
+    double expected_min = DBL_MAX, expected_max = -DBL_MAX;
+    for (i = 0; is_exact && i < line_count; ++i)
+    {
+      const real_t value = strtod(data->data[i + 1][j], NULL);
+      expected_min = fmin(expected_min, value);
+      expected_max = fmax(expected_max, value);
+      is_exact = data->entry_counts[i + 1] == width && values[i][j] == value;
+    }
+    is_exact = is_exact && min[j] == expected_min && max[j] == expected_max && strcmp(descs[j], data->data[0][j]) == 0;
+  }
+
+  destruct_csv_data(data);
+  return is_exact;
+}
+
+static bool
+_is_large_training_set_exact ()
+{
+  training_set_t* ts = construct_training_set(TRAINING_TEST_LARGE_INPUT_PATH, TRAINING_TEST_LARGE_OUTPUT_PATH);
+  const bool is_exact = ts->training_set_size == TRAINING_TEST_LARGE_LINES
+                        && ts->input_size == TRAINING_TEST_LARGE_INPUT_SIZE
+                        && ts->output_size == TRAINING_TEST_LARGE_OUTPUT_SIZE
+                        && _is_training_set_file_exact(TRAINING_TEST_LARGE_INPUT_PATH, ts->target_inputs,
+                                                       ts->training_set_size, ts->input_size, ts->input_entries_min,
+                                                       ts->input_entries_max, ts->input_entries_desc)
+                        && _is_training_set_file_exact(TRAINING_TEST_LARGE_OUTPUT_PATH, ts->target_outputs,
+                                                       ts->training_set_size, ts->output_size, ts->output_entries_min,
+                                                       ts->output_entries_max, ts->output_entries_desc);
+  destruct_training_set(ts);
+  return is_exact;
+}
+
+static bool
+_is_malformed_training_set_loaded ()
+{
+  // The loader exits on the malformed file, so getting here is a failure.
+  exit_if_null(freopen("/dev/null", "w", stderr));
+  training_set_t* ts = construct_training_set(TRAINING_TEST_MALFORMED_PATH, TRAINING_TEST_LARGE_OUTPUT_PATH);
+  destruct_training_set(ts);
+  return true;
+}
+
+/*
+  Runs a check in a child process with a shared thread pool of \b num_threads threads,
+  which must be started before this process has its own. Returns whether the child
+  exited successfully, which a check passes by returning true.
+  */
+static bool
+_run_in_child (const char* num_threads,
+               bool        (*check) ())
+{
+  fflush(stdout);
+  const pid_t pid = fork();
+  if (pid < 0)
+    putserr_and_exit("Could not fork the test process.");
+  if (pid == 0)
+  {
+    setenv(THREAD_POOL_ENVIRONMENT_VARIABLE, num_threads, 1);
+    exit((*check) () ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
+
+  int child_status;
+  if (waitpid(pid, &child_status, 0) != pid)
+    putserr_and_exit("Could not wait for the test process.");
+  return WIFEXITED(child_status) && WEXITSTATUS(child_status) == EXIT_SUCCESS;
+}
+
+int
+main (int argc, char** argv)
+{
+  (void) argc;
+  (void) argv;
+  // Run the threads even on a single processor, unless told otherwise.
+  setenv(THREAD_POOL_ENVIRONMENT_VARIABLE, "8", 0);
+  int status = EXIT_SUCCESS;
+
+  // A training set file of several chunks must load as construct_csv_data() and strtod() read it,
+  // and a line of the wrong width must be rejected. The loads run before this process starts its thread pool.
+  _write_training_set_file(TRAINING_TEST_LARGE_INPUT_PATH, TRAINING_TEST_LARGE_LINES, TRAINING_TEST_LARGE_INPUT_SIZE,
+                           TRAINING_TEST_LARGE_LINES, 1);
+  _write_training_set_file(TRAINING_TEST_LARGE_OUTPUT_PATH, TRAINING_TEST_LARGE_LINES, TRAINING_TEST_LARGE_OUTPUT_SIZE,
+                           TRAINING_TEST_LARGE_LINES, 2);
+  _write_training_set_file(TRAINING_TEST_MALFORMED_PATH, TRAINING_TEST_LARGE_LINES, TRAINING_TEST_LARGE_INPUT_SIZE,
+                           TRAINING_TEST_LARGE_LINES - 2, 1);
+  // The output file loads in a task of the pool while the input file loads on the calling thread.
+  const char* const loading_num_threads[] = {"1", "3", "8"};
+  size_t i, j;
+  for (i = 0; i < sizeof(loading_num_threads) / sizeof(loading_num_threads[0]); ++i)
+  {
+    if (!_run_in_child(loading_num_threads[i], &_is_large_training_set_exact))
+    {
+      printf("Training set loading with %s=%s: FAILED\n", THREAD_POOL_ENVIRONMENT_VARIABLE, loading_num_threads[i]);
+      status = EXIT_FAILURE;
+    }
+    else
+    {
+      printf("Training set loading with %s=%s: PASSED\n", THREAD_POOL_ENVIRONMENT_VARIABLE, loading_num_threads[i]);
+    }
+  }
+  if (_run_in_child("8", &_is_malformed_training_set_loaded))
+  {
+    printf("Training set with a line of the wrong width: FAILED\n");
+    status = EXIT_FAILURE;
+  }
+  else
+  {
+    printf("Training set with a line of the wrong width: PASSED\n");
+  }
+
+  time_series_data_t* tsd = construct_time_series_data("libcsv/test.csv");
+  struct tm fromt;
+  struct tm tot;
+  memset(&fromt, 0, sizeof(struct tm));
+  memset(&tot, 0, sizeof(struct tm));
+  fromt.tm_year = 2004 - 1900;
+  fromt.tm_mon = 1 - 1;
+  fromt.tm_mday = 1;
+
+  tot.tm_year = 2012 - 1900;
+  tot.tm_mon = 1 - 1;
+  tot.tm_mday = 1;
+
+  generate_training_set_files_from_time_series_data(tsd, mktime(&fromt), mktime(&tot), 5, 2,
+                                                    TRAINING_TEST_INPUT_PATH, TRAINING_TEST_OUTPUT_PATH);
+  destruct_time_series_data(tsd);
+
+  training_set_t* ts = construct_training_set(TRAINING_TEST_INPUT_PATH, TRAINING_TEST_OUTPUT_PATH);
+  normalize_training_set(ts);
+
+  size_t config[] = {30,8,12};
+  neural_network_t* nn = construct_neural_network(config, 3, -2.0, 2.0, &initialize_nguyen_widrow_weights);
+  real_t* expected_weights = construct_neural_network_weight_buffer(nn);
+  real_t* weights = construct_neural_network_weight_buffer(nn);
+
+  // A csv file split into chunks, some starting within quoted entries, must be parsed as a whole file is.
+  if (!_is_parallel_csv_data_exact())
+  {
+    printf("Parallel csv parsing: FAILED\n");
+    status = EXIT_FAILURE;
+  }
+  else
+  {
+    printf("Parallel csv parsing: PASSED\n");
+  }
+
+  // Every thread count must reproduce the single-threaded weights bit for bit.
+  const size_t num_threads[] = {2, 3, 8, 0};
+  const char* const names[] = {"resilient propagation", "mini-batch gradient descent", "Levenberg-Marquardt",
+                               "scaled conjugate gradient", "Adam", "AdamW"};
+  for (j = 0; j < sizeof(names) / sizeof(names[0]); ++j)
+  {
+    const double expected_error = _train(nn, ts, 1, j, expected_weights);
+    for (i = 0; i < sizeof(num_threads) / sizeof(num_threads[0]); ++i)
+    {
+      const double error = _train(nn, ts, num_threads[i], j, weights);
+      if (error != expected_error || memcmp(weights, expected_weights, nn->weights_size * sizeof(real_t)) != 0)
+      {
+        printf("Training with %s and %zu threads: FAILED\n", names[j], num_threads[i]);
+        status = EXIT_FAILURE;
+      }
+      else
+      {
+        printf("Training with %s and %zu threads: PASSED\n", names[j], num_threads[i]);
+      }
+    }
+  }
+
+  // The error returned by the algorithms that only keep steps lowering it must be that of the weights they leave.
+  for (j = 2; j <= 3; ++j)
+  {
+    if (!_is_error_of_final_weights(nn, ts, j, TRAINING_TEST_MAX_EPOCHS))
+    {
+      printf("Training with %s returns the error of its weights: FAILED\n", names[j]);
+      status = EXIT_FAILURE;
+    }
+    else
+    {
+      printf("Training with %s returns the error of its weights: PASSED\n", names[j]);
+    }
+  }
+
+  // The first step of Adam and AdamW must move every weight by about the learning rate.
+  for (j = 4; j < sizeof(names) / sizeof(names[0]); ++j)
+  {
+    if (!_is_first_adam_step_exact(nn, ts, j == 5 ? TRAINING_TEST_WEIGHT_DECAY : 0.0))
+    {
+      printf("First bias-corrected step of %s: FAILED\n", names[j]);
+      status = EXIT_FAILURE;
+    }
+    else
+    {
+      printf("First bias-corrected step of %s: PASSED\n", names[j]);
+    }
+  }
+
+  // The background validation must keep the same best weights.
+  training_set_t* vs = construct_training_set(TRAINING_TEST_INPUT_PATH, TRAINING_TEST_OUTPUT_PATH);
+  normalize_training_set(vs);
+  const double expected_error = _train_with_validation(nn, ts, vs, false, expected_weights);
+  const double error = _train_with_validation(nn, ts, vs, true, weights);
+  if (error != expected_error || memcmp(weights, expected_weights, nn->weights_size * sizeof(real_t)) != 0)
+  {
+    printf("Training with background validation: FAILED\n");
+    status = EXIT_FAILURE;
+  }
+  else
+  {
+    printf("Training with background validation: PASSED\n");
+  }
+
+  // Resuming from a checkpoint must continue exactly as the uninterrupted training.
+  const double uninterrupted_error = _train_with_checkpoint(nn, ts, vs, false, false, expected_weights);
+  _train_with_checkpoint(nn, ts, vs, true, false, weights);
+  const double resumed_error = _train_with_checkpoint(nn, ts, vs, false, true, weights);
+  if (resumed_error != uninterrupted_error
+      || memcmp(weights, expected_weights, nn->weights_size * sizeof(real_t)) != 0)
+  {
+    printf("Training resumed from a checkpoint: FAILED\n");
+    status = EXIT_FAILURE;
+  }
+  else
+  {
+    printf("Training resumed from a checkpoint: PASSED\n");
+  }
+  destruct_training_set(vs);
+
+  // A model file must reproduce the predictions of the neural network it was saved from.
+  if (!_is_model_exact(nn, ts))
+  {
+    printf("Neural network model round trip: FAILED\n");
+    status = EXIT_FAILURE;
+  }
+  else
+  {
+    printf("Neural network model round trip: PASSED\n");
+  }
+
+  // The batch prediction must write the outputs of the neural network for any number of threads.
+  if (!_is_batch_prediction_exact(nn, ts))
+  {
+    printf("Batch prediction: FAILED\n");
+    status = EXIT_FAILURE;
+  }
+  else
+  {
+    printf("Batch prediction: PASSED\n");
+  }
+
+  // The derivative array functions must agree with the scalar derivative functions.
+  if (!_are_derivative_arrays_exact())
+  {
+    printf("Activation derivative arrays: FAILED\n");
+    status = EXIT_FAILURE;
+  }
+  else
+  {
+    printf("Activation derivative arrays: PASSED\n");
+  }
+
+  // The approximated activation functions must keep the error bounds they document.
+  if (!_is_activation_within("fast_tanh", &tanh, TRAINING_TEST_FAST_TANH_MAX_ERROR)
+      || !_is_activation_within("fast_sigmoid", &_sigmoid, TRAINING_TEST_FAST_SIGMOID_MAX_ERROR)
+      || !_is_activation_within("lookup_tanh", &tanh, TRAINING_TEST_LOOKUP_TANH_MAX_ERROR)
+      || !_is_activation_within("lookup_sigmoid", &_sigmoid, TRAINING_TEST_LOOKUP_SIGMOID_MAX_ERROR))
+  {
+    printf("Activation error bounds: FAILED\n");
+    status = EXIT_FAILURE;
+  }
+  else
+  {
+    printf("Activation error bounds: PASSED\n");
+  }
+
+  destruct_neural_network_weight_buffer(weights);
+  destruct_neural_network_weight_buffer(expected_weights);
+  destruct_neural_network(nn);
+  destruct_training_set(ts);
+  remove(TRAINING_TEST_INPUT_PATH);
+  remove(TRAINING_TEST_OUTPUT_PATH);
+  remove(TRAINING_TEST_CHECKPOINT_PATH);
+  remove(TRAINING_TEST_MODEL_PATH);
+  remove(TRAINING_TEST_PREDICTION_INPUT_PATH);
+  remove(TRAINING_TEST_PREDICTION_PATH);
+  remove(TRAINING_TEST_LARGE_INPUT_PATH);
+  remove(TRAINING_TEST_LARGE_OUTPUT_PATH);
+  remove(TRAINING_TEST_MALFORMED_PATH);
+  remove(TRAINING_TEST_QUOTED_CSV_PATH);
+  return status;
+}
@@ -0,0 +1,373 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+
+#include "util.h"
+
+#include "thread-pool.h"
+
+#define THREAD_POOL_INITIAL_QUEUE_CAPACITY 16
+
+/*
+  The pool the current thread works for, and its queue. Outside threads use queue 0.
+  */
+static __thread thread_pool_t* _current_pool = NULL;
+static __thread size_t _current_index = 0;
+
+static thread_pool_t* _shared_thread_pool = NULL;
+static pthread_once_t _shared_thread_pool_once = PTHREAD_ONCE_INIT;
+
+static inline size_t
+_get_queue_index (const thread_pool_t* const pool)
+{
+  return _current_pool == pool ? _current_index : 0;
+}
+
+static void
+_push_task (thread_pool_queue_t*      const queue,
+            const thread_pool_task_t* const task)
+{
+  pthread_mutex_lock(&queue->_mutex);
+  if (queue->_size == queue->_capacity)
+  {
+    // Unwrap the ring into a buffer twice as large.
+    const size_t capacity = queue->_capacity * 2;
+    thread_pool_task_t* const tasks = malloc_exit_if_null(capacity * sizeof(thread_pool_task_t));
+    size_t i;
+    for (i = 0; i < queue->_size; ++i)
+    {
+      tasks[i] = queue->_tasks[(queue->_first + i) % queue->_capacity];
+    }
+    free_and_null(queue->_tasks);
+    queue->_tasks = tasks;
+    queue->_capacity = capacity;
+    queue->_first = 0;
+  }
+  queue->_tasks[(queue->_first + queue->_size) % queue->_capacity] = *task;
+  ++queue->_size;
+  pthread_mutex_unlock(&queue->_mutex);
+}
+
+static bool
+_pop_task (thread_pool_queue_t* const queue,
+           thread_pool_task_t*  const task,
+           const bool                 is_stealing)
+{
+  bool found = false;
+  pthread_mutex_lock(&queue->_mutex);
+  if (queue->_size > 0)
+  {
+    if (is_stealing)
+    {
+      *task = queue->_tasks[queue->_first];
+      queue->_first = (queue->_first + 1) % queue->_capacity;
+    }
+    else
+    {
+      *task = queue->_tasks[(queue->_first + queue->_size - 1) % queue->_capacity];
+    }
+    --queue->_size;
+    found = true;
+  }
+  pthread_mutex_unlock(&queue->_mutex);
+  return found;
+}
+
+/*
+  Runs one task from the queue of thread \b index, or else steals one from the other
+  queues, starting with the next one.
+  */
+static bool
+_run_task (thread_pool_t* const pool,
+           const size_t         index)
+{
+  if (__atomic_load_n(&pool->_num_queued, __ATOMIC_SEQ_CST) == 0)
+    return false;
+
+  thread_pool_task_t task;
+  bool found = _pop_task(&pool->_queues[index], &task, false);
+  size_t i;
+  for (i = 1; !found && i < pool->num_threads; ++i)
+  {
+    found = _pop_task(&pool->_queues[(index + i) % pool->num_threads], &task, true);
+  }
+  if (!found)
+    return false;
+
+  __atomic_sub_fetch(&pool->_num_queued, 1, __ATOMIC_SEQ_CST);
+  (*task._function) (task._data);
+  __atomic_sub_fetch(&task._group->_num_pending, 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+static void*
+_run_worker (void* argument)
+{
+  thread_pool_worker_t* const worker = (thread_pool_worker_t*) argument;
+  thread_pool_t* const pool = worker->_pool;
+  _current_pool = pool;
+  _current_index = worker->_index;
+
+  size_t spin_count = 0;
+  bool is_stopping = false;
+  while (!is_stopping)
+  {
+    if (_run_task(pool, worker->_index))
+    {
+      spin_count = 0;
+    }
+    else if (spin_count < THREAD_POOL_SPIN_COUNT)
+    {
+      ++spin_count;
+      sched_yield();
+    }
+    else
+    {
+      // fork_thread_pool_task() queues the task before it looks for sleepers, and this
+      // thread counts itself as sleeping before it looks for tasks, so one of them sees the other.
+      pthread_mutex_lock(&pool->_sleep_mutex);
+      __atomic_add_fetch(&pool->_num_sleeping, 1, __ATOMIC_SEQ_CST);
+      while (!pool->_is_stopping && __atomic_load_n(&pool->_num_queued, __ATOMIC_SEQ_CST) == 0)
+      {
+        pthread_cond_wait(&pool->_sleep_condition, &pool->_sleep_mutex);
+      }
+      __atomic_sub_fetch(&pool->_num_sleeping, 1, __ATOMIC_SEQ_CST);
+      is_stopping = pool->_is_stopping;
+      pthread_mutex_unlock(&pool->_sleep_mutex);
+      spin_count = 0;
+    }
+  }
+  return NULL;
+}
+
+size_t
+get_available_processor_count ()
+{
+#ifdef CPU_COUNT
+  cpu_set_t set;
+  if (sched_getaffinity(0, sizeof(set), &set) == 0 && CPU_COUNT(&set) > 0)
+    return CPU_COUNT(&set);
+#endif
+  const long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return count > 0 ? (size_t) count : 1;
+}
+
+thread_pool_t*
+construct_thread_pool (const size_t num_threads)
+{
+  // MALLOC: pool
+  thread_pool_t* pool = malloc_exit_if_null(sizeof(thread_pool_t));
+
+  // INIT: pool->num_threads
+  pool->num_threads = num_threads == 0 ? get_available_processor_count() : num_threads;
+
+  // MALLOC: pool->_queues
+  // INIT: pool->_queues
+  pool->_queues = malloc_exit_if_null(pool->num_threads * sizeof(thread_pool_queue_t));
+  size_t i;
+  for (i = 0; i < pool->num_threads; ++i)
+  {
+    pthread_mutex_init(&pool->_queues[i]._mutex, NULL);
+    pool->_queues[i]._capacity = THREAD_POOL_INITIAL_QUEUE_CAPACITY;
+    pool->_queues[i]._tasks = malloc_exit_if_null(THREAD_POOL_INITIAL_QUEUE_CAPACITY * sizeof(thread_pool_task_t));
+    pool->_queues[i]._first = 0;
+    pool->_queues[i]._size = 0;
+  }
+
+  // INIT: pool->_sleep_mutex, pool->_sleep_condition, pool->_num_queued, pool->_num_sleeping, pool->_is_stopping
+  pthread_mutex_init(&pool->_sleep_mutex, NULL);
+  pthread_cond_init(&pool->_sleep_condition, NULL);
+  pool->_num_queued = 0;
+  pool->_num_sleeping = 0;
+  pool->_is_stopping = false;
+
+  // MALLOC: pool->_workers
+  // INIT: pool->_workers
+  // Worker i runs queue i; queue 0 belongs to the calling thread.
+  pool->_workers = malloc_exit_if_null(pool->num_threads * sizeof(thread_pool_worker_t));
+  for (i = 1; i < pool->num_threads; ++i)
+  {
+    pool->_workers[i]._pool = pool;
+    pool->_workers[i]._index = i;
+    const int error = pthread_create(&pool->_workers[i]._thread, NULL, &_run_worker, &pool->_workers[i]);
+    if (error != 0)
+      printferr_and_exit("Could not start thread %zu of the thread pool: %s\n", i, strerror(error));
+  }
+
+  return pool;
+}
+
+void
+destruct_thread_pool (thread_pool_t* pool)
+{
+  pthread_mutex_lock(&pool->_sleep_mutex);
+  pool->_is_stopping = true;
+  pthread_cond_broadcast(&pool->_sleep_condition);
+  pthread_mutex_unlock(&pool->_sleep_mutex);
+
+  // FREE: pool->_workers
+  size_t i;
+  for (i = 1; i < pool->num_threads; ++i)
+  {
+    pthread_join(pool->_workers[i]._thread, NULL);
+  }
+  free_and_null(pool->_workers);
+
+  // FREE: pool->_queues
+  for (i = 0; i < pool->num_threads; ++i)
+  {
+    pthread_mutex_destroy(&pool->_queues[i]._mutex);
+    free_and_null(pool->_queues[i]._tasks);
+  }
+  free_and_null(pool->_queues);
+
+  pthread_cond_destroy(&pool->_sleep_condition);
+  pthread_mutex_destroy(&pool->_sleep_mutex);
+
+  // FREE: pool
+  free_and_null(pool);
+}
+
+static void
+_construct_shared_thread_pool ()
+{
+  size_t num_threads = 0;
+  const char* const value = getenv(THREAD_POOL_ENVIRONMENT_VARIABLE);
+  if (value != NULL)
+    num_threads = strtoul(value, NULL, 10);
+
+  _shared_thread_pool = construct_thread_pool(num_threads);
+}
+
+thread_pool_t*
+get_shared_thread_pool ()
+{
+  pthread_once(&_shared_thread_pool_once, &_construct_shared_thread_pool);
+  return _shared_thread_pool;
+}
+
+void
+reset_thread_pool_task_group (thread_pool_task_group_t* const group)
+{
+  group->_num_pending = 0;
+}
+
+void
+fork_thread_pool_task (thread_pool_t*              const pool,
+                       thread_pool_task_group_t*   const group,
+                       thread_pool_task_function_t       function,
+                       void*                       const data)
+{
+  thread_pool_task_t task;
+  task._function = function;
+  task._data = data;
+  task._group = group;
+
+  __atomic_add_fetch(&group->_num_pending, 1, __ATOMIC_RELAXED);
+  _push_task(&pool->_queues[_get_queue_index(pool)], &task);
+  __atomic_add_fetch(&pool->_num_queued, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&pool->_num_sleeping, __ATOMIC_SEQ_CST) > 0)
+  {
+    pthread_mutex_lock(&pool->_sleep_mutex);
+    pthread_cond_signal(&pool->_sleep_condition);
+    pthread_mutex_unlock(&pool->_sleep_mutex);
+  }
+}
+
+void
+join_thread_pool_task_group (thread_pool_t*            const pool,
+                             thread_pool_task_group_t* const group)
+{
+  const size_t index = _get_queue_index(pool);
+  while (__atomic_load_n(&group->_num_pending, __ATOMIC_ACQUIRE) > 0)
+  {
+    if (!_run_task(pool, index))
+      sched_yield();
+  }
+}
+
+/*
+  The state of one run_thread_pool_parallel_for() call, shared by its slots.
+  */
+struct thread_pool_parallel_for_t
+{
+  thread_pool_range_function_t  function;
+  void*                         data;
+  size_t                        next;
+  size_t                        end;
+  size_t                        grain_size;
+};
+
+typedef struct thread_pool_parallel_for_t thread_pool_parallel_for_t;
+
+struct thread_pool_parallel_for_slot_t
+{
+  thread_pool_parallel_for_t*   loop;
+  size_t                        slot;
+};
+
+typedef struct thread_pool_parallel_for_slot_t thread_pool_parallel_for_slot_t;
+
+static void
+_run_parallel_for_slot (void* data)
+{
+  const thread_pool_parallel_for_slot_t* const slot = (const thread_pool_parallel_for_slot_t*) data;
+  thread_pool_parallel_for_t* const loop = slot->loop;
+  while (true)
+  {
+    const size_t begin = __atomic_fetch_add(&loop->next, loop->grain_size, __ATOMIC_RELAXED);
+    if (begin >= loop->end)
+      break;
+
+    const size_t end = loop->end - begin > loop->grain_size ? begin + loop->grain_size : loop->end;
+    (*loop->function) (loop->data, begin, end, slot->slot);
+  }
+}
+
+void
+run_thread_pool_parallel_for (thread_pool_t*               const pool,
+                              const size_t                       begin,
+                              const size_t                       end,
+                              const size_t                       grain_size,
+                              const size_t                       max_slots,
+                              thread_pool_range_function_t       function,
+                              void*                        const data)
+{
+  if (begin >= end)
+    return;
+
+  if (grain_size == 0)
+    putserr_and_exit("The grain size of a parallel loop must be at least 1.");
+
+  thread_pool_parallel_for_t loop;
+  loop.function = function;
+  loop.data = data;
+  loop.next = begin;
+  loop.end = end;
+  loop.grain_size = grain_size;
+
+  const size_t num_chunks = (end - begin - 1) / grain_size + 1;
+  size_t num_slots = pool->num_threads;
+  if (max_slots != 0 && num_slots > max_slots)
+    num_slots = max_slots;
+  if (num_slots > num_chunks)
+    num_slots = num_chunks;
+
+  // The calling thread runs slot 0 while the others are stolen by idle workers.
+  thread_pool_parallel_for_slot_t slots[num_slots];
+  thread_pool_task_group_t group;
+  reset_thread_pool_task_group(&group);
+  size_t i;
+  for (i = 0; i < num_slots; ++i)
+  {
+    slots[i].loop = &loop;
+    slots[i].slot = i;
+    if (i > 0)
+      fork_thread_pool_task(pool, &group, &_run_parallel_for_slot, &slots[i]);
+  }
+  _run_parallel_for_slot(&slots[0]);
+  join_thread_pool_task_group(pool, &group);
+}
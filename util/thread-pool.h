@@ -0,0 +1,218 @@
+/*!
+  \file util/thread-pool.h
+  \brief A persistent pool of worker threads with work-stealing task queues.
+  \author Hellyna Ng (hellyna@hellyna.com)
+  */
+#ifndef THREAD_POOL_H_1B61B4E3_F6D0_4AAA_B722_F65EACBDCB82
+#define THREAD_POOL_H_1B61B4E3_F6D0_4AAA_B722_F65EACBDCB82
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <pthread.h>
+
+/*!
+  The environment variable that can set the number of threads of get_shared_thread_pool(),
+  eg. \b CANN_THREADS=4. It may exceed the number of available processors.
+  */
+#define THREAD_POOL_ENVIRONMENT_VARIABLE "CANN_THREADS"
+
+/*!
+  The number of times an idle worker looks for a task, yielding the processor in between,
+  before it goes to sleep. It keeps the workers awake between the short, back-to-back
+  parallel loops of a training run.
+  */
+#define THREAD_POOL_SPIN_COUNT 1024
+
+/*!
+  A task run by fork_thread_pool_task().
+  \param data the data the task was forked with.
+  */
+typedef void (*thread_pool_task_function_t) (void* data);
+
+/*!
+  The body of a run_thread_pool_parallel_for() loop.
+  \param data the data the loop was run with.
+  \param begin the first index of this chunk of the loop.
+  \param end one past the last index of this chunk of the loop.
+  \param slot the slot that runs this chunk, from 0 to the number of slots - 1. No two chunks
+         with the same slot run at the same time, so it can index per-thread buffers.
+  */
+typedef void (*thread_pool_range_function_t) (void*        data,
+                                              const size_t begin,
+                                              const size_t end,
+                                              const size_t slot);
+
+/*!
+  The thread_pool_task_group_t \b struct.
+
+  The tasks forked by fork_thread_pool_task() that join_thread_pool_task_group() waits for.
+  It usually lives on the stack of the function that forks the tasks.
+  */
+struct thread_pool_task_group_t
+{
+  size_t                        _num_pending;
+};
+
+typedef struct thread_pool_task_group_t thread_pool_task_group_t;
+
+/*!
+  The thread_pool_task_t \b struct.
+  */
+struct thread_pool_task_t
+{
+  thread_pool_task_function_t   _function;
+  void*                         _data;
+  thread_pool_task_group_t*     _group;
+};
+
+typedef struct thread_pool_task_t thread_pool_task_t;
+
+/*!
+  The thread_pool_queue_t \b struct.
+
+  The tasks forked by one thread. The thread takes its own tasks from the back, newest
+  first, and idle threads steal from the front, oldest first.
+  */
+struct thread_pool_queue_t
+{
+  pthread_mutex_t               _mutex;
+  thread_pool_task_t*           _tasks;
+  size_t                        _capacity;
+  size_t                        _first;
+  size_t                        _size;
+};
+
+typedef struct thread_pool_queue_t thread_pool_queue_t;
+
+struct thread_pool_t;
+
+/*!
+  The thread_pool_worker_t \b struct.
+  */
+struct thread_pool_worker_t
+{
+  struct thread_pool_t*         _pool;
+  size_t                        _index;
+  pthread_t                     _thread;
+};
+
+typedef struct thread_pool_worker_t thread_pool_worker_t;
+
+/*!
+  The thread_pool_t \b struct.
+
+  A pool of \b num_threads - 1 worker threads, which live as long as the pool and sleep
+  when there is nothing to do. The thread that runs a parallel loop or joins a task group
+  works as the remaining one, so that a pool of 1 thread runs everything in the caller.
+
+  A pool can be used by one outside thread at a time, and by the tasks it runs, which can
+  fork and join tasks or run parallel loops of their own.
+  */
+struct thread_pool_t
+{
+  /*!
+    The number of threads that run the tasks, including the calling thread.
+    */
+  size_t                        num_threads;
+  thread_pool_worker_t*         _workers;
+  thread_pool_queue_t*          _queues;
+  pthread_mutex_t               _sleep_mutex;
+  pthread_cond_t                _sleep_condition;
+  size_t                        _num_queued;
+  size_t                        _num_sleeping;
+  bool                          _is_stopping;
+};
+
+typedef struct thread_pool_t thread_pool_t;
+
+/*!
+  Counts the processors this process is allowed to run on, from its CPU affinity mask
+  where the system has one.
+  \return the number of processors, at least 1.
+  */
+size_t
+get_available_processor_count ();
+
+/*!
+  Constructs and starts a new thread_pool_t instance.
+  \param num_threads the number of threads, including the calling thread, or 0 for
+         get_available_processor_count().
+  \return a new thread_pool_t instance, or never returns, but exit with \b EXIT_FAILURE
+          if a thread could not be started.
+  */
+thread_pool_t*
+construct_thread_pool (const size_t num_threads);
+
+/*!
+  Stops the worker threads and frees memory for a thread_pool_t instance.
+  Every task group must have been joined.
+  \param pool the thread_pool_t instance to free and destruct.
+  */
+void
+destruct_thread_pool (thread_pool_t* pool);
+
+/*!
+  Gets the thread pool shared by the whole process, which is constructed on the first
+  call with one thread per available processor, unless \b THREAD_POOL_ENVIRONMENT_VARIABLE
+  says otherwise, and never destructed.
+  \return the shared thread_pool_t instance.
+  */
+thread_pool_t*
+get_shared_thread_pool ();
+
+/*!
+  Initializes an empty task group.
+  \param group the thread_pool_task_group_t instance to initialize.
+  */
+void
+reset_thread_pool_task_group (thread_pool_task_group_t* const group);
+
+/*!
+  Queues a task, which any thread of the pool can run.
+  \param pool the thread_pool_t instance to run the task.
+  \param group the task group that joins the task.
+  \param function the task.
+  \param data the argument of \b function.
+  */
+void
+fork_thread_pool_task (thread_pool_t*              const pool,
+                       thread_pool_task_group_t*   const group,
+                       thread_pool_task_function_t       function,
+                       void*                       const data);
+
+/*!
+  Waits for every task of a group to finish, running queued tasks in the meantime.
+  \param pool the thread_pool_t instance the tasks were forked to.
+  \param group the task group to wait for.
+  */
+void
+join_thread_pool_task_group (thread_pool_t*            const pool,
+                             thread_pool_task_group_t* const group);
+
+/*!
+  Runs \b function over the indices from \b begin to \b end - 1, in chunks of at most
+  \b grain_size indices, and returns when every chunk is done.
+
+  Up to \b max_slots threads of the pool take the chunks in order from a shared counter,
+  so that threads that get short chunks take more of them. Which thread runs which chunk
+  varies from call to call.
+
+  \param pool the thread_pool_t instance to run the loop.
+  \param begin the first index.
+  \param end one past the last index.
+  \param grain_size the number of indices per chunk, at least 1.
+  \param max_slots the maximum number of threads to run the loop on, or 0 for all of them.
+  \param function the body of the loop.
+  \param data the argument of \b function.
+  */
+void
+run_thread_pool_parallel_for (thread_pool_t*               const pool,
+                              const size_t                       begin,
+                              const size_t                       end,
+                              const size_t                       grain_size,
+                              const size_t                       max_slots,
+                              thread_pool_range_function_t       function,
+                              void*                        const data);
+
+#endif
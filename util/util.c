@@ -1,6 +1,11 @@
+#define _POSIX_C_SOURCE 200112L
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
 
 #include "util.h"
 
@@ -10,6 +15,14 @@ rand_double()
   return ((double)rand()/(double)RAND_MAX);
 }
 
+double
+get_monotonic_seconds()
+{
+  struct timespec now;
+  exit_if_not_zero(clock_gettime(CLOCK_MONOTONIC, &now));
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
 inline void*
 malloc_exit_if_null(const size_t size)
 {
@@ -27,6 +40,40 @@ calloc_exit_if_null(const size_t num,
   return p;
 }
 
+void*
+realloc_exit_if_null(void* const  p,
+                     const size_t size)
+{
+  void* q = realloc(p, size);
+  exit_if_null(q);
+  return q;
+}
+
+void*
+aligned_malloc_exit_if_null(const size_t alignment,
+                            const size_t size)
+{
+  void* p = NULL;
+  const int error = posix_memalign(&p, alignment, size);
+  if (error != 0)
+  {
+    errno = error;
+    p = NULL;
+  }
+  exit_if_null(p);
+  return p;
+}
+
+void*
+aligned_calloc_exit_if_null(const size_t alignment,
+                            const size_t num,
+                            const size_t size)
+{
+  void* p = aligned_malloc_exit_if_null(alignment, num * size);
+  memset(p, 0, num * size);
+  return p;
+}
+
 inline void
 free_and_null (void* p)
 {
@@ -54,6 +101,35 @@ exit_if_not_zero (const int n)
   }
 }
 
+void
+fwrite_exit_if_failed (const void* const p,
+                       const size_t      size,
+                       const size_t      count,
+                       FILE*       const fp)
+{
+  if (fwrite(p, size, count, fp) != count)
+  {
+    perror("Error");
+    exit(EXIT_FAILURE);
+  }
+}
+
+void
+fread_exit_if_failed (void*        const p,
+                      const size_t       size,
+                      const size_t       count,
+                      FILE*        const fp)
+{
+  if (fread(p, size, count, fp) != count)
+  {
+    if (ferror(fp))
+      perror("Error");
+    else
+      putserr("Error: Unexpected end of file");
+    exit(EXIT_FAILURE);
+  }
+}
+
 int
 putserr (const char* const str)
 {
@@ -7,6 +7,7 @@
 #define UTIL_H_84A458F6_C279_4C42_9C15_5DB1871DA11B
 
 #include <stddef.h>
+#include <stdio.h>
 
 #ifdef DOXYGEN
   /*!
@@ -27,6 +28,13 @@
 double
 rand_double();
 
+/*!
+  Gets the time of a monotonic clock, which is only meaningful as a difference.
+  \return the time in seconds.
+  */
+double
+get_monotonic_seconds();
+
 /*!
   Allocates memory.
   \param size the size to be allocated in bytes.
@@ -45,6 +53,40 @@ void*
 calloc_exit_if_null(const size_t num,
                     const size_t size);
 
+/*!
+  Resizes memory allocated by malloc_exit_if_null() or calloc_exit_if_null(), keeping its contents.
+  \param p the pointer to the memory to resize, or \b NULL to allocate new memory.
+  \param size the new size in bytes.
+  \return a pointer to the resized memory, which may have moved, or never returns, but exit with \b EXIT_FAILURE if the allocation failed.
+  */
+void*
+realloc_exit_if_null(void* const  p,
+                     const size_t size);
+
+/*!
+  Allocates memory aligned to a boundary.
+  \param alignment the alignment in bytes. Must be a power of two and a multiple of \b sizeof(void*).
+  \param size the size to be allocated in bytes.
+  \return a pointer to the allocated memory, which can be freed with free_and_null(),
+          or never returns, but exit with \b EXIT_FAILURE if the allocation failed.
+  */
+void*
+aligned_malloc_exit_if_null(const size_t alignment,
+                            const size_t size);
+
+/*!
+  Allocates memory aligned to a boundary and initializes it to 0.
+  \param alignment the alignment in bytes. Must be a power of two and a multiple of \b sizeof(void*).
+  \param num the number of elements to be allocated.
+  \param size the size of each element.
+  \return a pointer to the allocated memory, which can be freed with free_and_null(),
+          or never returns, but exit with \b EXIT_FAILURE if the allocation failed.
+  */
+void*
+aligned_calloc_exit_if_null(const size_t alignment,
+                            const size_t num,
+                            const size_t size);
+
 /*!
   Free memory pointed by \b p, and set it to \b NULL.
   \param p the pointer to be freed.
@@ -66,6 +108,34 @@ exit_if_null (const void* const p);
 void
 exit_if_not_zero (const int n);
 
+/*!
+  Writes \b count elements of \b size bytes to a file.
+  \param p the elements to write.
+  \param size the size of each element.
+  \param count the number of elements.
+  \param fp the file to write to.
+  Never returns, but exit with \b EXIT_FAILURE if not every element was written.
+  */
+void
+fwrite_exit_if_failed (const void* const p,
+                       const size_t      size,
+                       const size_t      count,
+                       FILE*       const fp);
+
+/*!
+  Reads \b count elements of \b size bytes from a file.
+  \param p the buffer to read into.
+  \param size the size of each element.
+  \param count the number of elements.
+  \param fp the file to read from.
+  Never returns, but exit with \b EXIT_FAILURE if not every element was read.
+  */
+void
+fread_exit_if_failed (void*        const p,
+                      const size_t       size,
+                      const size_t       count,
+                      FILE*        const fp);
+
 /*!
   Prints to \b stderr.
   \param str the string to print.
@@ -18,6 +18,11 @@ validate_csv_io_data_line_count (const csv_data_t* const input_data,
 size_t
 validate_csv_data_entry_counts (const csv_data_t* const data)
 {
+  if (data->line_count == 0)
+  {
+    putserr_and_exit("Malformed csv data file.");
+  }
+
   size_t i, temp = data->entry_counts[0];
   for (i = 1; i < data->line_count; ++i)
   {